@@ -0,0 +1,397 @@
+/**
+ * @file    Arduino.cpp
+ * @brief   Virtual clock, GPIO, Serial and program entry for the native environment.
+ */
+
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+/* Each clock poll costs this much simulated time, so busy-wait loops on
+   millis() terminate. */
+#define HOST_CLOCK_POLL_COST_US 1
+
+/* Largest single clock step; bounds ISR latency while sleeping in delay(). */
+#define HOST_MAX_STEP_US 100
+
+/* __WFI() resolution, and the SysTick period that wakes it regardless. */
+#define HOST_WFI_STEP_US 10
+#define HOST_SYSTICK_US  1000
+
+#define HOST_MAX_HOOKS 8
+
+HardwareSerial Serial;
+
+static uint64_t now_us = 0;
+static bool advancing = false;
+
+static HostTickHook tick_hooks[HOST_MAX_HOOKS];
+static void *tick_args[HOST_MAX_HOOKS];
+static int tick_count = 0;
+
+static HostPinHook pin_hooks[HOST_MAX_HOOKS];
+static void *pin_args[HOST_MAX_HOOKS];
+static int pin_hook_count = 0;
+
+static HostExitHook exit_hooks[HOST_MAX_HOOKS];
+static void *exit_args[HOST_MAX_HOOKS];
+static int exit_hook_count = 0;
+
+static uint8_t pin_level[HOST_NUM_PINS];
+static void (*isr[HOST_NUM_PINS])(void);
+static uint32_t isr_mode[HOST_NUM_PINS];
+static uint32_t pending_edges = 0;
+static uint32_t edges_raised = 0;
+static int irq_disabled = 0;
+
+/* Print --------------------------------------------------------------------*/
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(const char *str)
+{
+  return write(str);
+}
+
+size_t Print::print(char c)
+{
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+  return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+  return print((long long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  return printNumber(value, base);
+}
+
+size_t Print::print(long long value, int base)
+{
+  if (base == DEC && value < 0) {
+    return print('-') + printNumber((unsigned long long)(-value), base);
+  }
+  return printNumber((unsigned long long)value, base);
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+  return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, value);
+  return print(buf);
+}
+
+size_t Print::println()
+{
+  return write("\r\n");
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  return write((const uint8_t *)buf, ((size_t)len < sizeof(buf)) ? (size_t)len : sizeof(buf) - 1);
+}
+
+size_t Print::printNumber(unsigned long long value, int base)
+{
+  char buf[8 * sizeof(value) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+
+  if (base < 2) {
+    base = DEC;
+  }
+
+  *str = '\0';
+  do {
+    char c = (char)(value % base);
+    value /= base;
+    *--str = (c < 10) ? (char)(c + '0') : (char)(c + 'A' - 10);
+  } while (value);
+
+  return write(str);
+}
+
+/* Serial -------------------------------------------------------------------*/
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  /* Arduino sketches end lines with "\r\n"; keep host logs Unix-style. */
+  if (c != '\r') {
+    fputc(c, stdout);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+void HardwareSerial::flush()
+{
+  fflush(stdout);
+}
+
+/* Clock --------------------------------------------------------------------*/
+
+static void dispatchEdges()
+{
+  while (pending_edges && !irq_disabled) {
+    for (uint32_t pin = 0; pin < HOST_NUM_PINS; pin++) {
+      if (pending_edges & (1UL << pin)) {
+        pending_edges &= ~(1UL << pin);
+        if (isr[pin]) {
+          isr[pin]();
+        }
+      }
+    }
+  }
+}
+
+static void step(uint64_t us)
+{
+  now_us += us;
+  for (int i = 0; i < tick_count; i++) {
+    tick_hooks[i](tick_args[i], now_us);
+  }
+}
+
+uint64_t hostMicros64()
+{
+  return now_us;
+}
+
+void hostAdvanceMicros(uint64_t us)
+{
+  /* A peripheral reacting to a tick may itself charge bus time; that time
+     is accounted for by the outer step. */
+  if (advancing) {
+    now_us += us;
+    return;
+  }
+
+  advancing = true;
+  while (us > 0) {
+    uint64_t chunk = (us > HOST_MAX_STEP_US) ? HOST_MAX_STEP_US : us;
+    step(chunk);
+    us -= chunk;
+  }
+  advancing = false;
+
+  dispatchEdges();
+}
+
+void hostAddTickHook(HostTickHook hook, void *arg)
+{
+  if (tick_count < HOST_MAX_HOOKS) {
+    tick_hooks[tick_count] = hook;
+    tick_args[tick_count] = arg;
+    tick_count++;
+  }
+}
+
+void hostAddPinHook(HostPinHook hook, void *arg)
+{
+  if (pin_hook_count < HOST_MAX_HOOKS) {
+    pin_hooks[pin_hook_count] = hook;
+    pin_args[pin_hook_count] = arg;
+    pin_hook_count++;
+  }
+}
+
+void hostAddExitHook(HostExitHook hook, void *arg)
+{
+  if (exit_hook_count < HOST_MAX_HOOKS) {
+    exit_hooks[exit_hook_count] = hook;
+    exit_args[exit_hook_count] = arg;
+    exit_hook_count++;
+  }
+}
+
+unsigned long millis()
+{
+  hostAdvanceMicros(HOST_CLOCK_POLL_COST_US);
+  return (unsigned long)(now_us / 1000ULL);
+}
+
+unsigned long micros()
+{
+  hostAdvanceMicros(HOST_CLOCK_POLL_COST_US);
+  return (unsigned long)now_us;
+}
+
+void delay(unsigned long ms)
+{
+  hostAdvanceMicros((uint64_t)ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostAdvanceMicros(us);
+}
+
+void __WFI()
+{
+  /* Sleep until a pin interrupt is raised or the next SysTick. */
+  uint64_t systick = (now_us / HOST_SYSTICK_US + 1U) * HOST_SYSTICK_US;
+  uint32_t raised = edges_raised;
+
+  while (edges_raised == raised && now_us < systick) {
+    uint64_t left = systick - now_us;
+    hostAdvanceMicros(left > HOST_WFI_STEP_US ? HOST_WFI_STEP_US : left);
+  }
+}
+
+/* GPIO ---------------------------------------------------------------------*/
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+  if (pin < HOST_NUM_PINS && mode == INPUT_PULLUP) {
+    pin_level[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+  if (pin < HOST_NUM_PINS) {
+    pin_level[pin] = value ? HIGH : LOW;
+  }
+  for (int i = 0; i < pin_hook_count; i++) {
+    pin_hooks[i](pin_args[i], pin, value);
+  }
+}
+
+int digitalRead(uint32_t pin)
+{
+  return (pin < HOST_NUM_PINS) ? pin_level[pin] : LOW;
+}
+
+void hostSetPin(uint32_t pin, int level)
+{
+  if (pin >= HOST_NUM_PINS) {
+    return;
+  }
+
+  uint8_t old = pin_level[pin];
+  pin_level[pin] = level ? HIGH : LOW;
+
+  if (isr[pin] == NULL || old == pin_level[pin]) {
+    return;
+  }
+
+  bool rising = (old == LOW);
+  if (isr_mode[pin] == CHANGE || (isr_mode[pin] == RISING && rising) ||
+      (isr_mode[pin] == FALLING && !rising)) {
+    pending_edges |= (1UL << pin);
+    edges_raised++;
+  }
+}
+
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode)
+{
+  if (pin < HOST_NUM_PINS) {
+    isr[pin] = callback;
+    isr_mode[pin] = mode;
+  }
+}
+
+void detachInterrupt(uint32_t pin)
+{
+  if (pin < HOST_NUM_PINS) {
+    isr[pin] = NULL;
+    pending_edges &= ~(1UL << pin);
+  }
+}
+
+uint32_t digitalPinToInterrupt(uint32_t pin)
+{
+  return pin;
+}
+
+void noInterrupts()
+{
+  irq_disabled++;
+}
+
+void interrupts()
+{
+  if (irq_disabled > 0) {
+    irq_disabled--;
+  }
+  dispatchEdges();
+}
+
+/* Program entry ------------------------------------------------------------*/
+
+__attribute__((weak)) void hostBoardInit(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+}
+
+__attribute__((weak)) bool hostBoardDone()
+{
+  return hostMicros64() >= 10000000ULL;
+}
+
+__attribute__((weak)) void hostBoardEnd()
+{
+}
+
+/* Unit tests (pio test) bring their own main() */
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv)
+{
+  hostBoardInit(argc, argv);
+  setup();
+  while (!hostBoardDone()) {
+    loop();
+  }
+  for (int i = 0; i < exit_hook_count; i++) {
+    exit_hooks[i](exit_args[i]);
+  }
+  hostBoardEnd();
+  fflush(stdout);
+  return 0;
+}
+#endif /* PIO_UNIT_TESTING */
@@ -0,0 +1,166 @@
+/**
+ * @file    Arduino.h
+ * @brief   Minimal Arduino core for the native (host) environment.
+ *
+ * Time is virtual: it only moves when the firmware waits (delay), talks
+ * on a bus (Wire/SPI charge their wire time to the clock) or polls the
+ * clock (each millis()/micros() call costs a microsecond). Peripherals
+ * such as the simulated LSM6DSOX hook into the clock and see every step,
+ * so the firmware runs faster than real time while keeping its timing.
+ */
+
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Constants ----------------------------------------------------------------*/
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT          0x0
+#define OUTPUT         0x1
+#define INPUT_PULLUP   0x2
+#define INPUT_PULLDOWN 0x3
+
+#define CHANGE  2
+#define FALLING 3
+#define RISING  4
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/* Cygnet-style pin names. Only their identity matters on the host. */
+#define D0  0
+#define D1  1
+#define D2  2
+#define D3  3
+#define D4  4
+#define D5  5
+#define D6  6
+#define D7  7
+#define D8  8
+#define D9  9
+#define D10 10
+#define D11 11
+#define D12 12
+#define D13 13
+#define LED_BUILTIN 13
+#define SS  D10
+
+#define HOST_NUM_PINS 32
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+/* Print / Serial -----------------------------------------------------------*/
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println();
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+  private:
+    size_t printNumber(unsigned long long value, int base);
+};
+
+class HardwareSerial : public Print
+{
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush();
+    operator bool() const { return true; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+/* Time ---------------------------------------------------------------------*/
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/** Sleep until an interrupt (pin edge or SysTick), like the CMSIS intrinsic. */
+void __WFI();
+
+/* GPIO and interrupts ------------------------------------------------------*/
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode);
+void detachInterrupt(uint32_t pin);
+uint32_t digitalPinToInterrupt(uint32_t pin);
+void noInterrupts();
+void interrupts();
+
+/* Host-only extensions -----------------------------------------------------*/
+
+/** Called on every clock step with the new time, in microseconds. */
+typedef void (*HostTickHook)(void *arg, uint64_t now_us);
+
+/** Called whenever the firmware drives a pin. */
+typedef void (*HostPinHook)(void *arg, uint32_t pin, uint32_t value);
+
+/** Called once when the run ends, before hostBoardEnd(). */
+typedef void (*HostExitHook)(void *arg);
+
+uint64_t hostMicros64();
+void hostAdvanceMicros(uint64_t us);
+void hostAddTickHook(HostTickHook hook, void *arg);
+void hostAddPinHook(HostPinHook hook, void *arg);
+void hostAddExitHook(HostExitHook hook, void *arg);
+
+/** Drive an input pin from a peripheral model; ISRs see the edge on the next clock step. */
+void hostSetPin(uint32_t pin, int level);
+
+/**
+ * Board hooks. The default (weak) implementations run setup() once and
+ * loop() for ten simulated seconds; a board library overrides them to
+ * attach its peripherals and choose the run length.
+ */
+void hostBoardInit(int argc, char **argv);
+bool hostBoardDone();
+void hostBoardEnd();
+
+/* Sketch entry points ------------------------------------------------------*/
+
+void setup();
+void loop();
+
+#endif /* ARDUINO_HOST_H */
@@ -0,0 +1,64 @@
+/**
+ * @file    EEPROM.cpp
+ * @brief   Host stand-in for the STM32 core's flash-emulated EEPROM.
+ */
+
+#include "EEPROM.h"
+
+#include <stdio.h>
+
+static uint8_t page[E2END + 1];
+static bool page_loaded = false;
+static uint8_t buffer[E2END + 1];
+
+static void load_page(void)
+{
+  if (page_loaded) {
+    return;
+  }
+  memset(page, 0xFF, sizeof(page));
+
+  const char *path = getenv("TALON_HOST_EEPROM");
+  if (path && *path) {
+    FILE *f = fopen(path, "rb");
+    if (f) {
+      size_t n = fread(page, 1, sizeof(page), f);
+      (void)n;
+      fclose(f);
+    }
+  }
+  page_loaded = true;
+}
+
+void eeprom_buffer_fill(void)
+{
+  load_page();
+  memcpy(buffer, page, sizeof(buffer));
+}
+
+void eeprom_buffer_flush(void)
+{
+  load_page();
+  memcpy(page, buffer, sizeof(page));
+
+  const char *path = getenv("TALON_HOST_EEPROM");
+  if (path && *path) {
+    FILE *f = fopen(path, "wb");
+    if (f) {
+      fwrite(page, 1, sizeof(page), f);
+      fclose(f);
+    }
+  }
+}
+
+uint8_t eeprom_buffered_read_byte(const uint32_t pos)
+{
+  return (pos <= E2END) ? buffer[pos] : 0xFF;
+}
+
+void eeprom_buffered_write_byte(uint32_t pos, uint8_t value)
+{
+  if (pos <= E2END) {
+    buffer[pos] = value;
+  }
+}
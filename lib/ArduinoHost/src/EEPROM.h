@@ -0,0 +1,26 @@
+/**
+ * @file    EEPROM.h
+ * @brief   Host stand-in for the STM32 core's flash-emulated EEPROM.
+ *
+ * Implements the buffered API of the STM32 Arduino core (stm32_eeprom.h):
+ * eeprom_buffer_fill() loads the emulation page into a RAM buffer, the
+ * buffered read/write calls work on that buffer and eeprom_buffer_flush()
+ * writes it back as one page program. The page starts erased (0xFF) and is
+ * kept in the file named by $TALON_HOST_EEPROM when it is set, so it
+ * persists across runs like the flash page does across resets.
+ */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "Arduino.h"
+
+/* One 2 KB flash page, as on the STM32L4 */
+#define E2END 0x7FF
+
+void eeprom_buffer_fill(void);
+void eeprom_buffer_flush(void);
+uint8_t eeprom_buffered_read_byte(const uint32_t pos);
+void eeprom_buffered_write_byte(uint32_t pos, uint8_t value);
+
+#endif /* HOST_EEPROM_H */
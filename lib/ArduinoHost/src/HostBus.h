@@ -0,0 +1,24 @@
+/**
+ * @file    HostBus.h
+ * @brief   Register-pointer device model shared by the host Wire and SPI buses.
+ *
+ * A transaction first selects a register (the I2C sub-address or the SPI
+ * command byte), then streams bytes in or out. How the pointer moves after
+ * each byte (auto-increment, FIFO roll-back, ...) is up to the device.
+ */
+
+#ifndef HOST_BUS_H
+#define HOST_BUS_H
+
+#include <stdint.h>
+
+class HostBusDevice
+{
+  public:
+    virtual ~HostBusDevice() {}
+    virtual void busSelect(uint8_t reg) = 0;
+    virtual uint8_t busRead() = 0;
+    virtual void busWrite(uint8_t data) = 0;
+};
+
+#endif /* HOST_BUS_H */
@@ -0,0 +1,105 @@
+/**
+ * @file    HostFlash.cpp
+ * @brief   Host stand-in for spare STM32L4 program flash.
+ */
+
+#include "HostFlash.h"
+
+#include <stdio.h>
+
+static uint8_t flash[HOST_FLASH_PAGES * HOST_FLASH_PAGE_SIZE];
+static uint32_t erases[HOST_FLASH_PAGES];
+static bool flash_loaded = false;
+static FILE *backing = NULL;
+
+static void reportWear(void *arg)
+{
+  (void)arg;
+  uint32_t total = 0;
+  uint32_t most = 0;
+  for (uint32_t i = 0; i < HOST_FLASH_PAGES; i++) {
+    total += erases[i];
+    if (erases[i] > most) {
+      most = erases[i];
+    }
+  }
+  if (total > 0) {
+    printf("flash: %u page erases this run, at most %u on one page\n",
+           (unsigned)total, (unsigned)most);
+  }
+  if (backing) {
+    fclose(backing);
+    backing = NULL;
+  }
+}
+
+static void load_flash(void)
+{
+  if (flash_loaded) {
+    return;
+  }
+  memset(flash, 0xFF, sizeof(flash));
+
+  const char *path = getenv("TALON_HOST_FLASH");
+  if (path && *path) {
+    backing = fopen(path, "r+b");
+    if (backing) {
+      size_t n = fread(flash, 1, sizeof(flash), backing);
+      (void)n;
+    } else {
+      backing = fopen(path, "w+b");
+    }
+    if (backing) {
+      fseek(backing, 0, SEEK_SET);
+      fwrite(flash, 1, sizeof(flash), backing);
+      fflush(backing);
+    }
+  }
+  hostAddExitHook(reportWear, NULL);
+  flash_loaded = true;
+}
+
+static void store(uint32_t offset, uint32_t len)
+{
+  if (backing) {
+    fseek(backing, (long)offset, SEEK_SET);
+    fwrite(&flash[offset], 1, len, backing);
+    fflush(backing);
+  }
+}
+
+const uint8_t *hostFlashData(void)
+{
+  load_flash();
+  return flash;
+}
+
+bool hostFlashErase(uint32_t page)
+{
+  load_flash();
+  if (page >= HOST_FLASH_PAGES) {
+    return false;
+  }
+  memset(&flash[page * HOST_FLASH_PAGE_SIZE], 0xFF, HOST_FLASH_PAGE_SIZE);
+  erases[page]++;
+  hostAdvanceMicros(HOST_FLASH_ERASE_US);
+  store(page * HOST_FLASH_PAGE_SIZE, HOST_FLASH_PAGE_SIZE);
+  return true;
+}
+
+bool hostFlashProgram(uint32_t offset, uint64_t value)
+{
+  load_flash();
+  if ((offset & 7U) != 0 || offset + 8 > sizeof(flash)) {
+    return false;
+  }
+  for (int i = 0; i < 8; i++) {
+    if (flash[offset + i] != 0xFF) {
+      return false;
+    }
+  }
+  memcpy(&flash[offset], &value, 8);
+  hostAdvanceMicros(HOST_FLASH_PROGRAM_US);
+  store(offset, 8);
+  return true;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file    HostFlash.h
+ * @brief   Host stand-in for spare STM32L4 program flash.
+ *
+ * HOST_FLASH_PAGES pages of HOST_FLASH_PAGE_SIZE bytes with NOR flash
+ * rules as on the STM32L4: a page erases to 0xFF, and each 8-byte double
+ * word can be programmed once after that (programming one that is not
+ * erased fails, like PROGERR). Erase and program cost their typical times
+ * on the virtual clock. The contents are kept in the file named by
+ * $TALON_HOST_FLASH when it is set, so they persist across runs like the
+ * flash does across resets; page erase counts are reported at exit.
+ */
+
+#ifndef HOST_FLASH_H
+#define HOST_FLASH_H
+
+#include "Arduino.h"
+
+#define HOST_FLASH_PAGE_SIZE 2048
+#define HOST_FLASH_PAGES 64
+
+/* Typical STM32L4 timings */
+#define HOST_FLASH_ERASE_US 22000
+#define HOST_FLASH_PROGRAM_US 82
+
+/** Memory-mapped view of the flash, HOST_FLASH_PAGES pages. */
+const uint8_t *hostFlashData(void);
+
+/** Erase one page; false if out of range. */
+bool hostFlashErase(uint32_t page);
+
+/** Program the double word at offset (8-byte aligned, erased). */
+bool hostFlashProgram(uint32_t offset, uint64_t value);
+
+#endif /* HOST_FLASH_H */
@@ -0,0 +1,707 @@
+/**
+ * @file    Notecard.cpp
+ * @brief   Local stand-in for the Blues Notecard library on the host.
+ */
+
+#include "Notecard.h"
+
+#include <stdio.h>
+
+/* Serial transfer time charged per request byte (Notecard I2C at 100 kHz). */
+#define NOTECARD_BYTE_COST_US 90
+
+/* JSON tree ----------------------------------------------------------------*/
+
+static char *dupString(const char *s)
+{
+  size_t n = strlen(s) + 1;
+  char *d = (char *)malloc(n);
+  if (d) {
+    memcpy(d, s, n);
+  }
+  return d;
+}
+
+static J *newItem(int type)
+{
+  J *item = (J *)calloc(1, sizeof(J));
+  if (item) {
+    item->type = type;
+  }
+  return item;
+}
+
+J *JCreateObject(void)
+{
+  return newItem(JTYPE_OBJECT);
+}
+
+J *JCreateArray(void)
+{
+  return newItem(JTYPE_ARRAY);
+}
+
+void JDelete(J *item)
+{
+  while (item) {
+    J *next = item->next;
+    JDelete(item->child);
+    free(item->string);
+    free(item->valuestring);
+    free(item);
+    item = next;
+  }
+}
+
+void JAddItemToArray(J *array, J *item)
+{
+  if (array == NULL || item == NULL) {
+    return;
+  }
+  if (array->child == NULL) {
+    array->child = item;
+    return;
+  }
+  J *last = array->child;
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = item;
+}
+
+void JAddItemToObject(J *object, const char *name, J *item)
+{
+  if (object == NULL || item == NULL) {
+    return;
+  }
+  free(item->string);
+  item->string = dupString(name);
+  JAddItemToArray(object, item);
+}
+
+J *JAddStringToObject(J *object, const char *name, const char *string)
+{
+  J *item = newItem(JTYPE_STRING);
+  if (item) {
+    item->valuestring = dupString(string ? string : "");
+    JAddItemToObject(object, name, item);
+  }
+  return item;
+}
+
+J *JAddBoolToObject(J *object, const char *name, bool value)
+{
+  J *item = newItem(value ? JTYPE_TRUE : JTYPE_FALSE);
+  JAddItemToObject(object, name, item);
+  return item;
+}
+
+J *JAddNumberToObject(J *object, const char *name, double number)
+{
+  J *item = newItem(JTYPE_NUMBER);
+  if (item) {
+    item->valuenumber = number;
+    JAddItemToObject(object, name, item);
+  }
+  return item;
+}
+
+J *JAddObjectToObject(J *object, const char *name)
+{
+  J *item = JCreateObject();
+  JAddItemToObject(object, name, item);
+  return item;
+}
+
+J *JAddArrayToObject(J *object, const char *name)
+{
+  J *item = JCreateArray();
+  JAddItemToObject(object, name, item);
+  return item;
+}
+
+J *JGetObjectItem(const J *object, const char *name)
+{
+  if (object == NULL) {
+    return NULL;
+  }
+  for (J *item = object->child; item; item = item->next) {
+    if (item->string && strcmp(item->string, name) == 0) {
+      return item;
+    }
+  }
+  return NULL;
+}
+
+double JGetNumber(const J *object, const char *name)
+{
+  J *item = JGetObjectItem(object, name);
+  return (item && item->type == JTYPE_NUMBER) ? item->valuenumber : 0.0;
+}
+
+const char *JGetString(const J *object, const char *name)
+{
+  J *item = JGetObjectItem(object, name);
+  return (item && item->type == JTYPE_STRING) ? item->valuestring : "";
+}
+
+bool JIsPresent(const J *object, const char *name)
+{
+  return JGetObjectItem(object, name) != NULL;
+}
+
+void JFree(void *p)
+{
+  free(p);
+}
+
+/* Serialisation ------------------------------------------------------------*/
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+} JBuffer;
+
+static void put(JBuffer *b, const char *s, size_t n)
+{
+  if (b->len + n + 1 > b->cap) {
+    size_t cap = (b->cap == 0) ? 256 : b->cap;
+    while (b->len + n + 1 > cap) {
+      cap *= 2;
+    }
+    char *p = (char *)realloc(b->buf, cap);
+    if (p == NULL) {
+      return;
+    }
+    b->buf = p;
+    b->cap = cap;
+  }
+  memcpy(b->buf + b->len, s, n);
+  b->len += n;
+  b->buf[b->len] = '\0';
+}
+
+static void putString(JBuffer *b, const char *s)
+{
+  put(b, "\"", 1);
+  for (; *s; s++) {
+    char esc[8];
+    switch (*s) {
+      case '"':  put(b, "\\\"", 2); break;
+      case '\\': put(b, "\\\\", 2); break;
+      case '\n': put(b, "\\n", 2); break;
+      case '\r': put(b, "\\r", 2); break;
+      case '\t': put(b, "\\t", 2); break;
+      default:
+        if ((unsigned char)*s < 0x20) {
+          snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s);
+          put(b, esc, strlen(esc));
+        } else {
+          put(b, s, 1);
+        }
+        break;
+    }
+  }
+  put(b, "\"", 1);
+}
+
+static void putItem(JBuffer *b, const J *item)
+{
+  char num[32];
+
+  switch (item->type) {
+    case JTYPE_FALSE:  put(b, "false", 5); break;
+    case JTYPE_TRUE:   put(b, "true", 4); break;
+    case JTYPE_NULL:   put(b, "null", 4); break;
+    case JTYPE_STRING: putString(b, item->valuestring); break;
+    case JTYPE_NUMBER:
+      if (item->valuenumber == (double)(long long)item->valuenumber) {
+        snprintf(num, sizeof(num), "%lld", (long long)item->valuenumber);
+      } else {
+        snprintf(num, sizeof(num), "%.17g", item->valuenumber);
+      }
+      put(b, num, strlen(num));
+      break;
+    case JTYPE_ARRAY:
+    case JTYPE_OBJECT:
+      put(b, (item->type == JTYPE_ARRAY) ? "[" : "{", 1);
+      for (const J *c = item->child; c; c = c->next) {
+        if (item->type == JTYPE_OBJECT) {
+          putString(b, c->string ? c->string : "");
+          put(b, ":", 1);
+        }
+        putItem(b, c);
+        if (c->next) {
+          put(b, ",", 1);
+        }
+      }
+      put(b, (item->type == JTYPE_ARRAY) ? "]" : "}", 1);
+      break;
+  }
+}
+
+char *JPrintUnformatted(const J *item)
+{
+  JBuffer b = {NULL, 0, 0};
+  if (item) {
+    putItem(&b, item);
+  }
+  return b.buf;
+}
+
+/* Parsing ------------------------------------------------------------------*/
+
+static const char *skipSpace(const char *p)
+{
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+    p++;
+  }
+  return p;
+}
+
+static const char *parseValue(const char *p, J **out);
+
+/* Returns a malloc'd copy with the escapes resolved; non-ASCII \u becomes '?' */
+static const char *parseString(const char *p, char **out)
+{
+  const char *end = ++p;
+  while (*end && *end != '"') {
+    end += (*end == '\\' && end[1]) ? 2 : 1;
+  }
+  if (*end != '"') {
+    return NULL;
+  }
+
+  char *s = (char *)malloc((size_t)(end - p) + 1);
+  char *d = s;
+  if (s == NULL) {
+    return NULL;
+  }
+  while (p < end) {
+    if (*p != '\\') {
+      *d++ = *p++;
+      continue;
+    }
+    p++;
+    switch (*p) {
+      case 'n': *d++ = '\n'; break;
+      case 'r': *d++ = '\r'; break;
+      case 't': *d++ = '\t'; break;
+      case 'b': *d++ = '\b'; break;
+      case 'f': *d++ = '\f'; break;
+      case 'u': {
+        unsigned code = 0;
+        if (end - p < 5 || sscanf(p + 1, "%4x", &code) != 1) {
+          free(s);
+          return NULL;
+        }
+        *d++ = (code < 0x80) ? (char)code : '?';
+        p += 4;
+        break;
+      }
+      default: *d++ = *p; break;
+    }
+    p++;
+  }
+  *d = '\0';
+  *out = s;
+  return end + 1;
+}
+
+static const char *parseContainer(const char *p, J *item)
+{
+  char close = (item->type == JTYPE_OBJECT) ? '}' : ']';
+  p = skipSpace(p + 1);
+  if (*p == close) {
+    return p + 1;
+  }
+
+  for (;;) {
+    char *name = NULL;
+    if (item->type == JTYPE_OBJECT) {
+      if (*p != '"' || (p = parseString(p, &name)) == NULL) {
+        return NULL;
+      }
+      p = skipSpace(p);
+      if (*p != ':') {
+        free(name);
+        return NULL;
+      }
+      p = skipSpace(p + 1);
+    }
+
+    J *child = NULL;
+    p = parseValue(p, &child);
+    if (p == NULL) {
+      free(name);
+      return NULL;
+    }
+    child->string = name;
+    JAddItemToArray(item, child);
+
+    p = skipSpace(p);
+    if (*p == close) {
+      return p + 1;
+    }
+    if (*p != ',') {
+      return NULL;
+    }
+    p = skipSpace(p + 1);
+  }
+}
+
+static const char *parseValue(const char *p, J **out)
+{
+  J *item = NULL;
+  p = skipSpace(p);
+
+  if (*p == '{' || *p == '[') {
+    item = newItem((*p == '{') ? JTYPE_OBJECT : JTYPE_ARRAY);
+    if (item) {
+      p = parseContainer(p, item);
+    }
+  } else if (*p == '"') {
+    item = newItem(JTYPE_STRING);
+    if (item) {
+      p = parseString(p, &item->valuestring);
+    }
+  } else if (strncmp(p, "true", 4) == 0) {
+    item = newItem(JTYPE_TRUE);
+    p += 4;
+  } else if (strncmp(p, "false", 5) == 0) {
+    item = newItem(JTYPE_FALSE);
+    p += 5;
+  } else if (strncmp(p, "null", 4) == 0) {
+    item = newItem(JTYPE_NULL);
+    p += 4;
+  } else {
+    char *end = NULL;
+    double number = strtod(p, &end);
+    if (end != p) {
+      item = newItem(JTYPE_NUMBER);
+      if (item) {
+        item->valuenumber = number;
+      }
+      p = end;
+    }
+  }
+
+  if (item == NULL || p == NULL) {
+    JDelete(item);
+    return NULL;
+  }
+  *out = item;
+  return p;
+}
+
+J *JParse(const char *value)
+{
+  J *item = NULL;
+  if (value == NULL) {
+    return NULL;
+  }
+  const char *end = parseValue(value, &item);
+  if (end == NULL || *skipSpace(end) != '\0') {
+    JDelete(item);
+    return NULL;
+  }
+  return item;
+}
+
+/* Base64 -------------------------------------------------------------------*/
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int JB64EncodeLen(int len)
+{
+  return ((len + 2) / 3) * 4 + 1;
+}
+
+int JB64Encode(char *encoded, const char *string, int len)
+{
+  const unsigned char *s = (const unsigned char *)string;
+  char *p = encoded;
+  int i;
+
+  for (i = 0; i + 2 < len; i += 3) {
+    *p++ = b64[s[i] >> 2];
+    *p++ = b64[((s[i] & 0x03) << 4) | (s[i + 1] >> 4)];
+    *p++ = b64[((s[i + 1] & 0x0F) << 2) | (s[i + 2] >> 6)];
+    *p++ = b64[s[i + 2] & 0x3F];
+  }
+  if (i < len) {
+    *p++ = b64[s[i] >> 2];
+    if (i == len - 1) {
+      *p++ = b64[(s[i] & 0x03) << 4];
+      *p++ = '=';
+    } else {
+      *p++ = b64[((s[i] & 0x03) << 4) | (s[i + 1] >> 4)];
+      *p++ = b64[(s[i + 1] & 0x0F) << 2];
+    }
+    *p++ = '=';
+  }
+  *p++ = '\0';
+
+  return (int)(p - encoded);
+}
+
+/* Request log ---------------------------------------------------------------*/
+
+static void logLine(const char *json, const char *payload)
+{
+  const char *path = getenv("TALON_HOST_NOTES");
+  if (path && *path) {
+    FILE *f = fopen(path, "a");
+    if (f) {
+      if (payload) {
+        fprintf(f, "%s,\"payload\":\"%s\"}\n", json, payload);
+      } else {
+        fprintf(f, "%s\n", json);
+      }
+      fclose(f);
+    }
+  }
+}
+
+/* Binary buffer ------------------------------------------------------------*/
+
+/* Size of the Notecard's binary buffer, as card.binary reports it. */
+#define NOTECARD_BINARY_MAX 130554
+
+static uint8_t *binaryStore = NULL;
+static uint32_t binaryLength = 0;
+
+static bool binarySupported(void)
+{
+  const char *off = getenv("TALON_HOST_NO_BINARY");
+  return !(off && *off && strcmp(off, "0") != 0);
+}
+
+uint32_t NoteBinaryCodecMaxEncodedLength(uint32_t unencodedLength)
+{
+  /* COBS overhead byte per 254, the leading code byte, the newline */
+  return unencodedLength + unencodedLength / 254 + 2;
+}
+
+const char *NoteBinaryStoreDecodedLength(uint32_t *len)
+{
+  if (!binarySupported()) {
+    return "unknown request: card.binary";
+  }
+  *len = binaryLength;
+  return NULL;
+}
+
+const char *NoteBinaryStoreReset(void)
+{
+  if (!binarySupported()) {
+    return "unknown request: card.binary";
+  }
+  const char *json = "{\"req\":\"card.binary\",\"delete\":true}";
+  hostAdvanceMicros((uint64_t)strlen(json) * NOTECARD_BYTE_COST_US);
+  printf("notecard> %s\n", json);
+  logLine(json, NULL);
+  binaryLength = 0;
+  return NULL;
+}
+
+/* COBS with the newline framing byte XORed out, as note-c sends it. */
+static uint32_t cobsEncode(const uint8_t *in, uint32_t len, uint8_t *out)
+{
+  uint32_t code_at = 0;
+  uint32_t n = 1;
+  uint8_t code = 1;
+
+  for (uint32_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[n++] = in[i] ^ '\n';
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[code_at] = code ^ '\n';
+      code_at = n++;
+      code = 1;
+    }
+  }
+  out[code_at] = code ^ '\n';
+  return n;
+}
+
+static uint32_t cobsDecode(const uint8_t *in, uint32_t len, uint8_t *out)
+{
+  uint32_t n = 0;
+  uint32_t i = 0;
+
+  while (i < len) {
+    uint8_t code = in[i++] ^ '\n';
+    for (uint8_t j = 1; j < code && i < len; j++) {
+      out[n++] = in[i++] ^ '\n';
+    }
+    if (code != 0xFF && i < len) {
+      out[n++] = 0;
+    }
+  }
+  return n;
+}
+
+const char *NoteBinaryStoreTransmit(uint8_t *unencodedData, uint32_t unencodedLen,
+                                    uint32_t bufLen, uint32_t notecardOffset)
+{
+  if (!binarySupported()) {
+    return "unknown request: card.binary.put";
+  }
+  if (bufLen < NoteBinaryCodecMaxEncodedLength(unencodedLen)) {
+    return "binary buffer too small for its encoding";
+  }
+  if (notecardOffset != binaryLength) {
+    return "notecard offset does not match the binary buffer";
+  }
+  if (binaryLength + unencodedLen > NOTECARD_BINARY_MAX) {
+    return "binary buffer full";
+  }
+  if (binaryStore == NULL) {
+    binaryStore = (uint8_t *)malloc(NOTECARD_BINARY_MAX);
+    if (binaryStore == NULL) {
+      return "out of memory";
+    }
+  }
+
+  /* Encoded over the caller's buffer, which is lost, as with note-c */
+  uint8_t *encoded = (uint8_t *)malloc(bufLen);
+  if (encoded == NULL) {
+    return "out of memory";
+  }
+  uint32_t cobs = cobsEncode(unencodedData, unencodedLen, encoded);
+  memcpy(unencodedData, encoded, cobs);
+  unencodedData[cobs] = '\n';
+  free(encoded);
+
+  char json[96];
+  snprintf(json, sizeof(json), "{\"req\":\"card.binary.put\",\"offset\":%u,\"cobs\":%u}",
+           (unsigned)notecardOffset, (unsigned)cobs);
+  hostAdvanceMicros((uint64_t)(strlen(json) + 1 + cobs + 1) * NOTECARD_BYTE_COST_US);
+  printf("notecard> %s\n", json);
+  logLine(json, NULL);
+
+  /* The Notecard's side: unframe into the buffer */
+  uint32_t decoded = cobsDecode(unencodedData, cobs, &binaryStore[binaryLength]);
+  if (decoded != unencodedLen) {
+    return "COBS framing error";
+  }
+  binaryLength += decoded;
+  return NULL;
+}
+
+/* Notecard -----------------------------------------------------------------*/
+
+/* Inside the $TALON_HOST_OFFLINE span, a note.add fails */
+static bool noteRejected(const J *req)
+{
+  const char *span = getenv("TALON_HOST_OFFLINE");
+  double from = 0, to = 0;
+  if (span == NULL || sscanf(span, "%lf-%lf", &from, &to) != 2 ||
+      strcmp(JGetString(req, "req"), "note.add") != 0) {
+    return false;
+  }
+  double now = hostMicros64() / 1e6;
+  if (now < from || now >= to) {
+    return false;
+  }
+  printf("notecard> (offline) note.add %s rejected\n", JGetString(req, "file"));
+  return true;
+}
+
+J *Notecard::newRequest(const char *request)
+{
+  J *req = JCreateObject();
+  JAddStringToObject(req, "req", request);
+  return req;
+}
+
+J *Notecard::newCommand(const char *request)
+{
+  J *req = JCreateObject();
+  JAddStringToObject(req, "cmd", request);
+  return req;
+}
+
+void Notecard::emit(const J *req, const char *payload)
+{
+  char *json = JPrintUnformatted(req);
+  if (json == NULL) {
+    return;
+  }
+
+  // The payload went over in earlier transfers, only the request is charged
+  size_t len = strlen(json);
+  hostAdvanceMicros((uint64_t)len * NOTECARD_BYTE_COST_US);
+
+  if (payload && len > 0 && json[len - 1] == '}') {
+    json[len - 1] = '\0';
+    printf("notecard> %s,\"payload\":\"%s\"}\n", json, payload);
+    logLine(json, payload);
+  } else {
+    printf("notecard> %s\n", json);
+    logLine(json, NULL);
+  }
+
+  free(json);
+}
+
+bool Notecard::sendRequest(J *req)
+{
+  if (req == NULL) {
+    return false;
+  }
+  if (noteRejected(req)) {
+    JDelete(req);
+    return false;
+  }
+
+  J *binary = JGetObjectItem(req, "binary");
+  if (binary && binary->type == JTYPE_TRUE) {
+    if (!binarySupported() || binaryLength == 0) {
+      JDelete(req);
+      return false;
+    }
+    char *payload = (char *)malloc(JB64EncodeLen((int)binaryLength));
+    if (payload == NULL) {
+      JDelete(req);
+      return false;
+    }
+    JB64Encode(payload, (const char *)binaryStore, (int)binaryLength);
+    emit(req, payload);
+    free(payload);
+    binaryLength = 0;
+  } else {
+    emit(req);
+  }
+  JDelete(req);
+  return true;
+}
+
+J *Notecard::requestAndResponse(J *req)
+{
+  if (req == NULL) {
+    return NULL;
+  }
+  J *rsp = JCreateObject();
+  if (noteRejected(req)) {
+    JAddStringToObject(rsp, "err", "note.add: cannot add note {offline}");
+    JDelete(req);
+    return rsp;
+  }
+  emit(req);
+
+  if (strcmp(JGetString(req, "req"), "card.binary") == 0) {
+    if (binarySupported()) {
+      JAddNumberToObject(rsp, "max", NOTECARD_BINARY_MAX);
+      JAddNumberToObject(rsp, "length", binaryLength);
+    } else {
+      JAddStringToObject(rsp, "err", "unknown request: card.binary {io}");
+    }
+  }
+  JDelete(req);
+  return rsp;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file    Notecard.h
+ * @brief   Local stand-in for the Blues Notecard library on the host.
+ *
+ * Implements the subset of the Notecard class and the note-c JSON (J)
+ * helpers the firmware uses. Requests are not sent anywhere: each one is
+ * serialised as a single JSON line to stdout, prefixed with "notecard> ",
+ * and appended to the file named by $TALON_HOST_NOTES when it is set, so
+ * host tools can decode what the firmware would have uploaded.
+ *
+ * The binary buffer (card.binary, NoteBinaryStore*) is kept in host memory.
+ * Transfers are COBS-framed and unframed again as on the serial link, and
+ * checked for offset and size. A note.add with "binary":true is logged
+ * with the buffer attached as base64 in "payload", the way Notehub shows a
+ * note's payload, and empties it. Set $TALON_HOST_NO_BINARY to stand in for
+ * Notecard firmware without binary support.
+ *
+ * $TALON_HOST_OFFLINE="from-to" (seconds of host time) makes note.add fail
+ * in that span, as when the Notecard cannot take notes.
+ */
+
+#ifndef HOST_NOTECARD_H
+#define HOST_NOTECARD_H
+
+#include "Arduino.h"
+
+#define JTYPE_FALSE  1
+#define JTYPE_TRUE   2
+#define JTYPE_NULL   3
+#define JTYPE_NUMBER 4
+#define JTYPE_STRING 5
+#define JTYPE_ARRAY  6
+#define JTYPE_OBJECT 7
+
+typedef struct J {
+  struct J *next;
+  struct J *child;
+  int type;
+  char *string;
+  char *valuestring;
+  double valuenumber;
+} J;
+
+J *JCreateObject(void);
+J *JCreateArray(void);
+void JDelete(J *item);
+J *JAddStringToObject(J *object, const char *name, const char *string);
+J *JAddBoolToObject(J *object, const char *name, bool value);
+J *JAddNumberToObject(J *object, const char *name, double number);
+J *JAddObjectToObject(J *object, const char *name);
+J *JAddArrayToObject(J *object, const char *name);
+void JAddItemToArray(J *array, J *item);
+void JAddItemToObject(J *object, const char *name, J *item);
+J *JGetObjectItem(const J *object, const char *name);
+double JGetNumber(const J *object, const char *name);
+const char *JGetString(const J *object, const char *name);
+bool JIsPresent(const J *object, const char *name);
+char *JPrintUnformatted(const J *item);
+J *JParse(const char *value);
+void JFree(void *p);
+
+int JB64EncodeLen(int len);
+int JB64Encode(char *encoded, const char *string, int len);
+
+uint32_t NoteBinaryCodecMaxEncodedLength(uint32_t unencodedLength);
+const char *NoteBinaryStoreDecodedLength(uint32_t *len);
+const char *NoteBinaryStoreReset(void);
+const char *NoteBinaryStoreTransmit(uint8_t *unencodedData, uint32_t unencodedLen,
+                                    uint32_t bufLen, uint32_t notecardOffset);
+
+class Notecard
+{
+  public:
+    void begin() {}
+    void setDebugOutputStream(Print &stream) { (void)stream; }
+
+    J *newRequest(const char *request);
+    J *newCommand(const char *request);
+    bool sendRequest(J *req);
+    J *requestAndResponse(J *req);
+    void deleteResponse(J *rsp) { JDelete(rsp); }
+
+  private:
+    void emit(const J *req, const char *payload = NULL);
+};
+
+#endif /* HOST_NOTECARD_H */
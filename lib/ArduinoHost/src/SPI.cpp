@@ -0,0 +1,116 @@
+/**
+ * @file    SPI.cpp
+ * @brief   Host SPI master.
+ */
+
+#include "SPI.h"
+
+/* Software overhead of starting a transaction (settings, CS toggle) and
+   of each call into transfer(), in nanoseconds. */
+#define SPI_TRANSACTION_COST_NS 2000
+#define SPI_CALL_COST_NS        500
+
+SPIClass SPI;
+
+static void spiPinHook(void *arg, uint32_t pin, uint32_t value)
+{
+  ((SPIClass *)arg)->chipSelect(pin, value);
+}
+
+SPIClass::SPIClass()
+  : clock_hz(4000000), device_count(0), selected(NULL), command_pending(false), reading(false),
+    pending_ns(0)
+{
+}
+
+void SPIClass::charge(uint64_t ns)
+{
+  pending_ns += ns;
+  if (pending_ns >= 1000U) {
+    hostAdvanceMicros(pending_ns / 1000U);
+    pending_ns %= 1000U;
+  }
+}
+
+void SPIClass::begin()
+{
+}
+
+void SPIClass::attachDevice(uint32_t cs_pin, HostBusDevice *device)
+{
+  if (device_count == 0) {
+    hostAddPinHook(spiPinHook, this);
+  }
+  if (device_count < HOST_SPI_MAX_DEVICES) {
+    pins[device_count] = cs_pin;
+    devices[device_count] = device;
+    device_count++;
+  }
+}
+
+void SPIClass::chipSelect(uint32_t pin, uint32_t value)
+{
+  for (int i = 0; i < device_count; i++) {
+    if (pins[i] != pin) {
+      continue;
+    }
+    if (value == LOW) {
+      selected = devices[i];
+      command_pending = true;
+      reading = false;
+    } else if (selected == devices[i]) {
+      selected = NULL;
+    }
+  }
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  if (settings.clock > 0) {
+    clock_hz = settings.clock;
+  }
+  charge(SPI_TRANSACTION_COST_NS);
+}
+
+void SPIClass::endTransaction()
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  charge(SPI_CALL_COST_NS);
+  return shift(data);
+}
+
+void SPIClass::transfer(void *buf, size_t count)
+{
+  uint8_t *p = (uint8_t *)buf;
+
+  charge(SPI_CALL_COST_NS);
+  for (size_t i = 0; i < count; i++) {
+    p[i] = shift(p[i]);
+  }
+}
+
+uint8_t SPIClass::shift(uint8_t data)
+{
+  uint8_t out = 0xFF;
+
+  charge(8ULL * 1000000000ULL / clock_hz);
+
+  if (selected == NULL) {
+    return out;
+  }
+
+  if (command_pending) {
+    command_pending = false;
+    reading = (data & 0x80U) != 0U;
+    selected->busSelect(data & 0x7FU);
+  } else if (reading) {
+    out = selected->busRead();
+  } else {
+    selected->busWrite(data);
+  }
+
+  return out;
+}
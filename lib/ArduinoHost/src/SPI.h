@@ -0,0 +1,72 @@
+/**
+ * @file    SPI.h
+ * @brief   Host SPI master with the Arduino SPIClass API.
+ *
+ * A device is bound to its chip-select pin; driving CS low starts a frame
+ * whose first byte is the command (bit 7 set for reads), the following
+ * bytes stream through the device's register pointer.
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+#include "HostBus.h"
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+#define HOST_SPI_MAX_DEVICES 4
+
+class SPISettings
+{
+  public:
+    SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+      : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+class SPIClass
+{
+  public:
+    SPIClass();
+
+    void begin();
+    void end() {}
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+
+    uint8_t transfer(uint8_t data);
+    void transfer(void *buf, size_t count);
+
+    /* Host-only: bind a device to a chip-select pin. */
+    void attachDevice(uint32_t cs_pin, HostBusDevice *device);
+
+    /* Host-only: chip-select notifications from digitalWrite(). */
+    void chipSelect(uint32_t pin, uint32_t value);
+
+  private:
+    uint8_t shift(uint8_t data);
+    void charge(uint64_t ns);
+
+    uint32_t clock_hz;
+    uint32_t pins[HOST_SPI_MAX_DEVICES];
+    HostBusDevice *devices[HOST_SPI_MAX_DEVICES];
+    int device_count;
+
+    HostBusDevice *selected;
+    bool command_pending;
+    bool reading;
+    uint64_t pending_ns;
+};
+
+extern SPIClass SPI;
+
+#endif /* HOST_SPI_H */
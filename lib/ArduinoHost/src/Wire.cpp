@@ -0,0 +1,207 @@
+/**
+ * @file    Wire.cpp
+ * @brief   Host I2C master.
+ */
+
+#include "Wire.h"
+
+/* Bits on the wire per byte (8 data + ACK) and per START/STOP pair. */
+#define I2C_BITS_PER_BYTE 9
+#define I2C_BITS_FRAMING  2
+
+TwoWire Wire;
+
+TwoWire::TwoWire()
+  : clock_hz(100000), device_count(0), tx_address(0), tx_length(0), tx_active(false),
+    rx_length(0), rx_index(0), async_hooked(false), async_active(false)
+{
+}
+
+void TwoWire::begin()
+{
+  tx_length = 0;
+  rx_length = 0;
+  rx_index = 0;
+}
+
+void TwoWire::setClock(uint32_t frequency)
+{
+  if (frequency > 0) {
+    clock_hz = frequency;
+  }
+}
+
+void TwoWire::attachDevice(uint8_t address, HostBusDevice *device)
+{
+  if (device_count < HOST_I2C_MAX_DEVICES) {
+    addresses[device_count] = address;
+    devices[device_count] = device;
+    device_count++;
+  }
+}
+
+HostBusDevice *TwoWire::find(uint8_t address)
+{
+  for (int i = 0; i < device_count; i++) {
+    if (addresses[i] == address) {
+      return devices[i];
+    }
+  }
+  return NULL;
+}
+
+void TwoWire::chargeBytes(uint32_t bytes)
+{
+  uint64_t bits = (uint64_t)bytes * I2C_BITS_PER_BYTE + I2C_BITS_FRAMING;
+  hostAdvanceMicros((bits * 1000000ULL + clock_hz - 1) / clock_hz);
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  tx_address = address;
+  tx_length = 0;
+  tx_active = true;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (!tx_active || tx_length >= BUFFER_LENGTH) {
+    return 0;
+  }
+  tx_buffer[tx_length++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+  size_t n = 0;
+  while (quantity-- && write(*data++)) {
+    n++;
+  }
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t sendStop)
+{
+  (void)sendStop;
+  tx_active = false;
+
+  /* Address byte plus payload. */
+  chargeBytes(1U + tx_length);
+
+  HostBusDevice *device = find(tx_address);
+  if (device == NULL) {
+    return 2; /* NACK on address */
+  }
+
+  if (tx_length > 0) {
+    device->busSelect(tx_buffer[0]);
+    for (uint8_t i = 1; i < tx_length; i++) {
+      device->busWrite(tx_buffer[i]);
+    }
+  }
+
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop)
+{
+  (void)sendStop;
+
+  if (quantity > BUFFER_LENGTH) {
+    quantity = BUFFER_LENGTH;
+  }
+
+  rx_index = 0;
+  rx_length = 0;
+
+  chargeBytes(1U + quantity);
+
+  HostBusDevice *device = find(address);
+  if (device == NULL) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < quantity; i++) {
+    rx_buffer[i] = device->busRead();
+  }
+  rx_length = quantity;
+
+  return rx_length;
+}
+
+int TwoWire::available()
+{
+  return rx_length - rx_index;
+}
+
+int TwoWire::read()
+{
+  return (rx_index < rx_length) ? rx_buffer[rx_index++] : -1;
+}
+
+int TwoWire::peek()
+{
+  return (rx_index < rx_length) ? rx_buffer[rx_index] : -1;
+}
+
+/* Background transfers -----------------------------------------------------*/
+
+bool TwoWire::hostMemTransfer(uint8_t address, uint8_t reg, uint8_t *data, uint16_t len, bool write,
+                              HostWireDone done, void *arg)
+{
+  if (async_active) {
+    return false;
+  }
+
+  if (!async_hooked) {
+    hostAddTickHook(asyncTick, this);
+    async_hooked = true;
+  }
+
+  /* START, address, register, then for reads a repeated START and address. */
+  uint64_t bytes = 2U + len + (write ? 0U : 1U);
+  uint64_t bits = bytes * I2C_BITS_PER_BYTE + (write ? I2C_BITS_FRAMING : 2U * I2C_BITS_FRAMING);
+
+  async_end_us = hostMicros64() + (bits * 1000000ULL + clock_hz - 1) / clock_hz;
+  async_address = address;
+  async_reg = reg;
+  async_data = data;
+  async_len = len;
+  async_write = write;
+  async_done = done;
+  async_arg = arg;
+  async_active = true;
+
+  return true;
+}
+
+void TwoWire::asyncTick(void *arg, uint64_t now_us)
+{
+  TwoWire *wire = (TwoWire *)arg;
+
+  if (!wire->async_active || now_us < wire->async_end_us) {
+    return;
+  }
+
+  uint8_t status = 0;
+  HostBusDevice *device = wire->find(wire->async_address);
+
+  if (device == NULL) {
+    status = 2;
+  } else {
+    device->busSelect(wire->async_reg);
+    for (uint16_t i = 0; i < wire->async_len; i++) {
+      if (wire->async_write) {
+        device->busWrite(wire->async_data[i]);
+      } else {
+        wire->async_data[i] = device->busRead();
+      }
+    }
+  }
+
+  wire->async_active = false;
+  if (wire->async_done) {
+    wire->async_done(wire->async_arg, status);
+  }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file    Wire.h
+ * @brief   Host I2C master with the Arduino TwoWire API.
+ *
+ * Transfers are limited to BUFFER_LENGTH bytes like the Arduino core, and
+ * every transaction charges its wire time at the configured clock.
+ */
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+#include "HostBus.h"
+
+#define BUFFER_LENGTH 32
+
+#define HOST_I2C_MAX_DEVICES 4
+
+/** Completion of a background transfer; status 0 on success, 2 on NACK. */
+typedef void (*HostWireDone)(void *arg, uint8_t status);
+
+class TwoWire : public Print
+{
+  public:
+    TwoWire();
+
+    void begin();
+    void end() {}
+    void setClock(uint32_t frequency);
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(uint8_t sendStop = 1);
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = 1);
+    uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t quantity) override;
+    using Print::write;
+    int available();
+    int read();
+    int peek();
+
+    /* Host-only: put a device on the bus at a 7-bit address. */
+    void attachDevice(uint8_t address, HostBusDevice *device);
+
+    /*
+     * Host-only: background register transfer, the way HAL_I2C_Mem_Read_DMA /
+     * HAL_I2C_Mem_Write_DMA run on the target. The call returns at once; the
+     * transfer occupies the bus for its wire time and done() is called from
+     * the clock when it completes, like a DMA completion interrupt. There is
+     * no length limit. Returns false if a transfer is already running.
+     */
+    bool hostMemTransfer(uint8_t address, uint8_t reg, uint8_t *data, uint16_t len, bool write,
+                         HostWireDone done, void *arg);
+    bool hostTransferBusy() const { return async_active; }
+
+  private:
+    HostBusDevice *find(uint8_t address);
+    void chargeBytes(uint32_t bytes);
+    static void asyncTick(void *arg, uint64_t now_us);
+
+    uint32_t clock_hz;
+    uint8_t addresses[HOST_I2C_MAX_DEVICES];
+    HostBusDevice *devices[HOST_I2C_MAX_DEVICES];
+    int device_count;
+
+    uint8_t tx_address;
+    uint8_t tx_buffer[BUFFER_LENGTH];
+    uint8_t tx_length;
+    bool tx_active;
+
+    uint8_t rx_buffer[BUFFER_LENGTH];
+    uint8_t rx_length;
+    uint8_t rx_index;
+
+    bool async_hooked;
+    bool async_active;
+    uint64_t async_end_us;
+    uint8_t async_address;
+    uint8_t async_reg;
+    uint8_t *async_data;
+    uint16_t async_len;
+    bool async_write;
+    HostWireDone async_done;
+    void *async_arg;
+};
+
+extern TwoWire Wire;
+
+#endif /* HOST_WIRE_H */
@@ -0,0 +1,989 @@
+/**
+ * @file    LSM6DSOXSim.cpp
+ * @brief   Register-level model of the LSM6DSOX for the native environment.
+ */
+
+#include "LSM6DSOXSim.h"
+
+#include <string.h>
+#include <math.h>
+
+/* Register banks as selected by FUNC_CFG_ACCESS.reg_access. */
+#define BANK_USER      0U
+#define BANK_SHUB      1U
+#define BANK_EMBEDDED  2U
+
+/* CTRL3_C */
+#define CTRL3_SW_RESET   0x01U
+#define CTRL3_IF_INC     0x04U
+#define CTRL3_H_LACTIVE  0x20U
+
+/* CTRL4_C */
+#define CTRL4_INT2_ON_INT1 0x20U
+
+/* STATUS_REG */
+#define STATUS_XLDA  0x01U
+#define STATUS_GDA   0x02U
+#define STATUS_TDA   0x04U
+
+/* MDx_CFG */
+#define MD_EMB_FUNC  0x02U
+
+/* EMB_FUNC_EN_B / EMB_FUNC_INIT_B */
+#define EMB_FIFO_COMPR 0x08U
+#define EMB_MLC      0x10U
+
+/* FIFO_CTRL2 */
+#define FIFO_COMPR_RT_EN 0x40U
+
+/* PAGE_RW */
+#define PAGE_READ    0x20U
+#define PAGE_WRITE   0x40U
+#define EMB_FUNC_LIR 0x80U
+
+/* COUNTER_BDR_REG1 */
+#define CNT_TRIG_GY  0x20U
+#define CNT_RST      0x40U
+#define CNT_PULSED   0x80U
+
+/* Embedded-function status of the timestamp reset command. */
+#define TIMESTAMP_RESET_CMD 0xAAU
+
+static const float odr_hz[16] = {
+  0.0f, 12.5f, 26.0f, 52.0f, 104.0f, 208.0f, 417.0f, 833.0f,
+  1667.0f, 3333.0f, 6667.0f, 1.6f, 0.0f, 0.0f, 0.0f, 0.0f
+};
+
+static const float mlc_hz[4] = { 12.5f, 26.0f, 52.0f, 104.0f };
+
+static const float xl_sensitivity[4] = { 0.061f, 0.488f, 0.122f, 0.244f };
+
+static int16_t toRaw(float value, float sensitivity)
+{
+  float raw = roundf(value / sensitivity);
+  if (raw > 32767.0f) {
+    return 32767;
+  }
+  if (raw < -32768.0f) {
+    return -32768;
+  }
+  return (int16_t)raw;
+}
+
+static void putLE16(uint8_t *p, int16_t v)
+{
+  p[0] = (uint8_t)((uint16_t)v & 0xFFU);
+  p[1] = (uint8_t)((uint16_t)v >> 8);
+}
+
+static void putAxes(uint8_t *word, uint8_t tag, const int16_t *v)
+{
+  word[0] = tag;
+  for (int i = 0; i < 3; i++) {
+    putLE16(&word[1 + 2 * i], v[i]);
+  }
+}
+
+static bool fitsSigned(int32_t v, int bits)
+{
+  int32_t limit = (int32_t)1 << (bits - 1);
+  return v >= -limit && v < limit;
+}
+
+/* Decimation between a sensor ODR code and its FIFO batch data-rate code. */
+static uint32_t batchDecimation(uint8_t odr, uint8_t bdr)
+{
+  if (bdr == 0U || odr == 0U || odr == 11U) {
+    return 1U;
+  }
+  if (bdr == 11U) {
+    return 1UL << (odr + 2U);
+  }
+  return (bdr >= odr) ? 1U : (1UL << (odr - bdr));
+}
+
+LSM6DSOXSim::LSM6DSOXSim()
+  : motion(NULL), listener(NULL), listener_arg(NULL), now_ns(0), ts_origin_ns(0), clock_ppm(0), drift_mg_c(0.0f)
+{
+  pin_state[0] = 0;
+  pin_state[1] = 0;
+  reset();
+}
+
+void LSM6DSOXSim::reset()
+{
+  memset(user, 0, sizeof(user));
+  memset(emb, 0, sizeof(emb));
+  memset(shub, 0, sizeof(shub));
+  memset(page_mem, 0, sizeof(page_mem));
+
+  user[LSM6DSOX_PIN_CTRL] = 0x3FU;
+  user[LSM6DSOX_WHO_AM_I] = LSM6DSOX_ID;
+  user[LSM6DSOX_CTRL3_C] = CTRL3_IF_INC;
+  user[LSM6DSOX_CTRL9_XL] = 0xE0U;
+
+  emb[LSM6DSOX_PAGE_SEL] = 0x01U;
+  emb[LSM6DSOX_EMB_FUNC_ODR_CFG_B] = 0x4BU;
+  emb[LSM6DSOX_EMB_FUNC_ODR_CFG_C] = 0x15U;
+
+  pointer = 0;
+
+  memset(&xl, 0, sizeof(xl));
+  memset(&gy, 0, sizeof(gy));
+  memset(&temp, 0, sizeof(temp));
+  memset(&mlc, 0, sizeof(mlc));
+
+  memset(out_xl, 0, sizeof(out_xl));
+  memset(out_gy, 0, sizeof(out_gy));
+  out_temp = 0;
+  xl_samples = 0;
+
+  fifo_head = 0;
+  fifo_count = 0;
+  fifo_lost = 0;
+  fifo_ovr = 0;
+  fifo_ovr_latched = 0;
+  fifo_triggered = 0;
+  tag_cnt = 0;
+  ts_phase = 0;
+  bdr_counter = 0;
+  counter_bdr_ia = 0;
+  memset(&xl_compr, 0, sizeof(xl_compr));
+  memset(&gy_compr, 0, sizeof(gy_compr));
+
+  memset(mlc_out, 0, sizeof(mlc_out));
+  mlc_status = 0;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.accel_mg[2] = 1000.0f;
+  frame.temp_c = 25.0f;
+  frame.mlc_class = -1;
+
+  updatePins();
+}
+
+void LSM6DSOXSim::setMotion(LSM6DSOXSimMotion *src)
+{
+  motion = src;
+}
+
+void LSM6DSOXSim::setPinListener(LSM6DSOXSimPinListener l, void *arg)
+{
+  listener = l;
+  listener_arg = arg;
+}
+
+void LSM6DSOXSim::setThermalDrift(float offset_mg_per_c)
+{
+  drift_mg_c = offset_mg_per_c;
+}
+
+void LSM6DSOXSim::setClockErrorPpm(int32_t ppm)
+{
+  clock_ppm = ppm;
+  xl.odr = 0xFFU;
+  gy.odr = 0xFFU;
+  temp.odr = 0xFFU;
+  mlc.odr = 0xFFU;
+  updateTimers();
+}
+
+/* Time ---------------------------------------------------------------------*/
+
+void LSM6DSOXSim::updateChannel(Channel *ch, uint8_t odr)
+{
+  if (ch->odr == odr) {
+    return;
+  }
+
+  ch->odr = odr;
+
+  float hz = (odr < 16U) ? odr_hz[odr] : 0.0f;
+  if (hz <= 0.0f) {
+    ch->period_ns = 0;
+    return;
+  }
+
+  /* 26 Hz to 6667 Hz divide one clock by powers of two (6667 Hz is 256 x
+   * 26 Hz nominal): whole multiples of its period keep the grids aligned */
+  if (odr >= 2U && odr <= 10U) {
+    double base = 1e9 / (26.0 * 256.0) * (1.0 + (double)clock_ppm * 1e-6);
+    ch->period_ns = (uint64_t)base << (10U - odr);
+  } else {
+    double period = 1e9 / (double)hz * (1.0 + (double)clock_ppm * 1e-6);
+    ch->period_ns = (uint64_t)period;
+  }
+
+  /* Sensors share one ODR clock: at equal rates they sample together, and
+   * decimated batching counts ticks of that clock, so a slower batch rate
+   * falls on the same time slots whenever the rate was set */
+  ch->next_ns = (now_ns / ch->period_ns + 1U) * ch->period_ns;
+  ch->batch_phase = (uint32_t)(ch->next_ns / ch->period_ns);
+}
+
+void LSM6DSOXSim::updateTimers()
+{
+  uint8_t xl_odr = user[LSM6DSOX_CTRL1_XL] >> 4;
+  uint8_t gy_odr = user[LSM6DSOX_CTRL2_G] >> 4;
+  if (gy_odr == 11U) {
+    gy_odr = 0U;
+  }
+
+  updateChannel(&xl, xl_odr);
+  updateChannel(&gy, gy_odr);
+
+  /* The temperature sensor runs at 52 Hz while either sensor is on. */
+  updateChannel(&temp, (xl_odr || gy_odr) ? 3U : 0U);
+
+  /* MLC runs at its own rate, on accelerometer data. */
+  uint8_t mlc_code = 0U;
+  if ((emb[LSM6DSOX_EMB_FUNC_EN_B] & EMB_MLC) && xl_odr) {
+    /* Map MLC rates onto the ODR table: 12.5 Hz is code 1, doubling after. */
+    mlc_code = (uint8_t)(((emb[LSM6DSOX_EMB_FUNC_ODR_CFG_C] >> 4) & 0x03U) + 1U);
+  }
+  (void)mlc_hz;
+  updateChannel(&mlc, mlc_code);
+}
+
+void LSM6DSOXSim::advanceTo(uint64_t t_ns)
+{
+  while (true) {
+    uint64_t next = UINT64_MAX;
+    const Channel *channels[4] = { &xl, &gy, &temp, &mlc };
+
+    for (int i = 0; i < 4; i++) {
+      if (channels[i]->period_ns && channels[i]->next_ns < next) {
+        next = channels[i]->next_ns;
+      }
+    }
+
+    if (next > t_ns) {
+      break;
+    }
+
+    now_ns = next;
+    tick(next);
+  }
+
+  if (t_ns > now_ns) {
+    now_ns = t_ns;
+  }
+}
+
+void LSM6DSOXSim::sampleMotion(uint64_t t_ns)
+{
+  if (motion) {
+    frame.mlc_class = -1;
+    motion->sample(t_ns, &frame);
+  }
+}
+
+void LSM6DSOXSim::tick(uint64_t t_ns)
+{
+  bool xl_due = xl.period_ns && xl.next_ns <= t_ns;
+  bool gy_due = gy.period_ns && gy.next_ns <= t_ns;
+  bool temp_due = temp.period_ns && temp.next_ns <= t_ns;
+  bool mlc_due = mlc.period_ns && mlc.next_ns <= t_ns;
+
+  /* Up to three words per sensor (a compression flush) plus temperature */
+  uint8_t words[7][LSM6DSOX_SIM_WORD_SIZE];
+  int word_count = 0;
+  bool batched = false;  /* a batch slot, even if the compressor holds it */
+
+  sampleMotion(t_ns);
+
+  uint8_t fifo_ctrl3 = user[LSM6DSOX_FIFO_CTRL3];
+  uint8_t fifo_ctrl4 = user[LSM6DSOX_FIFO_CTRL4];
+
+  if (xl_due) {
+    xl.next_ns += xl.period_ns;
+    xl_samples++;
+
+    float sens = xl_sensitivity[(user[LSM6DSOX_CTRL1_XL] >> 2) & 0x03U];
+    float drift = drift_mg_c * (frame.temp_c - 25.0f);
+    for (int i = 0; i < 3; i++) {
+      out_xl[i] = toRaw(frame.accel_mg[i] + drift, sens);
+    }
+    user[LSM6DSOX_STATUS_REG] |= STATUS_XLDA;
+
+    uint8_t bdr = fifo_ctrl3 & 0x0FU;
+    uint32_t phase = xl.batch_phase++;
+    if (bdr && (phase % batchDecimation(xl.odr, bdr)) == 0U) {
+      word_count += batchSample(&xl_compr, false, out_xl, &words[word_count]);
+      batched = true;
+
+      if (!(user[LSM6DSOX_COUNTER_BDR_REG1] & CNT_TRIG_GY)) {
+        bdr_counter++;
+      }
+    }
+  }
+
+  if (gy_due) {
+    gy.next_ns += gy.period_ns;
+
+    uint8_t fs = (user[LSM6DSOX_CTRL2_G] >> 1) & 0x07U;
+    float sens = (fs & 0x01U) ? 4.375f : 8.75f * (float)(1U << (fs >> 1));
+    for (int i = 0; i < 3; i++) {
+      out_gy[i] = toRaw(frame.gyro_mdps[i], sens);
+    }
+    user[LSM6DSOX_STATUS_REG] |= STATUS_GDA;
+
+    uint8_t bdr = fifo_ctrl3 >> 4;
+    uint32_t phase = gy.batch_phase++;
+    if (bdr && (phase % batchDecimation(gy.odr, bdr)) == 0U) {
+      word_count += batchSample(&gy_compr, true, out_gy, &words[word_count]);
+      batched = true;
+
+      if (user[LSM6DSOX_COUNTER_BDR_REG1] & CNT_TRIG_GY) {
+        bdr_counter++;
+      }
+    }
+  }
+
+  if (temp_due) {
+    temp.next_ns += temp.period_ns;
+
+    out_temp = toRaw(frame.temp_c - 25.0f, 1.0f / 256.0f);
+    user[LSM6DSOX_STATUS_REG] |= STATUS_TDA;
+
+    static const uint32_t temp_dec[4] = { 0U, 32U, 4U, 1U };
+    uint8_t odr_t = (fifo_ctrl4 >> 4) & 0x03U;
+    uint32_t phase = temp.batch_phase++;
+    if (odr_t && (phase % temp_dec[odr_t]) == 0U) {
+      memset(words[word_count], 0, LSM6DSOX_SIM_WORD_SIZE);
+      words[word_count][0] = LSM6DSOX_TEMPERATURE_TAG;
+      putLE16(&words[word_count][1], out_temp);
+      word_count++;
+      batched = true;
+    }
+  }
+
+  /* The tag counter and timestamp decimation count batch slots, not words */
+  if (batched) {
+    static const uint32_t ts_dec[4] = { 0U, 1U, 8U, 32U };
+    uint8_t odr_ts = (fifo_ctrl4 >> 6) & 0x03U;
+
+    if (odr_ts && (ts_phase++ % ts_dec[odr_ts]) == 0U) {
+      uint8_t ts[6] = { 0 };
+      uint32_t t = timestamp();
+      ts[0] = (uint8_t)t;
+      ts[1] = (uint8_t)(t >> 8);
+      ts[2] = (uint8_t)(t >> 16);
+      ts[3] = (uint8_t)(t >> 24);
+      fifoPush(LSM6DSOX_TIMESTAMP_TAG, ts);
+    }
+
+    for (int i = 0; i < word_count; i++) {
+      fifoPush(words[i][0], &words[i][1]);
+    }
+    tag_cnt = (uint8_t)((tag_cnt + 1U) & 0x03U);
+
+    uint16_t threshold = (uint16_t)(((user[LSM6DSOX_COUNTER_BDR_REG1] & 0x07U) << 8) |
+                                    user[LSM6DSOX_COUNTER_BDR_REG2]);
+    if (threshold && bdr_counter >= threshold) {
+      bdr_counter = 0;
+      counter_bdr_ia = 1;
+    }
+  }
+
+  if (mlc_due) {
+    mlc.next_ns += mlc.period_ns;
+    runMLC(t_ns);
+  }
+
+  updatePins();
+}
+
+uint32_t LSM6DSOXSim::timestamp() const
+{
+  if (!(user[LSM6DSOX_CTRL10_C] & 0x20U)) {
+    return 0;
+  }
+  double tick_ns = 25000.0 * (1.0 + (double)clock_ppm * 1e-6);
+  return (uint32_t)(uint64_t)((double)(now_ns - ts_origin_ns) / tick_ns);
+}
+
+/* FIFO compression ---------------------------------------------------------*/
+
+bool LSM6DSOXSim::compressionEnabled() const
+{
+  return (emb[LSM6DSOX_EMB_FUNC_EN_B] & EMB_FIFO_COMPR) &&
+         (user[LSM6DSOX_FIFO_CTRL2] & FIFO_COMPR_RT_EN);
+}
+
+/*
+ * Batch one sample and build the words it completes. Uncompressed, every
+ * sample is an NC word. Compressed, samples collect in groups of three: a
+ * group whose successive differences fit in 5 bits becomes a 3xC word,
+ * otherwise the oldest two go out as 2xC if they fit in 8 bits, or the
+ * oldest alone as NC_T_2. Every uncoptr_rate samples the queue is flushed
+ * uncompressed (NC_T_2, NC_T_1, NC) so a reader can resynchronise.
+ */
+int LSM6DSOXSim::batchSample(Compressor *c, bool gyro, const int16_t *sample,
+                             uint8_t (*words)[LSM6DSOX_SIM_WORD_SIZE])
+{
+  uint8_t nc_tag = gyro ? LSM6DSOX_GYRO_NC_TAG : LSM6DSOX_XL_NC_TAG;
+
+  /* The compressor starts over whenever the FIFO stops storing. */
+  if (!compressionEnabled() || !fifoStoring()) {
+    memset(c, 0, sizeof(*c));
+    putAxes(words[0], nc_tag, sample);
+    return 1;
+  }
+
+  /* NC_T_2, NC_T_1, 2xC and 3xC follow each other for both sensors. */
+  uint8_t nc_t_2_tag = gyro ? LSM6DSOX_GYRO_NC_T_2_TAG : LSM6DSOX_XL_NC_T_2_TAG;
+  static const uint16_t forced_rate[4] = { 0U, 8U, 16U, 32U };
+  uint16_t rate = forced_rate[(user[LSM6DSOX_FIFO_CTRL2] >> 1) & 0x03U];
+  int n = 0;
+
+  memcpy(c->pending[c->pending_count++], sample, sizeof(c->pending[0]));
+  c->since_nc++;
+
+  if (!c->has_ref || (rate && c->since_nc >= rate)) {
+    for (uint8_t i = 0; i + 1U < c->pending_count; i++) {
+      uint8_t age = (uint8_t)(c->pending_count - 1U - i);
+      putAxes(words[n++], (uint8_t)(nc_t_2_tag + 2U - age), c->pending[i]);
+    }
+    putAxes(words[n++], nc_tag, sample);
+    memcpy(c->ref, sample, sizeof(c->ref));
+    c->has_ref = 1;
+    c->pending_count = 0;
+    c->since_nc = 0;
+    return n;
+  }
+
+  if (c->pending_count < 3U) {
+    return 0;
+  }
+
+  int32_t diff[3][3];
+  const int16_t *prev = c->ref;
+  bool fit5 = true;
+  bool fit8 = true;
+
+  for (int s = 0; s < 3; s++) {
+    for (int i = 0; i < 3; i++) {
+      diff[s][i] = (int32_t)c->pending[s][i] - prev[i];
+      fit5 = fit5 && fitsSigned(diff[s][i], 5);
+      if (s < 2) {
+        fit8 = fit8 && fitsSigned(diff[s][i], 8);
+      }
+    }
+    prev = c->pending[s];
+  }
+
+  uint8_t *word = words[n++];
+
+  if (fit5) {
+    word[0] = (uint8_t)(nc_t_2_tag + 3U);
+    for (int s = 0; s < 3; s++) {
+      uint16_t packed = (uint16_t)((diff[s][0] & 0x1F) | ((diff[s][1] & 0x1F) << 5) |
+                                   ((diff[s][2] & 0x1F) << 10));
+      word[1 + 2 * s] = (uint8_t)packed;
+      word[2 + 2 * s] = (uint8_t)(packed >> 8);
+    }
+    memcpy(c->ref, c->pending[2], sizeof(c->ref));
+    c->pending_count = 0;
+  } else if (fit8) {
+    word[0] = (uint8_t)(nc_t_2_tag + 2U);
+    for (int s = 0; s < 2; s++) {
+      for (int i = 0; i < 3; i++) {
+        word[1 + 3 * s + i] = (uint8_t)(int8_t)diff[s][i];
+      }
+    }
+    memcpy(c->ref, c->pending[1], sizeof(c->ref));
+    memcpy(c->pending[0], c->pending[2], sizeof(c->pending[0]));
+    c->pending_count = 1;
+  } else {
+    putAxes(word, nc_t_2_tag, c->pending[0]);
+    memcpy(c->ref, c->pending[0], sizeof(c->ref));
+    memmove(c->pending[0], c->pending[1], 2 * sizeof(c->pending[0]));
+    c->pending_count = 2;
+  }
+
+  return n;
+}
+
+/* Machine Learning Core ----------------------------------------------------*/
+
+void LSM6DSOXSim::runMLC(uint64_t t_ns)
+{
+  (void)t_ns;
+
+  if (frame.mlc_class < 0 || (uint8_t)frame.mlc_class == mlc_out[0]) {
+    return;
+  }
+
+  mlc_out[0] = (uint8_t)frame.mlc_class;
+  raiseEmbeddedEvent(0x01U);
+}
+
+void LSM6DSOXSim::setMLCOutput(uint8_t index, uint8_t value)
+{
+  if (index >= 8U || mlc_out[index] == value) {
+    return;
+  }
+  mlc_out[index] = value;
+  raiseEmbeddedEvent((uint8_t)(1U << index));
+  updatePins();
+}
+
+void LSM6DSOXSim::raiseEmbeddedEvent(uint8_t mlc_mask)
+{
+  mlc_status |= mlc_mask;
+
+  bool to_int1 = (user[LSM6DSOX_MD1_CFG] & MD_EMB_FUNC) && (emb[LSM6DSOX_MLC_INT1] & mlc_mask);
+  bool to_int2 = (user[LSM6DSOX_MD2_CFG] & MD_EMB_FUNC) && (emb[LSM6DSOX_MLC_INT2] & mlc_mask);
+
+  if (!to_int1 && !to_int2) {
+    return;
+  }
+
+  /* A routed event is what switches the FIFO in the triggered modes. */
+  fifoTrigger();
+
+  if (emb[LSM6DSOX_PAGE_RW] & EMB_FUNC_LIR) {
+    return;  /* latched: the level follows mlc_status in pinLevel() */
+  }
+
+  /* Pulsed: one edge pair per event. */
+  LSM6DSOXSimPin_t pin = to_int1 ? LSM6DSOX_SIM_INT1 : LSM6DSOX_SIM_INT2;
+  if (to_int2 && (user[LSM6DSOX_CTRL4_C] & CTRL4_INT2_ON_INT1)) {
+    pin = LSM6DSOX_SIM_INT1;
+  }
+  if (listener && pin_state[pin] == 0) {
+    int active = (user[LSM6DSOX_CTRL3_C] & CTRL3_H_LACTIVE) ? 0 : 1;
+    listener(listener_arg, pin, active);
+    listener(listener_arg, pin, !active);
+  }
+}
+
+/* FIFO ---------------------------------------------------------------------*/
+
+uint16_t LSM6DSOXSim::fifoDepth() const
+{
+  uint8_t ctrl2 = user[LSM6DSOX_FIFO_CTRL2];
+  uint16_t wtm = (uint16_t)(((ctrl2 & 0x01U) << 8) | user[LSM6DSOX_FIFO_CTRL1]);
+
+  if ((ctrl2 & 0x80U) && wtm) {
+    return wtm;
+  }
+  return LSM6DSOX_SIM_FIFO_DEPTH;
+}
+
+bool LSM6DSOXSim::fifoStoring() const
+{
+  switch (user[LSM6DSOX_FIFO_CTRL4] & 0x07U) {
+    case LSM6DSOX_FIFO_MODE:
+    case LSM6DSOX_STREAM_TO_FIFO_MODE:
+    case LSM6DSOX_STREAM_MODE:
+      return true;
+    case LSM6DSOX_BYPASS_TO_STREAM_MODE:
+    case LSM6DSOX_BYPASS_TO_FIFO_MODE:
+      return fifo_triggered != 0U;
+    default:
+      return false;
+  }
+}
+
+void LSM6DSOXSim::fifoPush(uint8_t tag, const uint8_t *data)
+{
+  if (!fifoStoring()) {
+    return;
+  }
+
+  uint8_t mode = user[LSM6DSOX_FIFO_CTRL4] & 0x07U;
+  bool stream = (mode == LSM6DSOX_STREAM_MODE) ||
+                (mode == LSM6DSOX_STREAM_TO_FIFO_MODE && !fifo_triggered) ||
+                (mode == LSM6DSOX_BYPASS_TO_STREAM_MODE);
+
+  if (fifo_count >= fifoDepth()) {
+    fifo_lost++;
+    if (!stream) {
+      return;  /* FIFO mode: stop collecting when full */
+    }
+    fifo_head = (uint16_t)((fifo_head + 1U) % LSM6DSOX_SIM_FIFO_DEPTH);
+    fifo_count--;
+    fifo_ovr = 1;
+    fifo_ovr_latched = 1;
+  }
+
+  uint8_t *word = fifo[(fifo_head + fifo_count) % LSM6DSOX_SIM_FIFO_DEPTH];
+  uint8_t tag_byte = (uint8_t)((tag << 3) | (tag_cnt << 1));
+  uint8_t parity = 0;
+  for (uint8_t b = tag_byte; b; b >>= 1) {
+    parity ^= (b & 1U);
+  }
+  word[0] = (uint8_t)(tag_byte | parity);
+  memcpy(&word[1], data, LSM6DSOX_SIM_WORD_SIZE - 1);
+  fifo_count++;
+}
+
+void LSM6DSOXSim::fifoPop()
+{
+  if (fifo_count == 0U) {
+    return;
+  }
+  fifo_head = (uint16_t)((fifo_head + 1U) % LSM6DSOX_SIM_FIFO_DEPTH);
+  fifo_count--;
+  fifo_ovr = 0;
+}
+
+void LSM6DSOXSim::fifoTrigger()
+{
+  fifo_triggered = 1;
+}
+
+uint8_t LSM6DSOXSim::fifoStatus1() const
+{
+  return (uint8_t)(fifo_count & 0xFFU);
+}
+
+uint8_t LSM6DSOXSim::fifoStatus2() const
+{
+  uint16_t wtm = (uint16_t)(((user[LSM6DSOX_FIFO_CTRL2] & 0x01U) << 8) | user[LSM6DSOX_FIFO_CTRL1]);
+  uint8_t status = (uint8_t)((fifo_count >> 8) & 0x03U);
+
+  status |= (uint8_t)(fifo_ovr_latched << 3);
+  status |= (uint8_t)(counter_bdr_ia << 4);
+  if (fifo_count >= fifoDepth()) {
+    status |= 0x20U;
+  }
+  status |= (uint8_t)(fifo_ovr << 6);
+  if (wtm && fifo_count >= wtm) {
+    status |= 0x80U;
+  }
+  return status;
+}
+
+/* Interrupt lines ----------------------------------------------------------*/
+
+int LSM6DSOXSim::pinLevel(LSM6DSOXSimPin_t pin) const
+{
+  uint8_t status = user[LSM6DSOX_STATUS_REG];
+  uint8_t fifo_status = fifoStatus2();
+  bool latched = (emb[LSM6DSOX_PAGE_RW] & EMB_FUNC_LIR) != 0U;
+  bool level = false;
+
+  for (int p = 0; p < 2; p++) {
+    if (p != (int)pin && !(pin == LSM6DSOX_SIM_INT1 && (user[LSM6DSOX_CTRL4_C] & CTRL4_INT2_ON_INT1))) {
+      continue;
+    }
+
+    uint8_t ctrl = user[(p == 0) ? LSM6DSOX_INT1_CTRL : LSM6DSOX_INT2_CTRL];
+    uint8_t md = user[(p == 0) ? LSM6DSOX_MD1_CFG : LSM6DSOX_MD2_CFG];
+    uint8_t mlc_route = emb[(p == 0) ? LSM6DSOX_MLC_INT1 : LSM6DSOX_MLC_INT2];
+
+    level = level || ((ctrl & 0x01U) && (status & STATUS_XLDA));
+    level = level || ((ctrl & 0x02U) && (status & STATUS_GDA));
+    level = level || ((ctrl & 0x08U) && (fifo_status & 0x80U));
+    level = level || ((ctrl & 0x10U) && (fifo_status & 0x40U));
+    level = level || ((ctrl & 0x20U) && (fifo_status & 0x20U));
+    level = level || ((ctrl & 0x40U) && counter_bdr_ia && !(user[LSM6DSOX_COUNTER_BDR_REG1] & CNT_PULSED));
+    level = level || (latched && (md & MD_EMB_FUNC) && (mlc_status & mlc_route));
+  }
+
+  if (user[LSM6DSOX_CTRL3_C] & CTRL3_H_LACTIVE) {
+    return level ? 0 : 1;
+  }
+  return level ? 1 : 0;
+}
+
+void LSM6DSOXSim::updatePins()
+{
+  for (int p = 0; p < 2; p++) {
+    int level = pinLevel((LSM6DSOXSimPin_t)p);
+    if (level != pin_state[p]) {
+      pin_state[p] = level;
+      if (listener) {
+        listener(listener_arg, (LSM6DSOXSimPin_t)p, level);
+      }
+    }
+  }
+}
+
+/* Register access ----------------------------------------------------------*/
+
+uint8_t LSM6DSOXSim::nextPointer(uint8_t reg) const
+{
+  if (!(user[LSM6DSOX_CTRL3_C] & CTRL3_IF_INC)) {
+    return reg;
+  }
+
+  uint8_t bank = user[LSM6DSOX_FUNC_CFG_ACCESS] >> 6;
+  if (bank == BANK_USER && reg == 0x7EU) {
+    return LSM6DSOX_FIFO_DATA_OUT_TAG;  /* FIFO output rolls back to the tag */
+  }
+  return (uint8_t)((reg + 1U) & 0x7FU);
+}
+
+uint8_t LSM6DSOXSim::readByte(uint8_t reg)
+{
+  uint8_t bank = user[LSM6DSOX_FUNC_CFG_ACCESS] >> 6;
+
+  if (reg == LSM6DSOX_FUNC_CFG_ACCESS) {
+    return user[reg];
+  }
+
+  if (bank == BANK_EMBEDDED) {
+    if (reg == LSM6DSOX_PAGE_VALUE) {
+      if (!(emb[LSM6DSOX_PAGE_RW] & PAGE_READ)) {
+        return 0;
+      }
+      uint8_t page = (emb[LSM6DSOX_PAGE_SEL] >> 4) & 0x03U;
+      return page_mem[page][emb[LSM6DSOX_PAGE_ADDRESS]++];
+    }
+    if (reg == LSM6DSOX_MLC_STATUS) {
+      return mlc_status;
+    }
+    if (reg >= LSM6DSOX_MLC0_SRC && reg <= LSM6DSOX_MLC7_SRC) {
+      mlc_status &= (uint8_t)~(1U << (reg - LSM6DSOX_MLC0_SRC));
+      return mlc_out[reg - LSM6DSOX_MLC0_SRC];
+    }
+    return emb[reg];
+  }
+
+  if (bank == BANK_SHUB) {
+    return shub[reg];
+  }
+
+  switch (reg) {
+    case LSM6DSOX_WHO_AM_I:
+      return LSM6DSOX_ID;
+
+    case LSM6DSOX_MLC_STATUS_MAINPAGE:
+      return mlc_status;
+
+    case LSM6DSOX_FIFO_STATUS1:
+      return fifoStatus1();
+
+    case LSM6DSOX_FIFO_STATUS2:
+    {
+      uint8_t status = fifoStatus2();
+      fifo_ovr_latched = 0;
+      counter_bdr_ia = 0;
+      return status;
+    }
+
+    case LSM6DSOX_TIMESTAMP0:
+    case LSM6DSOX_TIMESTAMP1:
+    case LSM6DSOX_TIMESTAMP2:
+    case LSM6DSOX_TIMESTAMP3:
+      return (uint8_t)(timestamp() >> (8U * (reg - LSM6DSOX_TIMESTAMP0)));
+
+    default:
+      break;
+  }
+
+  if (reg >= LSM6DSOX_OUT_TEMP_L && reg <= LSM6DSOX_OUTZ_H_A) {
+    uint8_t out[14];
+    putLE16(&out[0], out_temp);
+    for (int i = 0; i < 3; i++) {
+      putLE16(&out[2 + 2 * i], out_gy[i]);
+      putLE16(&out[8 + 2 * i], out_xl[i]);
+    }
+    if (reg >= LSM6DSOX_OUTX_L_A) {
+      user[LSM6DSOX_STATUS_REG] &= (uint8_t)~STATUS_XLDA;
+    } else if (reg >= LSM6DSOX_OUTX_L_G) {
+      user[LSM6DSOX_STATUS_REG] &= (uint8_t)~STATUS_GDA;
+    } else {
+      user[LSM6DSOX_STATUS_REG] &= (uint8_t)~STATUS_TDA;
+    }
+    return out[reg - LSM6DSOX_OUT_TEMP_L];
+  }
+
+  if (reg >= LSM6DSOX_FIFO_DATA_OUT_TAG && reg <= 0x7EU) {
+    uint8_t value = 0;
+    if (fifo_count > 0U) {
+      value = fifo[fifo_head][reg - LSM6DSOX_FIFO_DATA_OUT_TAG];
+    }
+    if (reg == 0x7EU) {
+      fifoPop();
+    }
+    return value;
+  }
+
+  return user[reg];
+}
+
+void LSM6DSOXSim::writeByte(uint8_t reg, uint8_t value)
+{
+  uint8_t bank = user[LSM6DSOX_FUNC_CFG_ACCESS] >> 6;
+
+  if (reg == LSM6DSOX_FUNC_CFG_ACCESS) {
+    user[reg] = value;
+    return;
+  }
+
+  if (bank == BANK_EMBEDDED) {
+    switch (reg) {
+      case LSM6DSOX_PAGE_VALUE:
+        if (emb[LSM6DSOX_PAGE_RW] & PAGE_WRITE) {
+          uint8_t page = (emb[LSM6DSOX_PAGE_SEL] >> 4) & 0x03U;
+          page_mem[page][emb[LSM6DSOX_PAGE_ADDRESS]++] = value;
+        }
+        return;
+
+      case LSM6DSOX_EMB_FUNC_INIT_B:
+        if (value & EMB_MLC) {
+          memset(mlc_out, 0, sizeof(mlc_out));
+          mlc_status = 0;
+        }
+        return;
+
+      case LSM6DSOX_EMB_FUNC_INIT_A:
+      case LSM6DSOX_EMB_FUNC_STATUS:
+      case LSM6DSOX_FSM_STATUS_A:
+      case LSM6DSOX_FSM_STATUS_B:
+      case LSM6DSOX_MLC_STATUS:
+        return;
+
+      default:
+        if (reg >= LSM6DSOX_MLC0_SRC && reg <= LSM6DSOX_MLC7_SRC) {
+          return;
+        }
+        emb[reg] = value;
+        if (reg == LSM6DSOX_EMB_FUNC_EN_B || reg == LSM6DSOX_EMB_FUNC_ODR_CFG_C) {
+          updateTimers();
+        }
+        return;
+    }
+  }
+
+  if (bank == BANK_SHUB) {
+    shub[reg] = value;
+    return;
+  }
+
+  switch (reg) {
+    case LSM6DSOX_WHO_AM_I:
+    case LSM6DSOX_STATUS_REG:
+    case LSM6DSOX_MLC_STATUS_MAINPAGE:
+    case LSM6DSOX_FIFO_STATUS1:
+    case LSM6DSOX_FIFO_STATUS2:
+      return;
+
+    case LSM6DSOX_TIMESTAMP2:
+      if (value == TIMESTAMP_RESET_CMD) {
+        ts_origin_ns = now_ns;
+      }
+      return;
+
+    case LSM6DSOX_CTRL3_C:
+      if (value & CTRL3_SW_RESET) {
+        reset();
+        return;
+      }
+      user[reg] = value;
+      return;
+
+    case LSM6DSOX_CTRL1_XL:
+    case LSM6DSOX_CTRL2_G:
+      user[reg] = value;
+      updateTimers();
+      return;
+
+    case LSM6DSOX_CTRL10_C:
+      if ((value & 0x20U) && !(user[reg] & 0x20U)) {
+        ts_origin_ns = now_ns;
+      }
+      user[reg] = value;
+      return;
+
+    case LSM6DSOX_FIFO_CTRL4:
+      if ((value & 0x07U) != (user[reg] & 0x07U)) {
+        fifo_triggered = 0;
+      }
+      if ((value & 0x07U) == LSM6DSOX_BYPASS_MODE) {
+        fifo_head = 0;
+        fifo_count = 0;
+        fifo_ovr = 0;
+        fifo_ovr_latched = 0;
+        memset(&xl_compr, 0, sizeof(xl_compr));
+        memset(&gy_compr, 0, sizeof(gy_compr));
+      }
+      user[reg] = value;
+      return;
+
+    case LSM6DSOX_COUNTER_BDR_REG1:
+      if (value & CNT_RST) {
+        bdr_counter = 0;
+        counter_bdr_ia = 0;
+      }
+      user[reg] = (uint8_t)(value & ~CNT_RST);
+      return;
+
+    default:
+      break;
+  }
+
+  if (reg >= LSM6DSOX_OUT_TEMP_L && reg <= LSM6DSOX_OUTZ_H_A) {
+    return;
+  }
+  if (reg >= LSM6DSOX_TIMESTAMP0 && reg <= LSM6DSOX_TIMESTAMP3) {
+    return;
+  }
+  if (reg >= LSM6DSOX_FIFO_DATA_OUT_TAG) {
+    return;
+  }
+
+  user[reg] = value;
+}
+
+void LSM6DSOXSim::select(uint8_t reg)
+{
+  pointer = reg & 0x7FU;
+}
+
+uint8_t LSM6DSOXSim::readNext()
+{
+  uint8_t value = readByte(pointer);
+  pointer = nextPointer(pointer);
+  updatePins();
+  return value;
+}
+
+void LSM6DSOXSim::writeNext(uint8_t value)
+{
+  writeByte(pointer, value);
+  pointer = nextPointer(pointer);
+  updatePins();
+}
+
+int32_t LSM6DSOXSim::readRegs(uint8_t reg, uint8_t *data, uint16_t len)
+{
+  select(reg);
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = readNext();
+  }
+  return 0;
+}
+
+int32_t LSM6DSOXSim::writeRegs(uint8_t reg, const uint8_t *data, uint16_t len)
+{
+  select(reg);
+  for (uint16_t i = 0; i < len; i++) {
+    writeNext(data[i]);
+  }
+  return 0;
+}
+
+/* lsm6dsox_ctx_t bindings --------------------------------------------------*/
+
+int32_t LSM6DSOXSim_io_write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite)
+{
+  return ((LSM6DSOXSim *)handle)->writeRegs(WriteAddr, pBuffer, nBytesToWrite);
+}
+
+int32_t LSM6DSOXSim_io_read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead)
+{
+  return ((LSM6DSOXSim *)handle)->readRegs(ReadAddr, pBuffer, nBytesToRead);
+}
+
+void LSM6DSOXSim_ctx_init(lsm6dsox_ctx_t *ctx, LSM6DSOXSim *sim)
+{
+  ctx->write_reg = LSM6DSOXSim_io_write;
+  ctx->read_reg = LSM6DSOXSim_io_read;
+  ctx->handle = (void *)sim;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file    LSM6DSOXSim.h
+ * @brief   Register-level model of the LSM6DSOX for the native environment.
+ *
+ * The model keeps the user, embedded-function and sensor-hub register
+ * banks, the embedded advanced pages written through PAGE_SEL/PAGE_ADDRESS/
+ * PAGE_VALUE, the MLC output registers and a 512-word tagged FIFO, with
+ * the accelerometer and gyroscope words compressed (NC_T_x/2xC/3xC tags)
+ * when FIFO_COMPR_EN and FIFO_COMPR_RT_EN are both set. Output
+ * data is produced at the programmed ODRs from a motion source, with
+ * STATUS_REG data-ready flags, the 25 us timestamp counter and the INT1/INT2
+ * lines driven from the interrupt routing registers.
+ *
+ * The sensor is reached either through a register pointer (select, then
+ * readNext/writeNext, as a bus master sees it) or directly through an
+ * lsm6dsox_ctx_t bound with LSM6DSOXSim_ctx_init().
+ */
+
+#ifndef __LSM6DSOXSim_H__
+#define __LSM6DSOXSim_H__
+
+#include <stdint.h>
+#include "lsm6dsox_reg.h"
+
+#define LSM6DSOX_SIM_FIFO_DEPTH  512
+#define LSM6DSOX_SIM_WORD_SIZE   7
+
+/** One instant of motion as seen by the sensor. */
+typedef struct
+{
+  float accel_mg[3];
+  float gyro_mdps[3];
+  float temp_c;
+  int16_t mlc_class;   /* MLC0 output to report, -1 to leave it unchanged */
+} LSM6DSOXSimFrame;
+
+/** Source of physical motion; called at every sensor ODR tick. */
+class LSM6DSOXSimMotion
+{
+  public:
+    virtual ~LSM6DSOXSimMotion() {}
+    virtual void sample(uint64_t t_ns, LSM6DSOXSimFrame *frame) = 0;
+};
+
+typedef enum
+{
+  LSM6DSOX_SIM_INT1 = 0,
+  LSM6DSOX_SIM_INT2 = 1
+} LSM6DSOXSimPin_t;
+
+typedef void (*LSM6DSOXSimPinListener)(void *arg, LSM6DSOXSimPin_t pin, int level);
+
+class LSM6DSOXSim
+{
+  public:
+    LSM6DSOXSim();
+
+    void reset();
+    void setMotion(LSM6DSOXSimMotion *motion);
+    void setPinListener(LSM6DSOXSimPinListener listener, void *arg);
+    void setClockErrorPpm(int32_t ppm);
+    void setThermalDrift(float offset_mg_per_c);
+
+    /* Run the sensor up to absolute time t_ns. */
+    void advanceTo(uint64_t t_ns);
+    uint64_t now() const { return now_ns; }
+
+    /* Bus view: a register pointer that moves like the real device's. */
+    void select(uint8_t reg);
+    uint8_t readNext();
+    void writeNext(uint8_t value);
+
+    int32_t readRegs(uint8_t reg, uint8_t *data, uint16_t len);
+    int32_t writeRegs(uint8_t reg, const uint8_t *data, uint16_t len);
+
+    /* Test hooks. */
+    void setMLCOutput(uint8_t index, uint8_t value);
+    uint8_t peekUser(uint8_t reg) const { return user[reg & 0x7FU]; }
+    uint8_t peekEmbedded(uint8_t reg) const { return emb[reg & 0x7FU]; }
+    uint8_t peekPage(uint16_t address) const { return page_mem[(address >> 8) & 0x03U][address & 0xFFU]; }
+    uint16_t fifoLevel() const { return fifo_count; }
+    uint32_t fifoWordsLost() const { return fifo_lost; }
+    uint32_t samplesGenerated() const { return xl_samples; }
+
+  private:
+    typedef struct
+    {
+      uint64_t period_ns;
+      uint64_t next_ns;
+      uint8_t odr;
+      uint32_t batch_phase;
+    } Channel;
+
+    /* Batched samples of one sensor awaiting a compressed word. */
+    typedef struct
+    {
+      int16_t ref[3];          /* last sample the host can reconstruct */
+      int16_t pending[3][3];
+      uint8_t pending_count;
+      uint8_t has_ref;
+      uint16_t since_nc;       /* samples since the last uncompressed word */
+    } Compressor;
+
+    uint8_t readByte(uint8_t reg);
+    void writeByte(uint8_t reg, uint8_t value);
+    uint8_t nextPointer(uint8_t reg) const;
+
+    void updateChannel(Channel *ch, uint8_t odr);
+    void updateTimers();
+    void tick(uint64_t t_ns);
+    void sampleMotion(uint64_t t_ns);
+    void runMLC(uint64_t t_ns);
+
+    bool compressionEnabled() const;
+    int batchSample(Compressor *c, bool gyro, const int16_t *sample,
+                    uint8_t (*words)[LSM6DSOX_SIM_WORD_SIZE]);
+
+    bool fifoStoring() const;
+    void fifoPush(uint8_t tag, const uint8_t *data);
+    void fifoPop();
+    void fifoTrigger();
+    uint16_t fifoDepth() const;
+    uint8_t fifoStatus1() const;
+    uint8_t fifoStatus2() const;
+    uint32_t timestamp() const;
+
+    void raiseEmbeddedEvent(uint8_t mlc_mask);
+    void updatePins();
+    int pinLevel(LSM6DSOXSimPin_t pin) const;
+
+    uint8_t user[128];
+    uint8_t emb[128];
+    uint8_t shub[128];
+    uint8_t page_mem[4][256];
+    uint8_t pointer;
+
+    LSM6DSOXSimMotion *motion;
+    LSM6DSOXSimFrame frame;
+    LSM6DSOXSimPinListener listener;
+    void *listener_arg;
+    int pin_state[2];
+
+    uint64_t now_ns;
+    uint64_t ts_origin_ns;
+    int32_t clock_ppm;
+    float drift_mg_c;        /* accelerometer offset change per degC from 25 degC */
+
+    Channel xl;
+    Channel gy;
+    Channel temp;
+    Channel mlc;
+
+    int16_t out_xl[3];
+    int16_t out_gy[3];
+    int16_t out_temp;
+    uint32_t xl_samples;
+
+    uint8_t fifo[LSM6DSOX_SIM_FIFO_DEPTH][LSM6DSOX_SIM_WORD_SIZE];
+    uint16_t fifo_head;
+    uint16_t fifo_count;
+    uint32_t fifo_lost;
+    uint8_t fifo_ovr;
+    uint8_t fifo_ovr_latched;
+    uint8_t fifo_triggered;
+    uint8_t tag_cnt;
+    uint32_t ts_phase;
+    uint16_t bdr_counter;
+    uint8_t counter_bdr_ia;
+    Compressor xl_compr;
+    Compressor gy_compr;
+
+    uint8_t mlc_out[8];
+    uint8_t mlc_status;
+};
+
+/* lsm6dsox_ctx_t bindings: handle is the LSM6DSOXSim instance. */
+int32_t LSM6DSOXSim_io_write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite);
+int32_t LSM6DSOXSim_io_read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead);
+void LSM6DSOXSim_ctx_init(lsm6dsox_ctx_t *ctx, LSM6DSOXSim *sim);
+
+#endif /* __LSM6DSOXSim_H__ */
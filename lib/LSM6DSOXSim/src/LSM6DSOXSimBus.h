@@ -0,0 +1,28 @@
+/**
+ * @file    LSM6DSOXSimBus.h
+ * @brief   The simulated LSM6DSOX as a device on the host Wire or SPI bus.
+ *
+ * Attach with Wire.attachDevice(address, &bus) or SPI.attachDevice(cs, &bus);
+ * the sensor still needs advancing from a host tick hook.
+ */
+
+#ifndef __LSM6DSOXSimBus_H__
+#define __LSM6DSOXSimBus_H__
+
+#include <HostBus.h>
+
+#include "LSM6DSOXSim.h"
+
+class LSM6DSOXSimBus : public HostBusDevice
+{
+  public:
+    explicit LSM6DSOXSimBus(LSM6DSOXSim *sim) : sim(sim) {}
+    void busSelect(uint8_t reg) override { sim->select(reg); }
+    uint8_t busRead() override { return sim->readNext(); }
+    void busWrite(uint8_t data) override { sim->writeNext(data); }
+
+  private:
+    LSM6DSOXSim *sim;
+};
+
+#endif /* __LSM6DSOXSimBus_H__ */
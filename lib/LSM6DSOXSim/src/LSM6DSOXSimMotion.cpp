@@ -0,0 +1,130 @@
+/**
+ * @file    LSM6DSOXSimMotion.cpp
+ * @brief   Motion sources for the LSM6DSOX simulator.
+ */
+
+#include "LSM6DSOXSimMotion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SIM_PI 3.14159265358979f
+
+/* Scenario -----------------------------------------------------------------*/
+
+LSM6DSOXSimScenario::LSM6DSOXSimScenario(uint32_t still_ms, uint32_t moving_ms, float freq_hz, float amp_mg)
+  : still_ms(still_ms), moving_ms(moving_ms), freq_hz(freq_hz), amp_mg(amp_mg)
+{
+}
+
+void LSM6DSOXSimScenario::sample(uint64_t t_ns, LSM6DSOXSimFrame *frame)
+{
+  uint64_t period_ns = (uint64_t)(still_ms + moving_ms) * 1000000ULL;
+  uint64_t phase_ns = period_ns ? t_ns % period_ns : 0;
+  bool moving = phase_ns >= (uint64_t)still_ms * 1000000ULL;
+  float t = (float)((double)t_ns * 1e-9);
+
+  /* Small deterministic noise so still data is not perfectly flat. */
+  uint32_t seed = (uint32_t)(t_ns / 1000ULL) * 2654435761U;
+  float noise = (float)((seed >> 16) & 0xFFU) / 255.0f - 0.5f;
+
+  frame->accel_mg[0] = 2.0f * noise;
+  frame->accel_mg[1] = -1.5f * noise;
+  frame->accel_mg[2] = 1000.0f + noise;
+  frame->gyro_mdps[0] = 50.0f * noise;
+  frame->gyro_mdps[1] = 0.0f;
+  frame->gyro_mdps[2] = -30.0f * noise;
+  frame->temp_c = 25.0f + 2.0f * sinf(2.0f * SIM_PI * t / 600.0f);
+
+  if (moving) {
+    float w = 2.0f * SIM_PI * freq_hz * t;
+    frame->accel_mg[0] += amp_mg * sinf(w);
+    frame->accel_mg[1] += 0.5f * amp_mg * sinf(w + 1.0f);
+    frame->accel_mg[2] += 0.3f * amp_mg * cosf(w);
+    frame->gyro_mdps[0] += 20000.0f * cosf(w);
+    frame->gyro_mdps[1] += 15000.0f * sinf(w);
+  }
+
+  frame->mlc_class = moving ? 1 : 0;
+}
+
+/* Trace --------------------------------------------------------------------*/
+
+bool LSM6DSOXSimTrace::load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    double v[8];
+    int n = 0;
+    char *p = line;
+
+    while (n < 8) {
+      char *end;
+      v[n] = strtod(p, &end);
+      if (end == p) {
+        break;
+      }
+      n++;
+      p = end;
+      while (*p == ',' || *p == ' ' || *p == '\t') {
+        p++;
+      }
+    }
+
+    if (n < 4) {
+      continue;  /* header or malformed row */
+    }
+
+    LSM6DSOXSimFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.accel_mg[0] = (float)v[1];
+    frame.accel_mg[1] = (float)v[2];
+    frame.accel_mg[2] = (float)v[3];
+    frame.temp_c = 25.0f;
+    frame.mlc_class = -1;
+
+    if (n >= 7) {
+      frame.gyro_mdps[0] = (float)v[4];
+      frame.gyro_mdps[1] = (float)v[5];
+      frame.gyro_mdps[2] = (float)v[6];
+    }
+    if (n == 5) {
+      frame.mlc_class = (int16_t)v[4];
+    } else if (n == 8) {
+      frame.mlc_class = (int16_t)v[7];
+    }
+
+    times_ns.push_back((uint64_t)(v[0] * 1e6));
+    frames.push_back(frame);
+  }
+
+  fclose(f);
+  cursor = 0;
+  return !frames.empty();
+}
+
+void LSM6DSOXSimTrace::sample(uint64_t t_ns, LSM6DSOXSimFrame *frame)
+{
+  if (frames.empty()) {
+    return;
+  }
+
+  uint64_t span = times_ns.back() + 1;
+  uint64_t t = t_ns % span;
+
+  if (cursor >= frames.size() || times_ns[cursor] > t) {
+    cursor = 0;  /* looped */
+  }
+  while (cursor + 1 < frames.size() && times_ns[cursor + 1] <= t) {
+    cursor++;
+  }
+
+  *frame = frames[cursor];
+}
@@ -0,0 +1,48 @@
+/**
+ * @file    LSM6DSOXSimMotion.h
+ * @brief   Motion sources for the LSM6DSOX simulator.
+ *
+ * LSM6DSOXSimScenario produces a repeating still/vibrating pattern with the
+ * MLC class following it; LSM6DSOXSimTrace replays a recorded CSV trace with
+ * lines "t_ms,ax,ay,az[,gx,gy,gz][,mlc]" (mg, mdps), holding each row until
+ * the next one and looping at the end.
+ */
+
+#ifndef __LSM6DSOXSimMotion_H__
+#define __LSM6DSOXSimMotion_H__
+
+#include "LSM6DSOXSim.h"
+
+#include <vector>
+
+class LSM6DSOXSimScenario : public LSM6DSOXSimMotion
+{
+  public:
+    /* Alternate still_ms at rest with moving_ms of vibration at freq_hz/amp_mg. */
+    LSM6DSOXSimScenario(uint32_t still_ms = 20000, uint32_t moving_ms = 15000,
+                        float freq_hz = 50.0f, float amp_mg = 300.0f);
+
+    void sample(uint64_t t_ns, LSM6DSOXSimFrame *frame) override;
+
+  private:
+    uint32_t still_ms;
+    uint32_t moving_ms;
+    float freq_hz;
+    float amp_mg;
+};
+
+class LSM6DSOXSimTrace : public LSM6DSOXSimMotion
+{
+  public:
+    bool load(const char *path);
+    size_t rows() const { return frames.size(); }
+
+    void sample(uint64_t t_ns, LSM6DSOXSimFrame *frame) override;
+
+  private:
+    std::vector<uint64_t> times_ns;
+    std::vector<LSM6DSOXSimFrame> frames;
+    size_t cursor = 0;
+};
+
+#endif /* __LSM6DSOXSimMotion_H__ */
@@ -0,0 +1,90 @@
+/**
+ * @file    TalonHostBoard.cpp
+ * @brief   Host board: wires the simulated LSM6DSOX to Wire, SPI and INT1/INT2.
+ *
+ * The sensor answers on I2C at 0x6A and on SPI with chip select on D10.
+ * INT1 drives D5 and INT2 drives D6. Environment:
+ *   TALON_SIM_TRACE   CSV motion trace to replay (default: built-in scenario)
+ *   TALON_SIM_RUN_MS  simulated run length in ms (default 360000, long
+ *                     enough for the five-minute state upload)
+ *   TALON_SIM_PPM     sensor clock error in ppm (default 0)
+ *   TALON_SIM_DRIFT   accelerometer offset drift in mg/degC, all axes
+ *                     (default 0)
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <stdio.h>
+
+#include "LSM6DSOXSim.h"
+#include "LSM6DSOXSimBus.h"
+#include "LSM6DSOXSimMotion.h"
+
+#define TALON_SIM_I2C_ADDRESS 0x6A
+#define TALON_SIM_SPI_CS      D10
+#define TALON_SIM_INT1_PIN    D5
+#define TALON_SIM_INT2_PIN    D6
+
+static LSM6DSOXSim sim;
+static LSM6DSOXSimBus simBus(&sim);
+static LSM6DSOXSimScenario scenario;
+static LSM6DSOXSimTrace trace;
+static uint64_t runLimitUs = 360000ULL * 1000ULL;
+
+static void simTick(void *arg, uint64_t now_us)
+{
+  (void)arg;
+  sim.advanceTo(now_us * 1000ULL);
+}
+
+static void simPin(void *arg, LSM6DSOXSimPin_t pin, int level)
+{
+  (void)arg;
+  hostSetPin((pin == LSM6DSOX_SIM_INT1) ? TALON_SIM_INT1_PIN : TALON_SIM_INT2_PIN, level);
+}
+
+void hostBoardInit(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  const char *tracePath = getenv("TALON_SIM_TRACE");
+  if (tracePath && *tracePath && trace.load(tracePath)) {
+    printf("host> replaying %s (%u rows)\n", tracePath, (unsigned)trace.rows());
+    sim.setMotion(&trace);
+  } else {
+    sim.setMotion(&scenario);
+  }
+
+  const char *runMs = getenv("TALON_SIM_RUN_MS");
+  if (runMs && *runMs) {
+    runLimitUs = strtoull(runMs, NULL, 10) * 1000ULL;
+  }
+
+  const char *ppm = getenv("TALON_SIM_PPM");
+  if (ppm && *ppm) {
+    sim.setClockErrorPpm((int32_t)strtol(ppm, NULL, 10));
+  }
+
+  const char *drift = getenv("TALON_SIM_DRIFT");
+  if (drift && *drift) {
+    sim.setThermalDrift(strtof(drift, NULL));
+  }
+
+  sim.setPinListener(simPin, NULL);
+  hostAddTickHook(simTick, NULL);
+  Wire.attachDevice(TALON_SIM_I2C_ADDRESS, &simBus);
+  SPI.attachDevice(TALON_SIM_SPI_CS, &simBus);
+}
+
+bool hostBoardDone()
+{
+  return hostMicros64() >= runLimitUs;
+}
+
+void hostBoardEnd()
+{
+  printf("host> simulated %.3f s, %u accelerometer samples, %u FIFO words lost\n",
+         (double)hostMicros64() * 1e-6, (unsigned)sim.samplesGenerated(), (unsigned)sim.fifoWordsLost());
+}
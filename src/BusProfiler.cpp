@@ -0,0 +1,169 @@
+#include "BusProfiler.h"
+
+#ifdef LSM6DSOX_BUS_PROFILE
+
+#define BUS_PROFILE_BANKS   3    // user, sensor hub, embedded functions
+#define BUS_PROFILE_REGS    128
+#define BUS_PROFILE_CALLERS 24
+
+#define FUNC_CFG_ACCESS_REG 0x01
+
+struct RegisterStats {
+  uint32_t reads;
+  uint32_t writes;
+  uint32_t bytes;
+  uint32_t us;
+};
+
+struct CallerStats {
+  const char *name;
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t us;
+  uint32_t bankTransactions;  // FUNC_CFG_ACCESS reads/writes
+  uint32_t bankUs;
+  uint32_t rmwWrites;         // writes straight after a read of the same register
+};
+
+static RegisterStats registerStats[BUS_PROFILE_BANKS][BUS_PROFILE_REGS];
+static CallerStats callerStats[BUS_PROFILE_CALLERS];
+static int callerCount = 0;
+
+static const char *currentCaller = NULL;
+static uint8_t currentBank = 0;
+
+// Last transaction, for read-modify-write detection
+static int lastReg = -1;
+static uint8_t lastBank = 0;
+static bool lastWasRead = false;
+
+static uint32_t profileStart = 0;
+
+static CallerStats *findCaller(const char *name) {
+  if (name == NULL) name = "(other)";
+
+  for (int i = 0; i < callerCount; i++) {
+    if (callerStats[i].name == name || strcmp(callerStats[i].name, name) == 0) {
+      return &callerStats[i];
+    }
+  }
+  if (callerCount < BUS_PROFILE_CALLERS) {
+    CallerStats *c = &callerStats[callerCount++];
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    return c;
+  }
+  return &callerStats[BUS_PROFILE_CALLERS - 1];
+}
+
+BusProfileScope::BusProfileScope(const char *name) {
+  owner = (currentCaller == NULL);
+  if (owner) currentCaller = name;
+}
+
+BusProfileScope::~BusProfileScope() {
+  if (owner) currentCaller = NULL;
+}
+
+#ifdef TALON_NATIVE
+static void dumpAtExit(void *arg) {
+  (void)arg;
+  busProfileDump(Serial);
+}
+#endif
+
+void busProfileBegin() {
+  busProfileReset();
+#ifdef TALON_NATIVE
+  hostAddExitHook(dumpAtExit, NULL);
+#endif
+}
+
+void busProfileReset() {
+  memset(registerStats, 0, sizeof(registerStats));
+  callerCount = 0;
+  lastReg = -1;
+  profileStart = millis();
+}
+
+void busProfileRecord(uint8_t reg, const uint8_t *data, uint16_t len, bool write, uint32_t us) {
+  uint8_t bank = (reg == FUNC_CFG_ACCESS_REG) ? 0 : currentBank;
+  RegisterStats *r = &registerStats[bank][reg & 0x7F];
+  CallerStats *c = findCaller(currentCaller);
+
+  if (write) r->writes++; else r->reads++;
+  r->bytes += len;
+  r->us += us;
+
+  c->transactions++;
+  c->bytes += len;
+  c->us += us;
+
+  if (reg == FUNC_CFG_ACCESS_REG) {
+    c->bankTransactions++;
+    c->bankUs += us;
+  }
+  if (write && lastWasRead && lastReg == (int)reg && lastBank == bank) {
+    c->rmwWrites++;
+  }
+
+  // Follow bank switches so later registers are filed under the right bank
+  if (write && reg == FUNC_CFG_ACCESS_REG && len > 0 && data != NULL) {
+    switch (data[0] >> 6) {
+      case 1:  currentBank = 1; break;
+      case 2:  currentBank = 2; break;
+      default: currentBank = 0; break;
+    }
+  }
+
+  lastReg = reg;
+  lastBank = bank;
+  lastWasRead = !write;
+}
+
+void busProfileDump(Print &out) {
+  static const char *bankNames[BUS_PROFILE_BANKS] = {"user", "shub", "emb"};
+  uint32_t totalTx = 0, totalBytes = 0, totalUs = 0, bankTx = 0, bankUs = 0, rmw = 0;
+
+  out.println("=== LSM6DSOX bus profile ===");
+  out.print("Window: ");
+  out.print((millis() - profileStart) / 1000.0, 1);
+  out.println(" s");
+
+  out.println("caller\ttx\tbytes\tus\tbank_tx\tbank_us\trmw");
+  for (int i = 0; i < callerCount; i++) {
+    CallerStats *c = &callerStats[i];
+    out.printf("%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n", c->name,
+               (unsigned long)c->transactions, (unsigned long)c->bytes, (unsigned long)c->us,
+               (unsigned long)c->bankTransactions, (unsigned long)c->bankUs,
+               (unsigned long)c->rmwWrites);
+    totalTx += c->transactions;
+    totalBytes += c->bytes;
+    totalUs += c->us;
+    bankTx += c->bankTransactions;
+    bankUs += c->bankUs;
+    rmw += c->rmwWrites;
+  }
+  out.printf("TOTAL\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n", (unsigned long)totalTx,
+             (unsigned long)totalBytes, (unsigned long)totalUs, (unsigned long)bankTx,
+             (unsigned long)bankUs, (unsigned long)rmw);
+
+  out.println("bank\treg\treads\twrites\tbytes\tus");
+  for (int b = 0; b < BUS_PROFILE_BANKS; b++) {
+    for (int reg = 0; reg < BUS_PROFILE_REGS; reg++) {
+      RegisterStats *r = &registerStats[b][reg];
+      if (r->reads == 0 && r->writes == 0) continue;
+      out.printf("%s\t0x%02X\t%lu\t%lu\t%lu\t%lu\n", bankNames[b], reg,
+                 (unsigned long)r->reads, (unsigned long)r->writes,
+                 (unsigned long)r->bytes, (unsigned long)r->us);
+    }
+  }
+
+  if (totalUs > 0) {
+    out.print("Bank switching: ");
+    out.print(100.0 * bankUs / totalUs, 1);
+    out.println("% of bus time");
+  }
+}
+
+#endif // LSM6DSOX_BUS_PROFILE
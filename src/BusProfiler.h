@@ -0,0 +1,45 @@
+#ifndef BUS_PROFILER_H
+#define BUS_PROFILER_H
+
+// Optional LSM6DSOX bus transaction profiler.
+//
+// Build with -D LSM6DSOX_BUS_PROFILE to count transactions, bytes and bus
+// time per register (per bank, tracked from FUNC_CFG_ACCESS writes) and per
+// calling API. Every register access made by LSM6DSOX_io_read/io_write is
+// recorded; BUS_PROFILE_SCOPE("name") at the top of an API attributes the
+// transactions made inside it to that name (the outermost scope wins, so a
+// call from setupLSM6DSOX into begin() is charged to setupLSM6DSOX).
+//
+// Without the flag every hook compiles away.
+
+#include <Arduino.h>
+
+#ifdef LSM6DSOX_BUS_PROFILE
+
+void busProfileBegin();
+void busProfileReset();
+void busProfileRecord(uint8_t reg, const uint8_t *data, uint16_t len, bool write, uint32_t us);
+void busProfileDump(Print &out);
+
+class BusProfileScope {
+public:
+  explicit BusProfileScope(const char *name);
+  ~BusProfileScope();
+private:
+  bool owner;
+};
+
+#define BUS_PROFILE_SCOPE(name) BusProfileScope busProfileScope_(name)
+#define BUS_PROFILE_TIME(var) uint32_t var = micros()
+#define BUS_PROFILE_RECORD(reg, data, len, write, start) \
+  busProfileRecord((reg), (data), (len), (write), micros() - (start))
+
+#else
+
+#define BUS_PROFILE_SCOPE(name) do {} while (0)
+#define BUS_PROFILE_TIME(var) do {} while (0)
+#define BUS_PROFILE_RECORD(reg, data, len, write, start) do {} while (0)
+
+#endif // LSM6DSOX_BUS_PROFILE
+
+#endif // BUS_PROFILER_H
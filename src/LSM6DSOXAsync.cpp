@@ -0,0 +1,312 @@
+/**
+ ******************************************************************************
+ * @file    LSM6DSOXAsync.cpp
+ * @brief   Asynchronous register transfer queue for the LSM6DSOX.
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "LSM6DSOXAsync.h"
+
+
+/* Platform back ends --------------------------------------------------------*/
+
+#if defined(LSM6DSOX_ASYNC_STM32_DMA)
+
+/* STM32L4 I2C1: RX on DMA1 channel 7, TX on DMA1 channel 6, request 3. */
+static DMA_HandleTypeDef hdma_i2c_rx;
+static DMA_HandleTypeDef hdma_i2c_tx;
+static I2C_HandleTypeDef *dma_i2c = NULL;
+static LSM6DSOXAsyncQueue *dma_owner = NULL;
+
+/* Mem read or write completion on any HAL I2C handle */
+extern "C" void LSM6DSOX_Async_I2C_MemCplt(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c == dma_i2c && dma_owner) {
+    dma_owner->complete(0);
+  }
+}
+
+extern "C" void LSM6DSOX_Async_DMA_IRQ(bool rx)
+{
+  HAL_DMA_IRQHandler(rx ? &hdma_i2c_rx : &hdma_i2c_tx);
+}
+
+#if !defined(LSM6DSOX_ASYNC_USER_HANDLERS)
+extern "C" void DMA1_Channel6_IRQHandler(void)
+{
+  LSM6DSOX_Async_DMA_IRQ(false);
+}
+
+extern "C" void DMA1_Channel7_IRQHandler(void)
+{
+  LSM6DSOX_Async_DMA_IRQ(true);
+}
+
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  LSM6DSOX_Async_I2C_MemCplt(hi2c);
+}
+
+extern "C" void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  LSM6DSOX_Async_I2C_MemCplt(hi2c);
+}
+#endif
+
+static void dma_channel_init(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel, uint32_t direction)
+{
+  hdma->Instance = channel;
+  hdma->Init.Request = DMA_REQUEST_3;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode = DMA_NORMAL;
+  hdma->Init.Priority = DMA_PRIORITY_HIGH;
+  HAL_DMA_Init(hdma);
+}
+
+#elif defined(LSM6DSOX_ASYNC_HOST)
+
+static void host_transfer_done(void *arg, uint8_t status)
+{
+  ((LSM6DSOXAsyncQueue *)arg)->complete(status == 0 ? 0 : -1);
+}
+
+#endif
+
+
+/* Class Implementation ------------------------------------------------------*/
+
+/** Constructor
+ * @param i2c bus the sensor is on, NULL for SPI (synchronous fallback)
+ * @param address 7-bit I2C address
+ * @param ctx driver context used by the synchronous fallback
+ */
+LSM6DSOXAsyncQueue::LSM6DSOXAsyncQueue(TwoWire *i2c, uint8_t address, lsm6dsox_ctx_t *ctx)
+  : dev_i2c(i2c), address(address), ctx(ctx), dma(false),
+    head(0), active(0), tail(0), count(0), waiting(0), in_flight(false), started_ms(0)
+{
+}
+
+/**
+ * @brief  Set up the background transfer path, if the platform has one
+ * @retval 0 in case of success, an error code otherwise
+ */
+int32_t LSM6DSOXAsyncQueue::begin()
+{
+  dma = false;
+
+  if (dev_i2c == NULL) {
+    return 0;
+  }
+
+#if defined(LSM6DSOX_ASYNC_STM32_DMA)
+  /* The core's i2c_t wraps the HAL handle the Wire driver uses. */
+  i2c_t *obj = dev_i2c->getHandle();
+  I2C_HandleTypeDef *hi2c = (obj != NULL) ? &obj->handle : NULL;
+  if (hi2c == NULL || hi2c->Instance != I2C1 || (dma_owner != NULL && dma_owner != this)) {
+    /* Only I2C1 is wired to these channels, for one queue: run synchronously */
+    return 0;
+  }
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  dma_channel_init(&hdma_i2c_rx, DMA1_Channel7, DMA_PERIPH_TO_MEMORY);
+  dma_channel_init(&hdma_i2c_tx, DMA1_Channel6, DMA_MEMORY_TO_PERIPH);
+  __HAL_LINKDMA(hi2c, hdmarx, hdma_i2c_rx);
+  __HAL_LINKDMA(hi2c, hdmatx, hdma_i2c_tx);
+
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+  dma_i2c = hi2c;
+  dma_owner = this;
+  dma = true;
+#elif defined(LSM6DSOX_ASYNC_HOST)
+  dma = true;
+#endif
+
+  return 0;
+}
+
+/**
+ * @brief  Queue a register transfer
+ * @param  reg first register
+ * @param  data buffer, owned by the caller until the callback runs
+ * @param  len number of bytes
+ * @param  write true to write data to the sensor, false to read
+ * @param  callback called from service() once the transfer is done
+ * @param  arg passed to the callback
+ * @retval 0 in case of success, -1 if the queue is full
+ */
+int32_t LSM6DSOXAsyncQueue::submit(uint8_t reg, uint8_t *data, uint16_t len, bool write,
+                                   LSM6DSOX_AsyncCallback_t callback, void *arg)
+{
+  if (count >= LSM6DSOX_ASYNC_QUEUE_DEPTH) {
+    return -1;
+  }
+
+  Transfer *t = &queue[tail];
+  t->reg = reg;
+  t->data = data;
+  t->len = len;
+  t->write = write;
+  t->callback = callback;
+  t->arg = arg;
+  t->status = 0;
+
+  noInterrupts();
+  tail = (uint8_t)((tail + 1U) % LSM6DSOX_ASYNC_QUEUE_DEPTH);
+  count++;
+  waiting++;
+  if (!in_flight) {
+    start_next();
+  }
+  interrupts();
+
+  return 0;
+}
+
+/**
+ * @brief  Start queued transfers until one is running in the background
+ */
+void LSM6DSOXAsyncQueue::start_next()
+{
+  while (!in_flight && waiting > 0U) {
+    Transfer *t = &queue[active];
+
+    if (dma) {
+      in_flight = true;
+      started_ms = millis();
+      if (start(t) == 0) {
+        return;
+      }
+      in_flight = false;
+      t->status = -1;
+    } else {
+      int32_t ret = t->write ? ctx->write_reg(ctx->handle, t->reg, t->data, t->len)
+                             : ctx->read_reg(ctx->handle, t->reg, t->data, t->len);
+      t->status = (ret == 0) ? 0 : -1;
+    }
+
+    active = (uint8_t)((active + 1U) % LSM6DSOX_ASYNC_QUEUE_DEPTH);
+    waiting--;
+  }
+}
+
+/**
+ * @brief  Hand one transfer to the background engine
+ * @retval 0 if it was started, -1 otherwise
+ */
+int32_t LSM6DSOXAsyncQueue::start(Transfer *t)
+{
+#if defined(LSM6DSOX_ASYNC_STM32_DMA)
+  HAL_StatusTypeDef ret;
+  if (t->write) {
+    ret = HAL_I2C_Mem_Write_DMA(dma_i2c, (uint16_t)(address << 1), t->reg, I2C_MEMADD_SIZE_8BIT, t->data, t->len);
+  } else {
+    ret = HAL_I2C_Mem_Read_DMA(dma_i2c, (uint16_t)(address << 1), t->reg, I2C_MEMADD_SIZE_8BIT, t->data, t->len);
+  }
+  return (ret == HAL_OK) ? 0 : -1;
+#elif defined(LSM6DSOX_ASYNC_HOST)
+  return dev_i2c->hostMemTransfer(address, t->reg, t->data, t->len, t->write, host_transfer_done, this) ? 0 : -1;
+#else
+  (void)t;
+  return -1;
+#endif
+}
+
+/**
+ * @brief  Transfer-complete handler; runs in interrupt context
+ * @param  status 0 on success, -1 on error
+ */
+void LSM6DSOXAsyncQueue::complete(int32_t status)
+{
+  if (!in_flight) {
+    return;
+  }
+
+  queue[active].status = status;
+  active = (uint8_t)((active + 1U) % LSM6DSOX_ASYNC_QUEUE_DEPTH);
+  waiting--;
+  in_flight = false;
+
+  start_next();
+}
+
+/**
+ * @brief  Fail a running transfer that errored or timed out
+ */
+void LSM6DSOXAsyncQueue::check_running()
+{
+  if (!in_flight) {
+    return;
+  }
+
+  bool failed = (millis() - started_ms) > LSM6DSOX_ASYNC_TIMEOUT_MS;
+
+#if defined(LSM6DSOX_ASYNC_STM32_DMA)
+  /* The core's HAL_I2C_ErrorCallback belongs to Wire; detect errors here. */
+  if (HAL_I2C_GetState(dma_i2c) == HAL_I2C_STATE_READY && HAL_I2C_GetError(dma_i2c) != HAL_I2C_ERROR_NONE) {
+    failed = true;
+  }
+  if (failed) {
+    HAL_I2C_Master_Abort_IT(dma_i2c, (uint16_t)(address << 1));
+  }
+#endif
+
+  if (failed) {
+    noInterrupts();
+    complete(-1);
+    interrupts();
+  }
+}
+
+/**
+ * @brief  Deliver completed transfers to their callbacks, in order
+ */
+void LSM6DSOXAsyncQueue::service()
+{
+  check_running();
+
+  /* Indices alone cannot tell a full queue from an empty one */
+  while (count > waiting) {
+    Transfer *t = &queue[head];
+
+    if (t->callback) {
+      t->callback(t->arg, t->status, t->data, t->len);
+    }
+
+    noInterrupts();
+    head = (uint8_t)((head + 1U) % LSM6DSOX_ASYNC_QUEUE_DEPTH);
+    count--;
+    interrupts();
+  }
+}
+
+/**
+ * @brief  Number of transfers queued, running or awaiting delivery
+ */
+uint8_t LSM6DSOXAsyncQueue::pending()
+{
+  return count;
+}
+
+/**
+ * @brief  Wait until the bus is free of background transfers
+ *
+ * Callbacks are not delivered here; blocking register access calls this
+ * before using the bus.
+ */
+void LSM6DSOXAsyncQueue::wait_idle()
+{
+  while (in_flight) {
+    check_running();
+    delayMicroseconds(10);
+  }
+}
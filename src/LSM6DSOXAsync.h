@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file    LSM6DSOXAsync.h
+ * @brief   Asynchronous register transfer queue for the LSM6DSOX.
+ ******************************************************************************
+ *
+ * Transfers are queued with submit() and run back to back in the
+ * background: on the STM32L4 (Cygnet) through HAL I2C with DMA when built
+ * with -D LSM6DSOX_ASYNC_DMA, on the native build through the host Wire
+ * model, which takes the same wire time without blocking the caller. The completion interrupt only records the
+ * result and starts the next queued transfer; callbacks are delivered from
+ * service(), in thread context, in submission order.
+ *
+ * Elsewhere (SPI, other targets) transfers run synchronously inside
+ * submit() through the driver context, with the same callback semantics.
+ */
+
+#ifndef __LSM6DSOXAsync_H__
+#define __LSM6DSOXAsync_H__
+
+#include "Wire.h"
+#include "lsm6dsox_reg.h"
+
+/* Maximum number of transfers queued or awaiting delivery. */
+#ifndef LSM6DSOX_ASYNC_QUEUE_DEPTH
+#define LSM6DSOX_ASYNC_QUEUE_DEPTH 8
+#endif
+
+/* A transfer not completed within this time is failed by service(). */
+#define LSM6DSOX_ASYNC_TIMEOUT_MS 100
+
+/* The DMA back end is opt-in until it has been run on target. It drives
+   I2C1 through DMA1 channels 6 (TX) and 7 (RX), request 3, and defines the
+   HAL_I2C_Mem*CpltCallback and DMA1_Channel6/7_IRQHandler functions. If the
+   application defines those itself, build with -D LSM6DSOX_ASYNC_USER_HANDLERS
+   and call LSM6DSOX_Async_I2C_MemCplt() and LSM6DSOX_Async_DMA_IRQ() from
+   them. */
+#if defined(TALON_NATIVE)
+#define LSM6DSOX_ASYNC_HOST
+#elif defined(LSM6DSOX_ASYNC_DMA) && defined(ARDUINO_ARCH_STM32) && defined(STM32L4xx)
+#define LSM6DSOX_ASYNC_STM32_DMA
+#endif
+
+#if defined(LSM6DSOX_ASYNC_STM32_DMA)
+extern "C" void LSM6DSOX_Async_I2C_MemCplt(I2C_HandleTypeDef *hi2c);
+extern "C" void LSM6DSOX_Async_DMA_IRQ(bool rx);
+#endif
+
+/**
+ * Completion callback.
+ * @param arg user argument given to submit()
+ * @param status 0 on success, -1 on bus error or timeout
+ * @param data the buffer given to submit()
+ * @param len number of bytes transferred
+ */
+typedef void (*LSM6DSOX_AsyncCallback_t)(void *arg, int32_t status, uint8_t *data, uint16_t len);
+
+class LSM6DSOXAsyncQueue
+{
+  public:
+    LSM6DSOXAsyncQueue(TwoWire *i2c, uint8_t address, lsm6dsox_ctx_t *ctx);
+
+    int32_t begin();
+    int32_t submit(uint8_t reg, uint8_t *data, uint16_t len, bool write,
+                   LSM6DSOX_AsyncCallback_t callback, void *arg);
+    void service();
+    uint8_t pending();
+    bool transferring() const { return in_flight; }
+    void wait_idle();
+
+    /* Completion entry point, called from the transfer-complete interrupt. */
+    void complete(int32_t status);
+
+  private:
+    typedef struct
+    {
+      uint8_t reg;
+      uint8_t *data;
+      uint16_t len;
+      bool write;
+      LSM6DSOX_AsyncCallback_t callback;
+      void *arg;
+      int32_t status;
+    } Transfer;
+
+    void start_next();
+    int32_t start(Transfer *t);
+    void check_running();
+
+    TwoWire *dev_i2c;
+    uint8_t address;       /* 7-bit */
+    lsm6dsox_ctx_t *ctx;
+    bool dma;              /* background transfers available */
+
+    Transfer queue[LSM6DSOX_ASYNC_QUEUE_DEPTH];
+    volatile uint8_t head;    /* next completed transfer to deliver */
+    volatile uint8_t active;  /* next transfer to start (or running) */
+    volatile uint8_t tail;    /* next free slot */
+    volatile uint8_t count;   /* queued + running + awaiting delivery */
+    volatile uint8_t waiting; /* queued + running */
+    volatile bool in_flight;
+    uint32_t started_ms;
+};
+
+#endif /* __LSM6DSOXAsync_H__ */
@@ -0,0 +1,474 @@
+/**
+ ******************************************************************************
+ * @file    LSM6DSOXFifo.cpp
+ * @brief   Tag-demultiplexing decoder for the LSM6DSOX FIFO.
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "LSM6DSOXFifo.h"
+
+
+/* Helpers -------------------------------------------------------------------*/
+
+static inline int16_t get_le16(const uint8_t *p)
+{
+  return (int16_t)(((uint16_t)p[1] << 8) | p[0]);
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+/* Sign-extend the 5-bit field at bit 'shift' of a 3xC group. */
+static inline int16_t get_diff5(uint16_t group, uint8_t shift)
+{
+  int16_t v = (int16_t)((group >> shift) & 0x1FU);
+  return (v & 0x10) ? (int16_t)(v - 32) : v;
+}
+
+/* Kinds of accelerometer/gyroscope word, see expand(). */
+enum {
+  AXES_UNCOMPRESSED,
+  AXES_2XC,
+  AXES_3XC
+};
+
+/* The tag byte, parity bit included, has even parity. */
+static inline bool tag_parity_ok(uint8_t tag_byte)
+{
+  tag_byte ^= (uint8_t)(tag_byte >> 4);
+  tag_byte ^= (uint8_t)(tag_byte >> 2);
+  tag_byte ^= (uint8_t)(tag_byte >> 1);
+  return (tag_byte & 1U) == 0U;
+}
+
+
+/* Class Implementation ------------------------------------------------------*/
+
+/**
+ * @brief  Extend a counter reading to 64 bits
+ * @param  raw TIMESTAMP0..3 value, from the registers or a FIFO word
+ * @retval monotonic count of 25 us ticks
+ */
+uint64_t LSM6DSOXTimestamp::extend(uint32_t raw)
+{
+  if (!valid) {
+    newest = raw;
+    valid = true;
+    return newest;
+  }
+
+  /* Signed distance from the newest reading, so wraps and late words both work */
+  int32_t delta = (int32_t)(raw - (uint32_t)newest);
+  uint64_t ticks = newest + (int64_t)delta;
+
+  if (delta > 0) {
+    newest = ticks;
+  }
+  return ticks;
+}
+
+/**
+ * @brief  Read the counter from the sensor and extend it
+ * @param  sensor driver to read TIMESTAMP0..3 through
+ * @param  ticks monotonic count of 25 us ticks
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXTimestamp::read(LSM6DSOXSensor *sensor, uint64_t *ticks)
+{
+  uint32_t raw = 0;
+
+  if (sensor->Get_Timestamp_Raw(&raw) != LSM6DSOX_OK) {
+    return LSM6DSOX_ERROR;
+  }
+  *ticks = extend(raw);
+  return LSM6DSOX_OK;
+}
+
+/** Constructor
+ * @param sensor driver the FIFO is read through
+ * @param clock timestamp extender to share with other readers of the
+ *        counter, NULL for a private one
+ */
+LSM6DSOXFifoDecoder::LSM6DSOXFifoDecoder(LSM6DSOXSensor *sensor, LSM6DSOXTimestamp *clock)
+  : compressed(false), sensor(sensor), clock(clock ? clock : &own_clock), slot_period_us(0)
+{
+  reset();
+}
+
+/**
+ * @brief  Empty every ring and clear the statistics
+ */
+void LSM6DSOXFifoDecoder::reset()
+{
+  xl.clear();
+  gy.clear();
+  temperature.clear();
+  steps.clear();
+  for (uint8_t i = 0; i < LSM6DSOX_FIFO_SLAVES; i++) {
+    slave[i].clear();
+  }
+  words = 0;
+  parity_errors = 0;
+  unhandled = 0;
+  compressed_words = 0;
+  decompress_errors = 0;
+  gaps.clear();
+  overruns = 0;
+  lost_slots = 0;
+  memset(&xl_state, 0, sizeof(xl_state));
+  memset(&gy_state, 0, sizeof(gy_state));
+  memset(slot_us, 0, sizeof(slot_us));
+  last_stamp_us = 0;
+  slots_since_stamp = 0;
+  slot_cnt = 0;
+  slot_valid = false;
+  stamp_valid = false;
+  gap_open = false;
+  gap_slots_before = 0;
+  gap_xl_index = 0;
+  gap_gy_index = 0;
+  stamp_xl_index = 0;
+  stamp_gy_index = 0;
+}
+
+/**
+ * @brief  Seed the time-slot period used between TIMESTAMP words
+ * @param  hz rate of the fastest batched sensor; the period is measured
+ *         from the TIMESTAMP words once two have been decoded
+ */
+void LSM6DSOXFifoDecoder::set_slot_rate(float hz)
+{
+  slot_period_us = (hz > 0.0f) ? (uint32_t)(1000000.0f / hz + 0.5f) : 0U;
+}
+
+/**
+ * @brief  Report that words were lost before the ones about to be drained
+ *         (FIFO_OVR_IA or FIFO_OVR_LATCHED seen)
+ */
+void LSM6DSOXFifoDecoder::mark_gap()
+{
+  overruns++;
+
+  /* Compressed words after the gap cannot use the samples before it */
+  xl_state.valid = false;
+  gy_state.valid = false;
+
+  if (!stamp_valid) {
+    /* No TIMESTAMP words to size the gap with */
+    gap_xl_index = xl_state.samples;
+    gap_gy_index = gy_state.samples;
+    record_gap(0, 0);
+    return;
+  }
+
+  if (!gap_open) {
+    gap_open = true;
+    gap_slots_before = slots_since_stamp;
+    gap_xl_index = xl_state.samples;
+    gap_gy_index = gy_state.samples;
+  }
+
+  /* The next word starts a new slot whatever its tag counter */
+  slot_valid = false;
+}
+
+/**
+ * @brief  Read words from the sensor FIFO and decode them
+ * @param  max_words most words to read; 0 reads what the FIFO holds, up to
+ *         one burst (LSM6DSOX_FIFO_BURST_WORDS)
+ * @retval number of words read, -1 on a bus error
+ */
+int32_t LSM6DSOXFifoDecoder::drain(uint16_t max_words)
+{
+  uint16_t level = 0;
+
+  if (max_words == 0U) {
+    if (sensor->Get_FIFO_Num_Samples(&level) != LSM6DSOX_OK) {
+      return -1;
+    }
+    max_words = (level > LSM6DSOX_FIFO_BURST_WORDS) ? LSM6DSOX_FIFO_BURST_WORDS : level;
+  }
+
+  uint16_t done = 0;
+
+  while (done < max_words) {
+    uint16_t count = max_words - done;
+    uint16_t received = 0;
+
+    if (count > LSM6DSOX_FIFO_BURST_WORDS) {
+      count = LSM6DSOX_FIFO_BURST_WORDS;
+    }
+
+    if (compressed) {
+      /* A 3xC word expands to three samples */
+      uint16_t room = (xl.space() < gy.space()) ? xl.space() : gy.space();
+      if (count > room / 3U) {
+        count = room / 3U;
+      }
+      if (count == 0U) {
+        break;
+      }
+    }
+
+    sensor->Get_FIFO_Sample(burst, count, &received);
+    decode(burst, received);
+    done += received;
+
+    if (received < count) {
+      return (done > 0U) ? (int32_t)done : -1;
+    }
+  }
+
+  return done;
+}
+
+/**
+ * @brief  Route FIFO words to their channel rings
+ * @param  words_in words as read from FIFO_DATA_OUT_TAG [multiple of 7]
+ * @param  count number of words
+ */
+void LSM6DSOXFifoDecoder::decode(const uint8_t *words_in, uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++, words_in += 7) {
+    const uint8_t *data = &words_in[1];
+    uint8_t tag = words_in[0] >> 3;
+
+    words++;
+
+    if (!tag_parity_ok(words_in[0])) {
+      parity_errors++;
+      continue;
+    }
+
+    uint8_t cnt = (uint8_t)((words_in[0] >> 1) & 0x03U);
+    if (!slot_valid || cnt != slot_cnt) {
+      advance_slot(cnt);
+    }
+
+    switch (tag) {
+      case LSM6DSOX_XL_NC_TAG:
+        expand(&xl, &xl_state, AXES_UNCOMPRESSED, 0, data);
+        break;
+
+      case LSM6DSOX_XL_NC_T_1_TAG:
+      case LSM6DSOX_XL_NC_T_2_TAG:
+        expand(&xl, &xl_state, AXES_UNCOMPRESSED,
+               (tag == LSM6DSOX_XL_NC_T_1_TAG) ? 1U : 2U, data);
+        break;
+
+      case LSM6DSOX_XL_2XC_TAG:
+      case LSM6DSOX_XL_3XC_TAG:
+        compressed = true;
+        compressed_words++;
+        expand(&xl, &xl_state,
+               (tag == LSM6DSOX_XL_2XC_TAG) ? AXES_2XC : AXES_3XC, 2, data);
+        break;
+
+      case LSM6DSOX_GYRO_NC_TAG:
+        expand(&gy, &gy_state, AXES_UNCOMPRESSED, 0, data);
+        break;
+
+      case LSM6DSOX_GYRO_NC_T_1_TAG:
+      case LSM6DSOX_GYRO_NC_T_2_TAG:
+        expand(&gy, &gy_state, AXES_UNCOMPRESSED,
+               (tag == LSM6DSOX_GYRO_NC_T_1_TAG) ? 1U : 2U, data);
+        break;
+
+      case LSM6DSOX_GYRO_2XC_TAG:
+      case LSM6DSOX_GYRO_3XC_TAG:
+        compressed = true;
+        compressed_words++;
+        expand(&gy, &gy_state,
+               (tag == LSM6DSOX_GYRO_2XC_TAG) ? AXES_2XC : AXES_3XC, 2, data);
+        break;
+
+      case LSM6DSOX_TEMPERATURE_TAG:
+        temperature.push(get_le16(&data[0]));
+        break;
+
+      case LSM6DSOX_TIMESTAMP_TAG:
+        stamp_slot(get_le32(&data[0]));
+        break;
+
+      case LSM6DSOX_STEP_CPUNTER_TAG:
+      {
+        LSM6DSOX_FIFO_Steps_t record;
+        record.steps = (uint16_t)get_le16(&data[0]);
+        record.timestamp = get_le32(&data[2]);
+        steps.push(record);
+        break;
+      }
+
+      case LSM6DSOX_SENSORHUB_SLAVE0_TAG:
+      case LSM6DSOX_SENSORHUB_SLAVE1_TAG:
+      case LSM6DSOX_SENSORHUB_SLAVE2_TAG:
+      case LSM6DSOX_SENSORHUB_SLAVE3_TAG:
+      {
+        LSM6DSOX_FIFO_Slave_t record;
+        memcpy(record.data, data, sizeof(record.data));
+        slave[tag - LSM6DSOX_SENSORHUB_SLAVE0_TAG].push(record);
+        break;
+      }
+
+      default:
+        /* Configuration-change, rotation vector and NACK words */
+        unhandled++;
+        break;
+    }
+  }
+}
+
+/**
+ * @brief  Move to the time slot of a word's tag counter
+ * @param  cnt 2-bit tag counter of the word
+ */
+void LSM6DSOXFifoDecoder::advance_slot(uint8_t cnt)
+{
+  if (!slot_valid) {
+    slot_cnt = cnt;
+    slot_valid = true;
+    if (gap_open) {
+      slots_since_stamp++;
+    }
+    return;
+  }
+
+  uint8_t steps = (uint8_t)((cnt - slot_cnt) & 0x03U);
+
+  while (steps--) {
+    uint64_t previous = slot_us[slot_cnt];
+    slot_cnt = (uint8_t)((slot_cnt + 1U) & 0x03U);
+    slot_us[slot_cnt] = previous + slot_period_us;
+    slots_since_stamp++;
+  }
+}
+
+/**
+ * @brief  Fix the current slot's time from a TIMESTAMP word
+ * @param  raw 32-bit counter value of the word
+ */
+void LSM6DSOXFifoDecoder::stamp_slot(uint32_t raw)
+{
+  uint64_t now_us = clock->extend(raw) * LSM6DSOX_TIMESTAMP_TICK_US;
+
+  if (stamp_valid && now_us > last_stamp_us) {
+    /* Slots the counter says went by, against the slots decoded */
+    uint32_t lost = 0;
+    if (slot_period_us > 0U) {
+      uint32_t elapsed = (uint32_t)((now_us - last_stamp_us + slot_period_us / 2U) / slot_period_us);
+      lost = (elapsed > slots_since_stamp) ? elapsed - slots_since_stamp : 0U;
+    }
+
+    if (gap_open && lost == 0U && slot_period_us > 0U) {
+      /* Reported, but the counter shows every slot was decoded */
+      gap_open = false;
+    } else if (gap_open || lost > 0U) {
+      if (!gap_open) {
+        /* Somewhere since the last TIMESTAMP word; place it there */
+        gap_slots_before = 0;
+        gap_xl_index = stamp_xl_index;
+        gap_gy_index = stamp_gy_index;
+      }
+      record_gap(lost, last_stamp_us + (uint64_t)(gap_slots_before + 1U) * slot_period_us);
+      gap_open = false;
+    } else if (slots_since_stamp > 0U) {
+      slot_period_us = (uint32_t)((now_us - last_stamp_us) / slots_since_stamp);
+    }
+  }
+  stamp_xl_index = xl_state.samples;
+  stamp_gy_index = gy_state.samples;
+  last_stamp_us = now_us;
+  slots_since_stamp = 0;
+  stamp_valid = true;
+
+  /* Earlier slots still referenced by NC_T_x and compressed words */
+  for (uint8_t age = 0; age < 4U; age++) {
+    slot_us[(slot_cnt - age) & 0x03U] = now_us - (uint64_t)age * slot_period_us;
+  }
+}
+
+/**
+ * @brief  Time of a recent slot
+ * @param  age slots before the current one (0 to 2)
+ * @retval time in microseconds, 0 before the first TIMESTAMP word
+ */
+uint64_t LSM6DSOXFifoDecoder::slot_time(uint8_t age) const
+{
+  return (stamp_valid && !gap_open) ? slot_us[(slot_cnt - age) & 0x03U] : 0U;
+}
+
+/**
+ * @brief  Store a gap record at the saved position
+ * @param  lost time slots lost, 0 if unknown
+ * @param  start_us time of the first lost slot, 0 if unknown
+ */
+void LSM6DSOXFifoDecoder::record_gap(uint32_t lost, uint64_t start_us)
+{
+  LSM6DSOX_FIFO_Gap_t gap;
+
+  gap.xl_index = gap_xl_index;
+  gap.gy_index = gap_gy_index;
+  gap.lost = lost;
+  gap.start_us = start_us;
+  gaps.push(gap);
+  lost_slots += lost;
+}
+
+/**
+ * @brief  Rebuild the samples of one accelerometer or gyroscope word
+ * @param  ring channel ring the samples go to
+ * @param  state reference sample and count of the channel, updated
+ * @param  kind AXES_UNCOMPRESSED (NC, NC_T_1, NC_T_2), AXES_2XC or AXES_3XC
+ * @param  age slots between the word and its (first) sample
+ * @param  data the 6 data bytes of the word
+ */
+void LSM6DSOXFifoDecoder::expand(AxesRing *ring, AxesState *state, uint8_t kind, uint8_t age,
+                                 const uint8_t *data)
+{
+  LSM6DSOX_FIFO_Axes_t *last = &state->last;
+
+  if (kind == AXES_UNCOMPRESSED) {
+    last->axis[0] = get_le16(&data[0]);
+    last->axis[1] = get_le16(&data[2]);
+    last->axis[2] = get_le16(&data[4]);
+    last->timestamp_us = slot_time(age);
+    state->valid = true;
+    state->samples++;
+    ring->push(*last);
+    return;
+  }
+
+  if (!state->valid) {
+    decompress_errors++;
+    return;
+  }
+
+  /* 2xC: two samples of 8-bit differences; 3xC: three of 5-bit ones */
+  uint8_t samples = (kind == AXES_2XC) ? 2U : 3U;
+
+  for (uint8_t s = 0; s < samples; s++) {
+    int16_t diff[3];
+
+    if (kind == AXES_2XC) {
+      diff[0] = (int8_t)data[3 * s];
+      diff[1] = (int8_t)data[3 * s + 1];
+      diff[2] = (int8_t)data[3 * s + 2];
+    } else {
+      uint16_t group = (uint16_t)get_le16(&data[2 * s]);
+      diff[0] = get_diff5(group, 0);
+      diff[1] = get_diff5(group, 5);
+      diff[2] = get_diff5(group, 10);
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+      last->axis[i] = (int16_t)(last->axis[i] + diff[i]);
+    }
+    last->timestamp_us = slot_time((uint8_t)(age - s));
+    state->samples++;
+    ring->push(*last);
+  }
+}
@@ -0,0 +1,235 @@
+/**
+ ******************************************************************************
+ * @file    LSM6DSOXFifo.h
+ * @brief   Tag-demultiplexing decoder for the LSM6DSOX FIFO.
+ ******************************************************************************
+ *
+ * The FIFO holds 7-byte words: a tag byte (sensor tag, 2-bit tag counter,
+ * parity) followed by 6 data bytes. The decoder reads words in bursts with
+ * Get_FIFO_Sample() and routes each one by tag into a typed ring buffer per
+ * channel; the application then pops from the channels it batched.
+ *
+ * Compressed accelerometer and gyroscope words (FIFO_COMPR_EN) are
+ * expanded back to full-resolution samples: NC_T_2/NC_T_1 carry a delayed
+ * sample uncompressed, 2xC two samples as 8-bit differences and 3xC three
+ * samples as 5-bit differences, each relative to the sample before it.
+ * A difference word with no earlier sample to apply it to (the stream was
+ * joined mid-way) is counted in decompress_errors until the next
+ * uncompressed word resynchronises the channel.
+ *
+ * Samples carry a 64-bit time in microseconds on the sensor's timestamp
+ * counter. Every FIFO word holds a 2-bit counter of its time slot; a
+ * TIMESTAMP word fixes its slot exactly, and slots in between (timestamp
+ * decimation 8 or 32) are placed at the slot period measured between the
+ * last two TIMESTAMP words, seeded with set_slot_rate(). Until the first
+ * TIMESTAMP word the time is 0. TIMESTAMP words only time the samples and
+ * have no ring of their own.
+ *
+ * A FIFO overrun discards the oldest words, so the stream read after it
+ * does not follow on from the one read before. The reader reports it with
+ * mark_gap() before draining; the gap is resolved at the next TIMESTAMP
+ * word into a gap record with the number of time slots lost, and sample
+ * times read 0 until then; if the counter shows no slot missing, no record
+ * is made. A TIMESTAMP word further on than the slots decoded since the
+ * previous one also records a gap, overrun or not. A FIFO-mode FIFO that
+ * filled up stops collecting instead, so its gap follows the words held.
+ *
+ * Rings never overwrite: a word for a full ring is counted in the ring's
+ * dropped counter and discarded, so drain in pieces no larger than the
+ * rings (see drain()) and empty them in between. Once a compressed word has
+ * been seen (or compressed is set beforehand), drain() sizes its bursts for
+ * three samples per word.
+ */
+
+#ifndef __LSM6DSOXFifo_H__
+#define __LSM6DSOXFifo_H__
+
+#include "LSM6DSOXSensor.h"
+
+/* Words read from the sensor per burst. */
+#ifndef LSM6DSOX_FIFO_BURST_WORDS
+#define LSM6DSOX_FIFO_BURST_WORDS 64
+#endif
+
+/* Ring capacities, in records. */
+#ifndef LSM6DSOX_FIFO_RING_AXES
+#define LSM6DSOX_FIFO_RING_AXES LSM6DSOX_FIFO_BURST_WORDS
+#endif
+#ifndef LSM6DSOX_FIFO_RING_AUX
+#define LSM6DSOX_FIFO_RING_AUX 16
+#endif
+
+#define LSM6DSOX_FIFO_SLAVES 4
+
+/* Timestamp counter resolution. */
+#define LSM6DSOX_TIMESTAMP_TICK_US 25U
+
+/* Raw 3-axis sample (accelerometer, gyroscope). */
+typedef struct
+{
+  int16_t axis[3];
+  uint64_t timestamp_us;  /* sensor time, 0 when timestamps are not batched */
+} LSM6DSOX_FIFO_Axes_t;
+
+/* Step counter word. */
+typedef struct
+{
+  uint16_t steps;
+  uint32_t timestamp;
+} LSM6DSOX_FIFO_Steps_t;
+
+/* Samples lost from the stream. */
+typedef struct
+{
+  uint32_t xl_index;      /* accelerometer samples decoded before the gap */
+  uint32_t gy_index;      /* gyroscope samples decoded before the gap */
+  uint32_t lost;          /* time slots lost, 0 if unknown */
+  uint64_t start_us;      /* time of the first lost slot, 0 if unknown */
+} LSM6DSOX_FIFO_Gap_t;
+
+/* Sensor hub slave word, as read from the external sensor. */
+typedef struct
+{
+  uint8_t data[6];
+} LSM6DSOX_FIFO_Slave_t;
+
+/**
+ * Fixed-size FIFO of records, for use from a single context.
+ */
+template <typename T, uint16_t N>
+class LSM6DSOXFifoRing
+{
+  public:
+    LSM6DSOXFifoRing() : dropped(0), head(0), count(0) {}
+
+    bool push(const T &record)
+    {
+      if (count >= N) {
+        dropped++;
+        return false;
+      }
+      records[(uint16_t)((head + count) % N)] = record;
+      count++;
+      return true;
+    }
+
+    bool pop(T *record)
+    {
+      if (count == 0U) {
+        return false;
+      }
+      *record = records[head];
+      head = (uint16_t)((head + 1U) % N);
+      count--;
+      return true;
+    }
+
+    uint16_t available() const { return count; }
+    uint16_t space() const { return (uint16_t)(N - count); }
+    void clear() { head = 0; count = 0; dropped = 0; }
+
+    /* Records discarded because the ring was full. */
+    uint32_t dropped;
+
+  private:
+    T records[N];
+    uint16_t head;
+    uint16_t count;
+};
+
+/**
+ * Extends the 32-bit timestamp counter (25 us ticks, wraps every 29.8 h)
+ * to a monotonic 64-bit count. Readings may come slightly out of order,
+ * FIFO words lagging the TIMESTAMP registers, so each one is placed within
+ * half the counter range of the newest; feed it at least every 14.9 h.
+ */
+class LSM6DSOXTimestamp
+{
+  public:
+    LSM6DSOXTimestamp() : newest(0), valid(false) {}
+
+    uint64_t extend(uint32_t raw);
+    LSM6DSOXStatusTypeDef read(LSM6DSOXSensor *sensor, uint64_t *ticks);
+    void reset() { newest = 0; valid = false; }
+
+  private:
+    uint64_t newest;
+    bool valid;
+};
+
+class LSM6DSOXFifoDecoder
+{
+  public:
+    LSM6DSOXFifoDecoder(LSM6DSOXSensor *sensor, LSM6DSOXTimestamp *clock = NULL);
+
+    int32_t drain(uint16_t max_words = 0);
+    void decode(const uint8_t *words, uint16_t count);
+    void reset();
+    void set_slot_rate(float hz);
+    void mark_gap();
+
+    /* Per-channel rings */
+    LSM6DSOXFifoRing<LSM6DSOX_FIFO_Axes_t, LSM6DSOX_FIFO_RING_AXES> xl;
+    LSM6DSOXFifoRing<LSM6DSOX_FIFO_Axes_t, LSM6DSOX_FIFO_RING_AXES> gy;
+    LSM6DSOXFifoRing<int16_t, LSM6DSOX_FIFO_RING_AUX> temperature;
+    LSM6DSOXFifoRing<LSM6DSOX_FIFO_Steps_t, LSM6DSOX_FIFO_RING_AUX> steps;
+    LSM6DSOXFifoRing<LSM6DSOX_FIFO_Slave_t, LSM6DSOX_FIFO_RING_AUX> slave[LSM6DSOX_FIFO_SLAVES];
+    LSM6DSOXFifoRing<LSM6DSOX_FIFO_Gap_t, LSM6DSOX_FIFO_RING_AUX> gaps;
+
+    /* Word statistics since reset() */
+    uint32_t words;          /* words decoded */
+    uint32_t parity_errors;  /* words discarded for a bad tag parity */
+    uint32_t unhandled;      /* words with a tag no channel takes */
+    uint32_t compressed_words;    /* 2xC and 3xC words expanded */
+    uint32_t decompress_errors;   /* difference words with no reference */
+    uint32_t overruns;            /* mark_gap() calls */
+    uint32_t lost_slots;          /* time slots lost, summed over the gaps */
+
+    /* FIFO compression is in use; kept across reset() */
+    bool compressed;
+
+  private:
+    typedef LSM6DSOXFifoRing<LSM6DSOX_FIFO_Axes_t, LSM6DSOX_FIFO_RING_AXES> AxesRing;
+
+    /* Decompression reference and sample count of one channel */
+    typedef struct
+    {
+      LSM6DSOX_FIFO_Axes_t last;
+      bool valid;
+      uint32_t samples;
+    } AxesState;
+
+    void expand(AxesRing *ring, AxesState *state, uint8_t kind, uint8_t age,
+                const uint8_t *data);
+    void record_gap(uint32_t lost, uint64_t start_us);
+    void advance_slot(uint8_t cnt);
+    void stamp_slot(uint32_t raw);
+    uint64_t slot_time(uint8_t age) const;
+
+    LSM6DSOXSensor *sensor;
+    LSM6DSOXTimestamp own_clock;
+    LSM6DSOXTimestamp *clock;
+
+    /* Time of the last four slots, by tag counter */
+    uint64_t slot_us[4];
+    uint64_t last_stamp_us;
+    uint32_t slot_period_us;
+    uint16_t slots_since_stamp;
+    uint8_t slot_cnt;
+    bool slot_valid;
+    bool stamp_valid;
+
+    /* Gap reported by mark_gap(), waiting for a TIMESTAMP word */
+    bool gap_open;
+    uint16_t gap_slots_before;
+    uint32_t gap_xl_index;
+    uint32_t gap_gy_index;
+    uint32_t stamp_xl_index;    /* samples decoded at the last TIMESTAMP word */
+    uint32_t stamp_gy_index;
+
+    AxesState xl_state;
+    AxesState gy_state;
+    uint8_t burst[LSM6DSOX_FIFO_BURST_WORDS * 7];
+};
+
+#endif /* __LSM6DSOXFifo_H__ */
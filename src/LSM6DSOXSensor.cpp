@@ -40,6 +40,7 @@
 /* Includes ------------------------------------------------------------------*/
 
 #include "LSM6DSOXSensor.h"
+#include "BusProfiler.h"
 
 
 /* Class Implementation ------------------------------------------------------*/
@@ -48,7 +49,8 @@
  * @param i2c object of an helper class which handles the I2C peripheral
  * @param address the address of the component's instance
  */
-LSM6DSOXSensor::LSM6DSOXSensor(TwoWire *i2c, uint8_t address) : dev_i2c(i2c), address(address)
+LSM6DSOXSensor::LSM6DSOXSensor(TwoWire *i2c, uint8_t address) : dev_i2c(i2c), address(address),
+  async_queue(i2c, (uint8_t)((address >> 1) & 0x7F), &reg_ctx)
 {
   dev_spi = NULL;
   reg_ctx.write_reg = LSM6DSOX_io_write;
@@ -56,6 +58,16 @@ LSM6DSOXSensor::LSM6DSOXSensor(TwoWire *i2c, uint8_t address) : dev_i2c(i2c), ad
   reg_ctx.handle = (void *)this;
   acc_is_enabled = 0U;
   gyro_is_enabled = 0U;
+  io_last_count = 0U;
+  spi_session = 0U;
+  reg_cache_enabled = 0U;
+  reg_cache_bank = 0U;
+  bank_reg = 0U;
+  bank_reg_hw = 0U;
+  bank_reg_valid = 0U;
+  bank_session = 0U;
+  acc_sensitivity = 0.0f;
+  gyro_sensitivity = 0.0f;
 }
 
 /** Constructor
@@ -63,7 +75,8 @@ LSM6DSOXSensor::LSM6DSOXSensor(TwoWire *i2c, uint8_t address) : dev_i2c(i2c), ad
  * @param cs_pin the chip select pin
  * @param spi_speed the SPI speed
  */
-LSM6DSOXSensor::LSM6DSOXSensor(SPIClass *spi, int cs_pin, uint32_t spi_speed) : dev_spi(spi), cs_pin(cs_pin), spi_speed(spi_speed)
+LSM6DSOXSensor::LSM6DSOXSensor(SPIClass *spi, int cs_pin, uint32_t spi_speed) : dev_spi(spi), cs_pin(cs_pin), spi_speed(spi_speed),
+  async_queue(NULL, 0, &reg_ctx)
 {
   reg_ctx.write_reg = LSM6DSOX_io_write;
   reg_ctx.read_reg = LSM6DSOX_io_read;
@@ -72,6 +85,20 @@ LSM6DSOXSensor::LSM6DSOXSensor(SPIClass *spi, int cs_pin, uint32_t spi_speed) :
   address = 0; 
   acc_is_enabled = 0U;
   gyro_is_enabled = 0U;  
+  io_last_count = 0U;
+  spi_session = 0U;
+  reg_cache_enabled = 0U;
+  reg_cache_bank = 0U;
+  bank_reg = 0U;
+  bank_reg_hw = 0U;
+  bank_reg_valid = 0U;
+  bank_session = 0U;
+  acc_sensitivity = 0.0f;
+  gyro_sensitivity = 0.0f;
+  if (this->spi_speed > LSM6DSOX_SPI_MAX_SPEED)
+  {
+    this->spi_speed = LSM6DSOX_SPI_MAX_SPEED;
+  }
 }
 
 /**
@@ -80,6 +107,8 @@ LSM6DSOXSensor::LSM6DSOXSensor(SPIClass *spi, int cs_pin, uint32_t spi_speed) :
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::begin()
 {
+  BUS_PROFILE_SCOPE("begin");
+
   if(dev_spi)
   {
     // Configure CS pin
@@ -87,6 +116,12 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::begin()
     digitalWrite(cs_pin, HIGH); 
   }
 
+  /* Background transfer engine (DMA on the STM32L4) */
+  if (async_queue.begin() != 0)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
   /* Disable I3C */
   if (lsm6dsox_i3c_disable_set(&reg_ctx, LSM6DSOX_I3C_DISABLE) != LSM6DSOX_OK)
   {
@@ -126,6 +161,7 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::begin()
   {
     return LSM6DSOX_ERROR;
   }
+  acc_sensitivity = LSM6DSOX_ACC_SENSITIVITY_FS_2G;
 
   /* Select default output data rate. */
   gyro_odr = LSM6DSOX_GY_ODR_104Hz;
@@ -141,6 +177,7 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::begin()
   {
     return LSM6DSOX_ERROR;
   }
+  gyro_sensitivity = LSM6DSOX_GYRO_SENSITIVITY_FS_2000DPS;
   
   acc_is_enabled = 0;
   gyro_is_enabled = 0;
@@ -197,6 +234,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::ReadID(uint8_t *Id)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Enable_X()
 {
+  BUS_PROFILE_SCOPE("Enable_X");
+
   /* Check if the component is already enabled */
   if (acc_is_enabled == 1U)
   {
@@ -220,6 +259,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Enable_X()
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Disable_X()
 {
+  BUS_PROFILE_SCOPE("Disable_X");
+
   /* Check if the component is already disabled */
   if (acc_is_enabled == 0U)
   {
@@ -253,6 +294,13 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_Sensitivity(float *Sensitivity)
   LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
   lsm6dsox_fs_xl_t full_scale;
 
+  /* Known since the last full scale change: no bus access needed. */
+  if (acc_sensitivity > 0.0f)
+  {
+    *Sensitivity = acc_sensitivity;
+    return LSM6DSOX_OK;
+  }
+
   /* Read actual full scale selection from sensor. */
   if (lsm6dsox_xl_full_scale_get(&reg_ctx, &full_scale) != LSM6DSOX_OK)
   {
@@ -283,6 +331,11 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_Sensitivity(float *Sensitivity)
       break;
   }
 
+  if (ret == LSM6DSOX_OK)
+  {
+    acc_sensitivity = *Sensitivity;
+  }
+
   return ret;
 }
 
@@ -379,6 +432,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_X_ODR(float Odr)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_X_ODR_With_Mode(float Odr, LSM6DSOX_ACC_Operating_Mode_t Mode)
 {
+  BUS_PROFILE_SCOPE("Set_X_ODR_With_Mode");
+
   LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
 
   switch (Mode)
@@ -665,6 +720,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_FS(int32_t *FullScale)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_X_FS(int32_t FullScale)
 {
+  BUS_PROFILE_SCOPE("Set_X_FS");
+
   lsm6dsox_fs_xl_t new_fs;
 
   /* Seems like MISRA C-2012 rule 14.3a violation but only from single file statical analysis point of view because
@@ -679,6 +736,11 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_X_FS(int32_t FullScale)
     return LSM6DSOX_ERROR;
   }
 
+  acc_sensitivity = (new_fs == LSM6DSOX_2g) ? LSM6DSOX_ACC_SENSITIVITY_FS_2G
+                  : (new_fs == LSM6DSOX_4g) ? LSM6DSOX_ACC_SENSITIVITY_FS_4G
+                  : (new_fs == LSM6DSOX_8g) ? LSM6DSOX_ACC_SENSITIVITY_FS_8G
+                  :                           LSM6DSOX_ACC_SENSITIVITY_FS_16G;
+
   return LSM6DSOX_OK;
 }
 
@@ -689,6 +751,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_X_FS(int32_t FullScale)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_AxesRaw(int16_t *Value)
 {
+  BUS_PROFILE_SCOPE("Get_X_AxesRaw");
+
   axis3bit16_t data_raw;
 
   /* Read raw data values. */
@@ -713,6 +777,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_AxesRaw(int16_t *Value)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_Axes(int32_t *Acceleration)
 {
+  BUS_PROFILE_SCOPE("Get_X_Axes");
+
   axis3bit16_t data_raw;
   float sensitivity = 0.0f;
 
@@ -743,6 +809,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_X_Axes(int32_t *Acceleration)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Enable_G()
 {
+  BUS_PROFILE_SCOPE("Enable_G");
+
   /* Check if the component is already enabled */
   if (gyro_is_enabled == 1U)
   {
@@ -767,6 +835,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Enable_G()
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Disable_G()
 {
+  BUS_PROFILE_SCOPE("Disable_G");
+
   /* Check if the component is already disabled */
   if (gyro_is_enabled == 0U)
   {
@@ -800,6 +870,13 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_Sensitivity(float *Sensitivity)
   LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
   lsm6dsox_fs_g_t full_scale;
 
+  /* Known since the last full scale change: no bus access needed. */
+  if (gyro_sensitivity > 0.0f)
+  {
+    *Sensitivity = gyro_sensitivity;
+    return LSM6DSOX_OK;
+  }
+
   /* Read actual full scale selection from sensor. */
   if (lsm6dsox_gy_full_scale_get(&reg_ctx, &full_scale) != LSM6DSOX_OK)
   {
@@ -834,6 +911,11 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_Sensitivity(float *Sensitivity)
       break;
   }
 
+  if (ret == LSM6DSOX_OK)
+  {
+    gyro_sensitivity = *Sensitivity;
+  }
+
   return ret;
 }
 
@@ -925,6 +1007,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_ODR(float Odr)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_ODR_With_Mode(float Odr, LSM6DSOX_GYRO_Operating_Mode_t Mode)
 {
+  BUS_PROFILE_SCOPE("Set_G_ODR_With_Mode");
+
   LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
 
   switch (Mode)
@@ -1097,6 +1181,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_FS(int32_t  *FullScale)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_FS(int32_t FullScale)
 {
+  BUS_PROFILE_SCOPE("Set_G_FS");
+
   lsm6dsox_fs_g_t new_fs;
 
   new_fs = (FullScale <= 125)  ? LSM6DSOX_125dps
@@ -1110,6 +1196,12 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_FS(int32_t FullScale)
     return LSM6DSOX_ERROR;
   }
 
+  gyro_sensitivity = (new_fs == LSM6DSOX_125dps)  ? LSM6DSOX_GYRO_SENSITIVITY_FS_125DPS
+                   : (new_fs == LSM6DSOX_250dps)  ? LSM6DSOX_GYRO_SENSITIVITY_FS_250DPS
+                   : (new_fs == LSM6DSOX_500dps)  ? LSM6DSOX_GYRO_SENSITIVITY_FS_500DPS
+                   : (new_fs == LSM6DSOX_1000dps) ? LSM6DSOX_GYRO_SENSITIVITY_FS_1000DPS
+                   :                                LSM6DSOX_GYRO_SENSITIVITY_FS_2000DPS;
+
   return LSM6DSOX_OK;
 }
 
@@ -1120,6 +1212,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_FS(int32_t FullScale)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_AxesRaw(int16_t *Value)
 {
+  BUS_PROFILE_SCOPE("Get_G_AxesRaw");
+
   axis3bit16_t data_raw;
 
   /* Read raw data values. */
@@ -1144,6 +1238,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_AxesRaw(int16_t *Value)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_G_Axes(int32_t *AngularRate)
 {
+  BUS_PROFILE_SCOPE("Get_G_Axes");
+
   axis3bit16_t data_raw;
   float sensitivity;
 
@@ -2708,6 +2804,8 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_G_SelfTest(uint8_t val)
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Num_Samples(uint16_t *NumSamples)
 {
+  BUS_PROFILE_SCOPE("Get_FIFO_Num_Samples");
+
   if (lsm6dsox_fifo_data_level_get(&reg_ctx, NumSamples) != LSM6DSOX_OK)
   {
     return LSM6DSOX_ERROR;
@@ -2716,6 +2814,29 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Num_Samples(uint16_t *NumSamples)
   return LSM6DSOX_OK;
 }
 
+/**
+ * @brief  Get the LSM6DSOX FIFO level and status flags in one read
+ * @param  NumSamples number of samples
+ * @param  Flags FIFO_STATUS2 flags (LSM6DSOX_FIFO_FLAG_*); reading them
+ *         clears the latched overrun flag
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Status(uint16_t *NumSamples, uint8_t *Flags)
+{
+  BUS_PROFILE_SCOPE("Get_FIFO_Status");
+  uint8_t status[2];
+
+  if (lsm6dsox_read_reg(&reg_ctx, LSM6DSOX_FIFO_STATUS1, status, 2) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  *NumSamples = (uint16_t)(((status[1] & 0x03U) << 8) | status[0]);
+  *Flags = status[1] & 0xF8U;
+
+  return LSM6DSOX_OK;
+}
+
 /**
  * @brief  Get the LSM6DSOX FIFO full status
  * @param  Status FIFO full status
@@ -2917,6 +3038,98 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_INT2_FIFO_Threshold(uint8_t Statu
   return LSM6DSOX_OK;
 }
 
+/**
+ * @brief  Set the LSM6DSOX batch counter interrupt on INT1 pin
+ * @param  Status batch counter interrupt on INT1 pin status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_INT1_Batch_Counter(uint8_t Status)
+{
+  lsm6dsox_reg_t reg;
+
+  if (lsm6dsox_read_reg(&reg_ctx, LSM6DSOX_INT1_CTRL, &reg.byte, 1) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  reg.int1_ctrl.int1_cnt_bdr = Status;
+
+  if (lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_INT1_CTRL, &reg.byte, 1) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Set the LSM6DSOX sensor whose batched samples the batch counter counts
+ * @param  Event LSM6DSOX_XL_BATCH_EVENT or LSM6DSOX_GYRO_BATCH_EVENT
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Batch_Counter_Event(uint8_t Event)
+{
+  LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
+
+  /* Verify that the passed parameter contains one of the valid values. */
+  switch ((lsm6dsox_trig_counter_bdr_t)Event)
+  {
+    case LSM6DSOX_XL_BATCH_EVENT:
+    case LSM6DSOX_GYRO_BATCH_EVENT:
+      break;
+
+    default:
+      ret = LSM6DSOX_ERROR;
+      break;
+  }
+
+  if (ret == LSM6DSOX_ERROR)
+  {
+    return ret;
+  }
+
+  if (lsm6dsox_fifo_cnt_event_batch_set(&reg_ctx, (lsm6dsox_trig_counter_bdr_t)Event) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return ret;
+}
+
+/**
+ * @brief  Set the LSM6DSOX batch counter threshold
+ * @param  Threshold batched samples that raise COUNTER_BDR_IA [1 to 2047]
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Batch_Counter_Threshold(uint16_t Threshold)
+{
+  if (Threshold > 0x07FFU)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  if (lsm6dsox_batch_counter_threshold_set(&reg_ctx, Threshold) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Restart the LSM6DSOX batch counter from zero
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Reset_FIFO_Batch_Counter()
+{
+  if (lsm6dsox_rst_batch_counter_set(&reg_ctx, 1) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
 /**
  * @brief  Set the LSM6DSOX FIFO watermark level
  * @param  Watermark FIFO watermark level
@@ -3021,12 +3234,23 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Data(uint8_t *Data)
 /**
  * @brief  Get the LSM6DSOX FIFO sample
  * @param  Sample FIFO sample array [multiple of 7]
- * @param  Count Count of samples to get.
+ * @param  Count Count of samples to get, up to the whole FIFO (512).
+ * @param  Received optional, number of complete samples actually read; lower
+ *         than Count after a short read
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Sample(uint8_t *Sample, uint16_t Count)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Sample(uint8_t *Sample, uint16_t Count, uint16_t *Received)
 {
-  if (lsm6dsox_read_reg(&reg_ctx, LSM6DSOX_FIFO_DATA_OUT_TAG, Sample, Count * 7) != LSM6DSOX_OK)
+  BUS_PROFILE_SCOPE("Get_FIFO_Sample");
+
+  int32_t ret = lsm6dsox_read_reg(&reg_ctx, LSM6DSOX_FIFO_DATA_OUT_TAG, Sample, Count * 7);
+
+  if (Received != NULL)
+  {
+    *Received = (ret == 0) ? Count : (uint16_t)(io_last_count / 7);
+  }
+
+  if (ret != LSM6DSOX_OK)
   {
     return LSM6DSOX_ERROR;
   }
@@ -3071,6 +3295,12 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_X_Axes(int32_t *Acceleration)
   return LSM6DSOX_OK;
 }
 
+/* FIFO batch data rates by BDR_XL/BDR_GY code, 1 to 10 */
+static const float fifo_bdr_hz[11] =
+{
+  0.0f, 12.5f, 26.0f, 52.0f, 104.0f, 208.0f, 417.0f, 833.0f, 1667.0f, 3333.0f, 6667.0f
+};
+
 /**
  * @brief  Set the LSM6DSOX FIFO accelero BDR value
  * @param  Bdr FIFO accelero BDR value
@@ -3086,10 +3316,10 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_X_BDR(float Bdr)
             : (Bdr <=   52.0f) ? LSM6DSOX_XL_BATCHED_AT_52Hz
             : (Bdr <=  104.0f) ? LSM6DSOX_XL_BATCHED_AT_104Hz
             : (Bdr <=  208.0f) ? LSM6DSOX_XL_BATCHED_AT_208Hz
-            : (Bdr <=  416.0f) ? LSM6DSOX_XL_BATCHED_AT_417Hz
+            : (Bdr <=  417.0f) ? LSM6DSOX_XL_BATCHED_AT_417Hz
             : (Bdr <=  833.0f) ? LSM6DSOX_XL_BATCHED_AT_833Hz
-            : (Bdr <= 1660.0f) ? LSM6DSOX_XL_BATCHED_AT_1667Hz
-            : (Bdr <= 3330.0f) ? LSM6DSOX_XL_BATCHED_AT_3333Hz
+            : (Bdr <= 1667.0f) ? LSM6DSOX_XL_BATCHED_AT_1667Hz
+            : (Bdr <= 3333.0f) ? LSM6DSOX_XL_BATCHED_AT_3333Hz
             :                    LSM6DSOX_XL_BATCHED_AT_6667Hz;
 
   if (lsm6dsox_fifo_xl_batch_set(&reg_ctx, new_bdr) != LSM6DSOX_OK)
@@ -3100,6 +3330,26 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_X_BDR(float Bdr)
   return LSM6DSOX_OK;
 }
 
+/**
+ * @brief  Get the LSM6DSOX FIFO accelerometer BDR value
+ * @param  Bdr pointer where the FIFO accelerometer BDR value is written (0 if not batched)
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_X_BDR(float *Bdr)
+{
+  lsm6dsox_bdr_xl_t bdr;
+
+  if (lsm6dsox_fifo_xl_batch_get(&reg_ctx, &bdr) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  /* Code 11 is the extra low rate, 1.6 Hz for the accelerometer */
+  *Bdr = (bdr == LSM6DSOX_XL_BATCHED_AT_6Hz5) ? 1.6f : fifo_bdr_hz[bdr];
+
+  return LSM6DSOX_OK;
+}
+
 /**
  * @brief  Get the LSM6DSOX FIFO gyro single sample (16-bit data per 3 axes) and calculate angular velocity [mDPS]
  * @param  AngularVelocity FIFO gyro axes [mDPS]
@@ -3152,10 +3402,10 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_G_BDR(float Bdr)
             : (Bdr <=   52.0f) ? LSM6DSOX_GY_BATCHED_AT_52Hz
             : (Bdr <=  104.0f) ? LSM6DSOX_GY_BATCHED_AT_104Hz
             : (Bdr <=  208.0f) ? LSM6DSOX_GY_BATCHED_AT_208Hz
-            : (Bdr <=  416.0f) ? LSM6DSOX_GY_BATCHED_AT_417Hz
+            : (Bdr <=  417.0f) ? LSM6DSOX_GY_BATCHED_AT_417Hz
             : (Bdr <=  833.0f) ? LSM6DSOX_GY_BATCHED_AT_833Hz
-            : (Bdr <= 1660.0f) ? LSM6DSOX_GY_BATCHED_AT_1667Hz
-            : (Bdr <= 3330.0f) ? LSM6DSOX_GY_BATCHED_AT_3333Hz
+            : (Bdr <= 1667.0f) ? LSM6DSOX_GY_BATCHED_AT_1667Hz
+            : (Bdr <= 3333.0f) ? LSM6DSOX_GY_BATCHED_AT_3333Hz
             :                    LSM6DSOX_GY_BATCHED_AT_6667Hz;
 
   if (lsm6dsox_fifo_gy_batch_set(&reg_ctx, new_bdr) != LSM6DSOX_OK)
@@ -3166,34 +3416,40 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_G_BDR(float Bdr)
   return LSM6DSOX_OK;
 }
 
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_MLC_Status(LSM6DSOX_MLC_Status_t *Status)
+/**
+ * @brief  Get the LSM6DSOX FIFO gyro BDR value
+ * @param  Bdr pointer where the FIFO gyro BDR value is written (0 if not batched)
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_G_BDR(float *Bdr)
 {
-  if (lsm6dsox_mlc_status_get(&reg_ctx, (lsm6dsox_mlc_status_mainpage_t *)Status) != LSM6DSOX_OK)
-  {
-    return LSM6DSOX_ERROR;
-  }
-
-  return LSM6DSOX_OK;
-}
+  lsm6dsox_bdr_gy_t bdr;
 
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_MLC_Output(uint8_t *Output)
-{
-  if (lsm6dsox_mlc_out_get(&reg_ctx, Output) != LSM6DSOX_OK)
+  if (lsm6dsox_fifo_gy_batch_get(&reg_ctx, &bdr) != LSM6DSOX_OK)
   {
     return LSM6DSOX_ERROR;
   }
 
+  *Bdr = (bdr == LSM6DSOX_GY_BATCHED_AT_6Hz5) ? 6.5f : fifo_bdr_hz[bdr];
+
   return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Get the LSM6DSOX timestamp enable status
- * @param  Status Timestamp enable status
+ * @brief  Set the LSM6DSOX FIFO temperature BDR value
+ * @param  Bdr FIFO temperature BDR value, 1.6, 12.5 or 52 Hz (0 disables batching)
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_Timestamp_Status(uint8_t *Status)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_T_BDR(float Bdr)
 {
-  if (lsm6dsox_timestamp_get(&reg_ctx, Status) != LSM6DSOX_OK)
+  lsm6dsox_odr_t_batch_t new_bdr;
+
+  new_bdr = (Bdr <=  0.0f) ? LSM6DSOX_TEMP_NOT_BATCHED
+            : (Bdr <=  1.6f) ? LSM6DSOX_TEMP_BATCHED_AT_1Hz6
+            : (Bdr <= 12.5f) ? LSM6DSOX_TEMP_BATCHED_AT_12Hz5
+            :                  LSM6DSOX_TEMP_BATCHED_AT_52Hz;
+
+  if (lsm6dsox_fifo_temp_batch_set(&reg_ctx, new_bdr) != LSM6DSOX_OK)
   {
     return LSM6DSOX_ERROR;
   }
@@ -3202,135 +3458,632 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_Timestamp_Status(uint8_t *Status)
 }
 
 /**
- * @brief  Set the LSM6DSOX timestamp enable status
- * @param  Status Timestamp enable status
+ * @brief  Convert the accelerometer words of a block of FIFO samples to [mg]
+ * @note   The sensitivity is looked up once for the whole block; words with
+ *         other tags are skipped.
+ * @param  Sample FIFO samples as read by Get_FIFO_Sample() [multiple of 7]
+ * @param  Count number of samples in Sample
+ * @param  Acceleration output array, 3 axes per converted sample [mg]
+ * @param  Converted number of samples written to Acceleration
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_Timestamp_Status(uint8_t Status)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Convert_FIFO_X_Axes(const uint8_t *Sample, uint16_t Count, int32_t *Acceleration, uint16_t *Converted)
 {
-  if (lsm6dsox_timestamp_set(&reg_ctx, Status) != LSM6DSOX_OK)
+  float sensitivity = 0.0f;
+  uint16_t n = 0;
+
+  if (Get_X_Sensitivity(&sensitivity) != LSM6DSOX_OK)
   {
     return LSM6DSOX_ERROR;
   }
 
+  for (uint16_t i = 0; i < Count; i++, Sample += 7)
+  {
+    if ((Sample[0] >> 3) != LSM6DSOX_XL_NC_TAG)
+    {
+      continue;
+    }
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+      int16_t raw = (int16_t)(((uint16_t)Sample[2 + 2 * axis] << 8) | Sample[1 + 2 * axis]);
+      *Acceleration++ = (int32_t)((float)raw * sensitivity);
+    }
+    n++;
+  }
+
+  *Converted = n;
+
   return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Set the LSM6DSOX FIFO timestamp decimation
- * @param  Decimation FIFO timestamp decimation
+ * @brief  Convert the gyroscope words of a block of FIFO samples to [mDPS]
+ * @note   The sensitivity is looked up once for the whole block; words with
+ *         other tags are skipped.
+ * @param  Sample FIFO samples as read by Get_FIFO_Sample() [multiple of 7]
+ * @param  Count number of samples in Sample
+ * @param  AngularVelocity output array, 3 axes per converted sample [mDPS]
+ * @param  Converted number of samples written to AngularVelocity
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Timestamp_Decimation(uint8_t Decimation)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Convert_FIFO_G_Axes(const uint8_t *Sample, uint16_t Count, int32_t *AngularVelocity, uint16_t *Converted)
 {
-  LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
+  float sensitivity = 0.0f;
+  uint16_t n = 0;
 
-  /* Verify that the passed parameter contains one of the valid values. */
-  switch ((lsm6dsox_odr_ts_batch_t)Decimation)
+  if (Get_G_Sensitivity(&sensitivity) != LSM6DSOX_OK)
   {
-    case LSM6DSOX_NO_DECIMATION:
-    case LSM6DSOX_DEC_1:
-    case LSM6DSOX_DEC_8:
-    case LSM6DSOX_DEC_32:
-      break;
-
-    default:
-      ret = LSM6DSOX_ERROR;
-      break;
+    return LSM6DSOX_ERROR;
   }
 
-  if (ret == LSM6DSOX_ERROR)
+  for (uint16_t i = 0; i < Count; i++, Sample += 7)
   {
-    return ret;
+    if ((Sample[0] >> 3) != LSM6DSOX_GYRO_NC_TAG)
+    {
+      continue;
+    }
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+      int16_t raw = (int16_t)(((uint16_t)Sample[2 + 2 * axis] << 8) | Sample[1 + 2 * axis]);
+      *AngularVelocity++ = (int32_t)((float)raw * sensitivity);
+    }
+    n++;
   }
 
-  if (lsm6dsox_fifo_timestamp_decimation_set(&reg_ctx, (lsm6dsox_odr_ts_batch_t)Decimation) != LSM6DSOX_OK)
-  {
-    return LSM6DSOX_ERROR;
-  }
+  *Converted = n;
 
-  return ret;
+  return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Set the LSM6DSOX FIFO compression initialization status
- * @param  Status FIFO compression initialization status
+ * @brief  Keep the SPI bus claimed across the register accesses of one
+ *         logical operation
+ * @note   The SPI transaction (settings and bus ownership) is opened once and
+ *         kept until Bus_Session_End(); chip select still toggles for every
+ *         register access, since the sensor takes a new command byte after
+ *         each CS falling edge. Sessions nest. No effect on I2C.
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Init(uint8_t Status)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Bus_Session_Begin()
 {
-  if (lsm6dsox_compression_algo_init_set(&reg_ctx, Status) != LSM6DSOX_OK)
+  if (dev_spi && spi_session++ == 0U)
   {
-    return LSM6DSOX_ERROR;
+    dev_spi->beginTransaction(SPISettings(spi_speed, MSBFIRST, SPI_MODE3));
   }
 
   return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Set the LSM6DSOX FIFO compression enable status
- * @param  Status FIFO compression enable status
+ * @brief  Release the SPI bus claimed by Bus_Session_Begin()
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Enable(uint8_t Status)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Bus_Session_End()
 {
-  lsm6dsox_emb_sens_t val;
-  if (lsm6dsox_embedded_sens_get(&reg_ctx, &val) != LSM6DSOX_OK)
-  {
-    return LSM6DSOX_ERROR;
-  }
-
-  val.fifo_compr = Status;
-
-  if (lsm6dsox_embedded_sens_set(&reg_ctx, &val) != LSM6DSOX_OK)
+  if (dev_spi && spi_session > 0U && --spi_session == 0U)
   {
-    return LSM6DSOX_ERROR;
+    dev_spi->endTransaction();
   }
 
   return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Set the LSM6DSOX FIFO compression configuration and enable status
- * @param  Compression FIFO compression and enable status
+ * @brief  Share one memory bank switch between several embedded functions
+ *         accesses
+ * @note   Every embedded-bank getter enters the embedded bank and switches
+ *         back to the user bank when done. Inside a session the switch back
+ *         is deferred: it is dropped if the next access re-enters the
+ *         embedded bank and performed before any other register access, so
+ *         user-bank registers stay safe to use. Sessions nest; the sensor is
+ *         left in the user bank by the outermost Embedded_Bank_Session_End().
  * @retval 0 in case of success, an error code otherwise
  */
-LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Set(uint8_t Compression)
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Embedded_Bank_Session_Begin()
 {
-  LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
-
-  /* Verify that the passed parameter contains one of the valid values. */
-  switch ((lsm6dsox_uncoptr_rate_t)Compression)
-  {
-    case LSM6DSOX_CMP_DISABLE:
-    case LSM6DSOX_CMP_ALWAYS:
-    case LSM6DSOX_CMP_8_TO_1:
-    case LSM6DSOX_CMP_16_TO_1:
-    case LSM6DSOX_CMP_32_TO_1:
-      break;
+  Bus_Session_Begin();
+  bank_session++;
 
-    default:
-      ret = LSM6DSOX_ERROR;
-      break;
-  }
+  return LSM6DSOX_OK;
+}
 
+/**
+ * @brief  Close a session opened by Embedded_Bank_Session_Begin()
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Embedded_Bank_Session_End()
+{
+  int32_t ret = 0;
 
-  if (ret == LSM6DSOX_ERROR)
+  if (bank_session > 0U && --bank_session == 0U)
   {
-    return ret;
+    ret = Bank_Flush();
   }
+  Bus_Session_End();
 
-  if (lsm6dsox_compression_algo_set(&reg_ctx, (lsm6dsox_uncoptr_rate_t)Compression) != LSM6DSOX_OK)
+  if (ret != 0)
   {
     return LSM6DSOX_ERROR;
   }
 
-  return ret;
+  return LSM6DSOX_OK;
 }
 
 /**
- * @brief  Set the LSM6DSOX FIFO compression real time enable status
- * @param  Status FIFO compression real time enable status
+ * @brief  Start a background register read
+ * @param  Reg first register to read
+ * @param  Data buffer, must stay valid until the callback runs
+ * @param  Len number of bytes, not limited by the Wire buffer
+ * @param  Callback called from Async_Service() when the data is in
+ * @param  Arg passed to the callback
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Read_Async(uint8_t Reg, uint8_t *Data, uint16_t Len, LSM6DSOX_AsyncCallback_t Callback, void *Arg)
+{
+  /* Background transfers bypass the bank tracking: settle it first */
+  if (Bank_Flush() != 0)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  if (async_queue.submit(Reg, Data, Len, false, Callback, Arg) != 0)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Start a background read of FIFO samples
+ * @param  Sample FIFO sample array [multiple of 7]
+ * @param  Count Count of samples to get
+ * @param  Callback called from Async_Service() when the samples are in
+ * @param  Arg passed to the callback
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_FIFO_Sample_Async(uint8_t *Sample, uint16_t Count, LSM6DSOX_AsyncCallback_t Callback, void *Arg)
+{
+  return Read_Async(LSM6DSOX_FIFO_DATA_OUT_TAG, Sample, Count * 7, Callback, Arg);
+}
+
+/**
+ * @brief  Number of background transfers not yet delivered
+ * @retval Transfers queued, running or awaiting Async_Service()
+ */
+uint8_t LSM6DSOXSensor::Async_Pending()
+{
+  return async_queue.pending();
+}
+
+/**
+ * @brief  Deliver completed background transfers to their callbacks
+ */
+void LSM6DSOXSensor::Async_Service()
+{
+  async_queue.service();
+}
+
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_MLC_Status(LSM6DSOX_MLC_Status_t *Status)
+{
+  BUS_PROFILE_SCOPE("Get_MLC_Status");
+
+  if (lsm6dsox_mlc_status_get(&reg_ctx, (lsm6dsox_mlc_status_mainpage_t *)Status) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_MLC_Output(uint8_t *Output)
+{
+  BUS_PROFILE_SCOPE("Get_MLC_Output");
+
+  /* Bank switch, read and switch back under one bus claim */
+  Bus_Session_Begin();
+  int32_t ret = lsm6dsox_mlc_out_get(&reg_ctx, Output);
+  Bus_Session_End();
+
+  if (ret != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/* Fletcher-16 over the page data of an MLC/FSM program. */
+static void ucf_checksum_add(uint16_t *Sum, const uint8_t *Data, uint16_t Len)
+{
+  uint16_t a = *Sum & 0xFFU;
+  uint16_t b = *Sum >> 8;
+
+  for (uint16_t i = 0; i < Len; i++)
+  {
+    a = (uint16_t)((a + Data[i]) % 255U);
+    b = (uint16_t)((b + a) % 255U);
+  }
+
+  *Sum = (uint16_t)((b << 8) | a);
+}
+
+/**
+ * @brief  Load a Machine Learning Core / FSM program (UCF)
+ * @note   Register auto-increment is disabled for the whole load, so each run
+ *         of consecutive PAGE_VALUE lines goes out as one burst to PAGE_VALUE
+ *         instead of one transfer per line. With Verify, the page data is
+ *         then read back and its checksum compared with what was written;
+ *         that costs about as much bus time as the load itself.
+ * @param  Program UCF lines
+ * @param  Lines number of lines
+ * @param  Loaded number of lines written, the failing line on a bus error
+ * @param  Checksum Fletcher-16 of the page data read back, or written
+ *         without Verify
+ * @param  Verify read the page data back
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Load_MLC_Program(const ucf_line_t *Program, uint32_t Lines, uint32_t *Loaded, uint16_t *Checksum, bool Verify)
+{
+  BUS_PROFILE_SCOPE("Load_MLC_Program");
+
+  uint8_t burst[LSM6DSOX_UCF_BURST_SIZE];
+  uint16_t written_sum = 0;
+  uint16_t read_sum = 0;
+  uint32_t line = 0;
+  int32_t ret;
+
+  Embedded_Bank_Session_Begin();
+
+  /* Keep the register pointer on PAGE_VALUE during bursts */
+  ret = lsm6dsox_auto_increment_set(&reg_ctx, PROPERTY_DISABLE);
+
+  while (ret == 0 && line < Lines)
+  {
+    if (Program[line].address != LSM6DSOX_PAGE_VALUE)
+    {
+      uint8_t data = Program[line].data;
+      ret = lsm6dsox_write_reg(&reg_ctx, Program[line].address, &data, 1);
+      if (ret == 0)
+      {
+        line++;
+      }
+      continue;
+    }
+
+    uint16_t len = 0;
+    while (line + len < Lines && len < LSM6DSOX_UCF_BURST_SIZE && Program[line + len].address == LSM6DSOX_PAGE_VALUE)
+    {
+      burst[len] = Program[line + len].data;
+      len++;
+    }
+
+    ret = Page_Value_Burst(burst, len, true);
+    if (ret == 0)
+    {
+      ucf_checksum_add(&written_sum, burst, len);
+      line += len;
+    }
+  }
+
+  if (Loaded != NULL)
+  {
+    *Loaded = line;
+  }
+
+  /* Read the page data back, replaying the program's page selection */
+  if (ret == 0 && !Verify)
+  {
+    read_sum = written_sum;
+    ret = lsm6dsox_mem_bank_set(&reg_ctx, LSM6DSOX_USER_BANK);
+  }
+  else if (ret == 0)
+  {
+    uint8_t page_rw = 0;
+    uint8_t page_sel = 0;
+    uint8_t page_addr = 0;
+
+    ret = lsm6dsox_mem_bank_set(&reg_ctx, LSM6DSOX_EMBEDDED_FUNC_BANK);
+    if (ret == 0)
+    {
+      ret = lsm6dsox_read_reg(&reg_ctx, LSM6DSOX_PAGE_RW, &page_rw, 1);
+    }
+    if (ret == 0)
+    {
+      uint8_t value = (uint8_t)((page_rw & ~0x40U) | 0x20U);   /* page_read */
+      ret = lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_PAGE_RW, &value, 1);
+    }
+
+    for (line = 0; ret == 0 && line < Lines; )
+    {
+      if (Program[line].address == LSM6DSOX_PAGE_SEL)
+      {
+        page_sel = Program[line++].data;
+        continue;
+      }
+      if (Program[line].address == LSM6DSOX_PAGE_ADDRESS)
+      {
+        page_addr = Program[line++].data;
+        continue;
+      }
+      if (Program[line].address != LSM6DSOX_PAGE_VALUE)
+      {
+        line++;
+        continue;
+      }
+
+      uint16_t len = 0;
+      while (line + len < Lines && len < LSM6DSOX_UCF_BURST_SIZE && Program[line + len].address == LSM6DSOX_PAGE_VALUE)
+      {
+        len++;
+      }
+
+      ret = lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_PAGE_SEL, &page_sel, 1);
+      if (ret == 0)
+      {
+        ret = lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_PAGE_ADDRESS, &page_addr, 1);
+      }
+      if (ret == 0)
+      {
+        ret = Page_Value_Burst(burst, len, false);
+      }
+      if (ret == 0)
+      {
+        ucf_checksum_add(&read_sum, burst, len);
+        page_addr = (uint8_t)(page_addr + len);
+        line += len;
+      }
+    }
+
+    /* Leave the page registers as the program left them */
+    if (ret == 0)
+    {
+      ret = lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_PAGE_RW, &page_rw, 1);
+    }
+    if (ret == 0)
+    {
+      ret = lsm6dsox_write_reg(&reg_ctx, LSM6DSOX_PAGE_SEL, &page_sel, 1);
+    }
+    if (ret == 0)
+    {
+      ret = lsm6dsox_mem_bank_set(&reg_ctx, LSM6DSOX_USER_BANK);
+    }
+  }
+  else
+  {
+    lsm6dsox_mem_bank_set(&reg_ctx, LSM6DSOX_USER_BANK);
+  }
+
+  /* Restore auto-increment in any case */
+  if (lsm6dsox_auto_increment_set(&reg_ctx, PROPERTY_ENABLE) != 0)
+  {
+    ret = -1;
+  }
+
+  Embedded_Bank_Session_End();
+
+  if (Checksum != NULL)
+  {
+    *Checksum = read_sum;
+  }
+
+  if (ret != 0 || read_sum != written_sum)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Write or read consecutive bytes of PAGE_VALUE in one transfer
+ * @note   Needs register auto-increment disabled and the embedded functions
+ *         bank selected. Page data is not cached, so this bypasses the
+ *         register cache.
+ * @param  Data bytes to write or buffer to read into
+ * @param  Len number of bytes, at most LSM6DSOX_UCF_BURST_SIZE
+ * @param  Write true to write, false to read
+ * @retval 0 in case of success, an error code otherwise
+ */
+int32_t LSM6DSOXSensor::Page_Value_Burst(uint8_t *Data, uint16_t Len, bool Write)
+{
+  int32_t ret = Bank_Flush();
+
+  if (ret != 0)
+  {
+    return ret;
+  }
+
+  BUS_PROFILE_TIME(start);
+  ret = Write ? IO_Write(Data, LSM6DSOX_PAGE_VALUE, Len, false) : IO_Read(Data, LSM6DSOX_PAGE_VALUE, Len, false);
+  BUS_PROFILE_RECORD(LSM6DSOX_PAGE_VALUE, Data, Len, Write, start);
+
+  return ret;
+}
+
+/**
+ * @brief  Get the LSM6DSOX timestamp enable status
+ * @param  Status Timestamp enable status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_Timestamp_Status(uint8_t *Status)
+{
+  if (lsm6dsox_timestamp_get(&reg_ctx, Status) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Set the LSM6DSOX timestamp enable status
+ * @param  Status Timestamp enable status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_Timestamp_Status(uint8_t Status)
+{
+  if (lsm6dsox_timestamp_set(&reg_ctx, Status) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Get the LSM6DSOX timestamp counter
+ * @param  Timestamp 32-bit counter value, in 25 us ticks
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_Timestamp_Raw(uint32_t *Timestamp)
+{
+  uint8_t data[4];
+
+  if (lsm6dsox_timestamp_raw_get(&reg_ctx, data) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  *Timestamp = ((uint32_t)data[3] << 24) | ((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0];
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Get the LSM6DSOX temperature sensor raw value
+ * @param  Value temperature in 1/256 degC steps from 25 degC
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Get_Temperature_Raw(int16_t *Value)
+{
+  uint8_t data[2];
+
+  if (lsm6dsox_temperature_raw_get(&reg_ctx, data) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  *Value = (int16_t)(((uint16_t)data[1] << 8) | data[0]);
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Set the LSM6DSOX FIFO timestamp decimation
+ * @param  Decimation FIFO timestamp decimation
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Timestamp_Decimation(uint8_t Decimation)
+{
+  LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
+
+  /* Verify that the passed parameter contains one of the valid values. */
+  switch ((lsm6dsox_odr_ts_batch_t)Decimation)
+  {
+    case LSM6DSOX_NO_DECIMATION:
+    case LSM6DSOX_DEC_1:
+    case LSM6DSOX_DEC_8:
+    case LSM6DSOX_DEC_32:
+      break;
+
+    default:
+      ret = LSM6DSOX_ERROR;
+      break;
+  }
+
+  if (ret == LSM6DSOX_ERROR)
+  {
+    return ret;
+  }
+
+  if (lsm6dsox_fifo_timestamp_decimation_set(&reg_ctx, (lsm6dsox_odr_ts_batch_t)Decimation) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return ret;
+}
+
+/**
+ * @brief  Set the LSM6DSOX FIFO compression initialization status
+ * @param  Status FIFO compression initialization status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Init(uint8_t Status)
+{
+  if (lsm6dsox_compression_algo_init_set(&reg_ctx, Status) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Set the LSM6DSOX FIFO compression enable status
+ * @param  Status FIFO compression enable status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Enable(uint8_t Status)
+{
+  lsm6dsox_emb_sens_t val;
+  if (lsm6dsox_embedded_sens_get(&reg_ctx, &val) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  val.fifo_compr = Status;
+
+  if (lsm6dsox_embedded_sens_set(&reg_ctx, &val) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Set the LSM6DSOX FIFO compression configuration and enable status
+ * @param  Compression FIFO compression and enable status
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Set(uint8_t Compression)
+{
+  LSM6DSOXStatusTypeDef ret = LSM6DSOX_OK;
+
+  /* Verify that the passed parameter contains one of the valid values. */
+  switch ((lsm6dsox_uncoptr_rate_t)Compression)
+  {
+    case LSM6DSOX_CMP_DISABLE:
+    case LSM6DSOX_CMP_ALWAYS:
+    case LSM6DSOX_CMP_8_TO_1:
+    case LSM6DSOX_CMP_16_TO_1:
+    case LSM6DSOX_CMP_32_TO_1:
+      break;
+
+    default:
+      ret = LSM6DSOX_ERROR;
+      break;
+  }
+
+
+  if (ret == LSM6DSOX_ERROR)
+  {
+    return ret;
+  }
+
+  if (lsm6dsox_compression_algo_set(&reg_ctx, (lsm6dsox_uncoptr_rate_t)Compression) != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  return ret;
+}
+
+/**
+ * @brief  Set the LSM6DSOX FIFO compression real time enable status
+ * @param  Status FIFO compression real time enable status
  * @retval 0 in case of success, an error code otherwise
  */
 LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Real_Time_Set(uint8_t Status)
@@ -3343,12 +4096,446 @@ LSM6DSOXStatusTypeDef LSM6DSOXSensor::Set_FIFO_Compression_Algo_Real_Time_Set(ui
   return LSM6DSOX_OK;
 }
 
+/* Register shadow cache -----------------------------------------------------*/
+
+#define REG_CACHE_USER      0U
+#define REG_CACHE_EMBEDDED  1U
+#define REG_CACHE_NONE      0xFFU
+
+/* Cache slot of the bank selected by a FUNC_CFG_ACCESS value. */
+static uint8_t reg_cache_bank_of(uint8_t func_cfg_access)
+{
+  switch (func_cfg_access >> 6)
+  {
+    case 0:  return REG_CACHE_USER;
+    case 2:  return REG_CACHE_EMBEDDED;
+    default: return REG_CACHE_NONE;   /* sensor hub: not cached */
+  }
+}
+
+/* First register and length of each cached block. Only configuration
+   registers the sensor never changes by itself are cached; status, output,
+   counter and self-clearing registers always go to the bus. */
+static const uint8_t reg_cache_user_blocks[][2] =
+{
+  { LSM6DSOX_FUNC_CFG_ACCESS, 2 },      /* FUNC_CFG_ACCESS, PIN_CTRL */
+  { LSM6DSOX_FIFO_CTRL1, 8 },           /* FIFO_CTRL1..INT2_CTRL */
+  { LSM6DSOX_CTRL1_XL, 10 },            /* CTRL1_XL..CTRL10_C */
+  { LSM6DSOX_TAP_CFG0, 10 },            /* TAP_CFG0..MD2_CFG */
+  { LSM6DSOX_X_OFS_USR, 3 },            /* X/Y/Z_OFS_USR */
+};
+
+static const uint8_t reg_cache_embedded_blocks[][2] =
+{
+  { LSM6DSOX_PAGE_SEL, 1 },
+  { LSM6DSOX_EMB_FUNC_EN_A, 2 },        /* EMB_FUNC_EN_A/B */
+  { LSM6DSOX_EMB_FUNC_INT1, 8 },        /* EMB_FUNC_INT1..MLC_INT2 */
+  { LSM6DSOX_PAGE_RW, 1 },
+  { LSM6DSOX_EMB_FUNC_FIFO_CFG, 1 },
+  { LSM6DSOX_FSM_ENABLE_A, 2 },         /* FSM_ENABLE_A/B */
+  { LSM6DSOX_EMB_FUNC_ODR_CFG_B, 2 },   /* EMB_FUNC_ODR_CFG_B/C */
+};
+
+#define REG_CACHE_BLOCKS(bank) \
+  (((bank) == REG_CACHE_USER) ? reg_cache_user_blocks : reg_cache_embedded_blocks)
+#define REG_CACHE_BLOCK_COUNT(bank) \
+  (((bank) == REG_CACHE_USER) ? sizeof(reg_cache_user_blocks) / 2U : sizeof(reg_cache_embedded_blocks) / 2U)
+
+static bool reg_cacheable(uint8_t bank, uint8_t reg)
+{
+  const uint8_t (*blocks)[2] = REG_CACHE_BLOCKS(bank);
+
+  for (uint8_t i = 0; i < REG_CACHE_BLOCK_COUNT(bank); i++)
+  {
+    if (reg >= blocks[i][0] && reg < blocks[i][0] + blocks[i][1])
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief  Serve a register read from the shadow cache
+ * @param  Reg first register
+ * @param  Data buffer to fill
+ * @param  Len number of registers
+ * @retval true if every register was cached and Data has been filled
+ */
+bool LSM6DSOXSensor::Cache_Read(uint8_t Reg, uint8_t *Data, uint16_t Len)
+{
+  if (!reg_cache_enabled || Reg + Len > 128U)
+  {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < Len; i++)
+  {
+    uint8_t reg = (uint8_t)(Reg + i);
+    /* FUNC_CFG_ACCESS is reachable from every bank */
+    uint8_t bank = (reg == LSM6DSOX_FUNC_CFG_ACCESS) ? REG_CACHE_USER : reg_cache_bank;
+
+    if (bank == REG_CACHE_NONE || reg >= 128U || !reg_cacheable(bank, reg) ||
+        !(reg_cache_valid[bank][reg >> 3] & (1U << (reg & 7U))))
+    {
+      return false;
+    }
+  }
+
+  for (uint16_t i = 0; i < Len; i++)
+  {
+    uint8_t reg = (uint8_t)(Reg + i);
+    uint8_t bank = (reg == LSM6DSOX_FUNC_CFG_ACCESS) ? REG_CACHE_USER : reg_cache_bank;
+    Data[i] = reg_cache[bank][reg];
+  }
+
+  return true;
+}
+
+/**
+ * @brief  Record registers read from or written to the sensor
+ * @param  Reg first register
+ * @param  Data register values
+ * @param  Len number of registers
+ * @param  Written true for a write, false for a read
+ */
+void LSM6DSOXSensor::Cache_Update(uint8_t Reg, const uint8_t *Data, uint16_t Len, bool Written)
+{
+  /* The selected bank is tracked whether or not the cache is enabled */
+  if (Reg <= LSM6DSOX_FUNC_CFG_ACCESS && Reg + Len > LSM6DSOX_FUNC_CFG_ACCESS)
+  {
+    bank_reg = bank_reg_hw = Data[LSM6DSOX_FUNC_CFG_ACCESS - Reg];
+    bank_reg_valid = 1U;
+  }
+  else if (Written && (!bank_reg_valid || (bank_reg_hw & 0xC0U) == 0U))
+  {
+    /* Full scale written behind Set_X_FS()/Set_G_FS(): read it again */
+    if (Reg <= LSM6DSOX_CTRL1_XL && Reg + Len > LSM6DSOX_CTRL1_XL)
+    {
+      acc_sensitivity = 0.0f;
+    }
+    if (Reg <= LSM6DSOX_CTRL2_G && Reg + Len > LSM6DSOX_CTRL2_G)
+    {
+      gyro_sensitivity = 0.0f;
+    }
+    if (Reg <= LSM6DSOX_CTRL3_C && Reg + Len > LSM6DSOX_CTRL3_C && (Data[LSM6DSOX_CTRL3_C - Reg] & 0x81U))
+    {
+      /* Reset or reboot selects the user bank and the default full scales */
+      bank_reg = bank_reg_hw = 0U;
+      bank_reg_valid = 1U;
+      acc_sensitivity = 0.0f;
+      gyro_sensitivity = 0.0f;
+    }
+  }
+
+  if (!reg_cache_enabled)
+  {
+    return;
+  }
+
+  /* A FIFO burst wraps within FIFO_DATA_OUT on the device; never let its
+   * length carry the address round into the configuration registers */
+  for (uint16_t i = 0; i < Len && Reg + i < 128U; i++)
+  {
+    uint8_t reg = (uint8_t)(Reg + i);
+    uint8_t value = Data[i];
+    uint8_t bank = (reg == LSM6DSOX_FUNC_CFG_ACCESS) ? REG_CACHE_USER : reg_cache_bank;
+
+    if (bank == REG_CACHE_NONE || reg >= 128U || !reg_cacheable(bank, reg))
+    {
+      continue;
+    }
+
+    if (Written && bank == REG_CACHE_USER)
+    {
+      if (reg == LSM6DSOX_CTRL3_C && (value & 0x81U))
+      {
+        /* Software reset or reboot: registers go back to their defaults */
+        memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+        reg_cache_bank = REG_CACHE_USER;
+        return;
+      }
+      if (reg == LSM6DSOX_COUNTER_BDR_REG1)
+      {
+        value &= (uint8_t)~0x40U;   /* rst_counter_bdr clears itself */
+      }
+    }
+
+    reg_cache[bank][reg] = value;
+    reg_cache_valid[bank][reg >> 3] |= (uint8_t)(1U << (reg & 7U));
+
+    if (reg == LSM6DSOX_FUNC_CFG_ACCESS)
+    {
+      reg_cache_bank = reg_cache_bank_of(value);
+    }
+  }
+}
+
+/**
+ * @brief  Enable the register shadow cache
+ * @note   Configuration register reads are then served from a local copy, so
+ *         getters cost no bus traffic and setters a single write. All register
+ *         access must go through this driver while the cache is enabled.
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Enable_Register_Cache()
+{
+  reg_cache_enabled = 1U;
+
+  if (Resync_Register_Cache() != LSM6DSOX_OK)
+  {
+    reg_cache_enabled = 0U;
+    return LSM6DSOX_ERROR;
+  }
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Disable the register shadow cache
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Disable_Register_Cache()
+{
+  reg_cache_enabled = 0U;
+  memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Reload the register shadow cache from the sensor
+ * @note   Reads every cached register of the user and embedded functions
+ *         banks and leaves the sensor in the bank it was in.
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Resync_Register_Cache()
+{
+  uint8_t func_cfg_access;
+  uint8_t bank_sel;
+
+  if (!reg_cache_enabled)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+
+  Bus_Session_Begin();
+
+  if (Bank_Flush() != 0 || IO_Read(&func_cfg_access, LSM6DSOX_FUNC_CFG_ACCESS, 1) != 0)
+  {
+    Bus_Session_End();
+    return LSM6DSOX_ERROR;
+  }
+
+  /* The bank is switched behind the tracking until restored below */
+  bank_reg_valid = 0U;
+
+  for (uint8_t bank = REG_CACHE_USER; bank <= REG_CACHE_EMBEDDED; bank++)
+  {
+    const uint8_t (*blocks)[2] = REG_CACHE_BLOCKS(bank);
+
+    bank_sel = (uint8_t)((func_cfg_access & 0x3FU) | ((bank == REG_CACHE_EMBEDDED) ? 0x80U : 0x00U));
+    if (IO_Write(&bank_sel, LSM6DSOX_FUNC_CFG_ACCESS, 1) != 0)
+    {
+      memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+      Bus_Session_End();
+      return LSM6DSOX_ERROR;
+    }
+
+    for (uint8_t i = 0; i < REG_CACHE_BLOCK_COUNT(bank); i++)
+    {
+      uint8_t reg = blocks[i][0];
+      uint8_t len = blocks[i][1];
+
+      if (reg == LSM6DSOX_FUNC_CFG_ACCESS)
+      {
+        reg++;
+        len--;
+      }
+      if (IO_Read(&reg_cache[bank][reg], reg, len) != 0)
+      {
+        memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+        Bus_Session_End();
+        return LSM6DSOX_ERROR;
+      }
+      for (uint8_t r = reg; r < reg + len; r++)
+      {
+        reg_cache_valid[bank][r >> 3] |= (uint8_t)(1U << (r & 7U));
+      }
+    }
+  }
+
+  /* Back to the bank the sensor was in */
+  if (IO_Write(&func_cfg_access, LSM6DSOX_FUNC_CFG_ACCESS, 1) != 0)
+  {
+    memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+    Bus_Session_End();
+    return LSM6DSOX_ERROR;
+  }
+  Cache_Update(LSM6DSOX_FUNC_CFG_ACCESS, &func_cfg_access, 1, true);
+
+  Bus_Session_End();
+
+  return LSM6DSOX_OK;
+}
+
+/**
+ * @brief  Check the register shadow cache against the sensor
+ * @param  Mismatches number of cached registers that differed from the
+ *         sensor; the cache is resynchronised in any case
+ * @retval 0 in case of success, an error code otherwise
+ */
+LSM6DSOXStatusTypeDef LSM6DSOXSensor::Verify_Register_Cache(uint8_t *Mismatches)
+{
+  uint8_t cache[2][128];
+  uint8_t valid[2][16];
+  uint8_t count = 0;
+
+  memcpy(cache, reg_cache, sizeof(cache));
+  memcpy(valid, reg_cache_valid, sizeof(valid));
+
+  if (Resync_Register_Cache() != LSM6DSOX_OK)
+  {
+    return LSM6DSOX_ERROR;
+  }
+
+  for (uint8_t bank = REG_CACHE_USER; bank <= REG_CACHE_EMBEDDED; bank++)
+  {
+    for (uint8_t reg = 0; reg < 128U; reg++)
+    {
+      uint8_t bit = (uint8_t)(1U << (reg & 7U));
+      if ((valid[bank][reg >> 3] & bit) && (reg_cache_valid[bank][reg >> 3] & bit) &&
+          cache[bank][reg] != reg_cache[bank][reg] && count < 0xFFU)
+      {
+        count++;
+      }
+    }
+  }
+
+  *Mismatches = count;
+
+  return LSM6DSOX_OK;
+}
+
+/* Memory bank tracking -----------------------------------------------------*/
+
+/**
+ * @brief  Serve a read of FUNC_CFG_ACCESS from the tracked value
+ * @param  Reg first register
+ * @param  Data buffer to fill
+ * @param  Len number of registers
+ * @retval true if Data has been filled
+ */
+bool LSM6DSOXSensor::Bank_Read(uint8_t Reg, uint8_t *Data, uint16_t Len)
+{
+  if (Reg != LSM6DSOX_FUNC_CFG_ACCESS || Len != 1U || !bank_reg_valid)
+  {
+    return false;
+  }
+
+  Data[0] = bank_reg;
+  return true;
+}
+
+/**
+ * @brief  Absorb a write of FUNC_CFG_ACCESS that needs no bus transfer
+ * @note   A write of the value the sensor already holds is dropped; inside an
+ *         embedded bank session the write is deferred until Bank_Flush().
+ * @param  Reg first register
+ * @param  Data register values
+ * @param  Len number of registers
+ * @retval true if the write has been absorbed
+ */
+bool LSM6DSOXSensor::Bank_Write(uint8_t Reg, const uint8_t *Data, uint16_t Len)
+{
+  if (Reg != LSM6DSOX_FUNC_CFG_ACCESS || Len != 1U || !bank_reg_valid)
+  {
+    return false;
+  }
+
+  if (bank_session == 0U && Data[0] != bank_reg_hw)
+  {
+    return false;
+  }
+
+  bank_reg = Data[0];
+  return true;
+}
+
+/**
+ * @brief  Perform a deferred memory bank switch
+ * @retval 0 in case of success, an error code otherwise
+ */
+int32_t LSM6DSOXSensor::Bank_Flush()
+{
+  if (!bank_reg_valid || bank_reg == bank_reg_hw)
+  {
+    return 0;
+  }
+
+  uint8_t value = bank_reg;
+
+  BUS_PROFILE_TIME(start);
+  int32_t ret = IO_Write(&value, LSM6DSOX_FUNC_CFG_ACCESS, 1);
+  BUS_PROFILE_RECORD(LSM6DSOX_FUNC_CFG_ACCESS, &value, 1, true, start);
+
+  if (ret == 0)
+  {
+    Cache_Update(LSM6DSOX_FUNC_CFG_ACCESS, &value, 1, true);
+  }
+  return ret;
+}
+
 int32_t LSM6DSOX_io_write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite)
 {
-  return ((LSM6DSOXSensor *)handle)->IO_Write(pBuffer, WriteAddr, nBytesToWrite);
+  LSM6DSOXSensor *sensor = (LSM6DSOXSensor *)handle;
+
+  if (sensor->Bank_Write(WriteAddr, pBuffer, nBytesToWrite))
+  {
+    return 0;
+  }
+  if (sensor->Bank_Flush() != 0)
+  {
+    return 1;
+  }
+
+  BUS_PROFILE_TIME(start);
+  int32_t ret = sensor->IO_Write(pBuffer, WriteAddr, nBytesToWrite);
+  BUS_PROFILE_RECORD(WriteAddr, pBuffer, nBytesToWrite, true, start);
+
+  if (ret == 0)
+  {
+    sensor->Cache_Update(WriteAddr, pBuffer, nBytesToWrite, true);
+  }
+  return ret;
 }
 
 int32_t LSM6DSOX_io_read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead)
 {
-  return ((LSM6DSOXSensor *)handle)->IO_Read(pBuffer, ReadAddr, nBytesToRead);
+  LSM6DSOXSensor *sensor = (LSM6DSOXSensor *)handle;
+
+  if (sensor->Bank_Read(ReadAddr, pBuffer, nBytesToRead))
+  {
+    return 0;
+  }
+  if (sensor->Bank_Flush() != 0)
+  {
+    return 1;
+  }
+  if (sensor->Cache_Read(ReadAddr, pBuffer, nBytesToRead))
+  {
+    return 0;
+  }
+
+  BUS_PROFILE_TIME(start);
+  int32_t ret = sensor->IO_Read(pBuffer, ReadAddr, nBytesToRead);
+  BUS_PROFILE_RECORD(ReadAddr, pBuffer, nBytesToRead, false, start);
+
+  if (ret == 0)
+  {
+    sensor->Cache_Update(ReadAddr, pBuffer, nBytesToRead, false);
+  }
+  return ret;
 }
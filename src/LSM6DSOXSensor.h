@@ -48,6 +48,7 @@
 #include "Wire.h"
 #include "SPI.h"
 #include "lsm6dsox_reg.h"
+#include "LSM6DSOXAsync.h"
 
 /* Defines -------------------------------------------------------------------*/
 /* For compatibility with ESP32 platforms */
@@ -68,6 +69,36 @@
 #define LSM6DSOX_GYRO_SENSITIVITY_FS_1000DPS  35.000f
 #define LSM6DSOX_GYRO_SENSITIVITY_FS_2000DPS  70.000f
 
+/* Highest SPI clock the LSM6DSOX supports. */
+#define LSM6DSOX_SPI_MAX_SPEED 10000000
+
+/* Bytes per block transfer when writing over SPI. */
+#define LSM6DSOX_SPI_BLOCK_SIZE 32
+
+/* Largest I2C transfer, register address included. Defaults to the Wire
+   buffer size; longer reads and writes are split into several transfers. */
+#ifndef LSM6DSOX_I2C_CHUNK_SIZE
+#ifdef BUFFER_LENGTH
+#define LSM6DSOX_I2C_CHUNK_SIZE BUFFER_LENGTH
+#else
+#define LSM6DSOX_I2C_CHUNK_SIZE 32
+#endif
+#endif
+
+/* Most PAGE_VALUE bytes sent or read back in one burst when loading an
+   MLC/FSM program. One I2C transfer by default; a longer burst goes out as
+   several, each restarting at PAGE_VALUE. */
+#ifndef LSM6DSOX_UCF_BURST_SIZE
+#define LSM6DSOX_UCF_BURST_SIZE (LSM6DSOX_I2C_CHUNK_SIZE - 1)
+#endif
+
+/* FIFO_STATUS2 flags returned by Get_FIFO_Status() */
+#define LSM6DSOX_FIFO_FLAG_OVR_LATCHED  0x08U
+#define LSM6DSOX_FIFO_FLAG_COUNTER_BDR  0x10U
+#define LSM6DSOX_FIFO_FLAG_FULL         0x20U
+#define LSM6DSOX_FIFO_FLAG_OVR          0x40U
+#define LSM6DSOX_FIFO_FLAG_WTM          0x80U
+
 
 /* Typedefs ------------------------------------------------------------------*/
 
@@ -156,6 +187,16 @@ class LSM6DSOXSensor
     LSM6DSOXStatusTypeDef Get_G_AxesRaw(int16_t *Value);
     LSM6DSOXStatusTypeDef Get_G_Axes(int32_t *AngularRate);
     
+    LSM6DSOXStatusTypeDef Enable_Register_Cache();
+    LSM6DSOXStatusTypeDef Disable_Register_Cache();
+    LSM6DSOXStatusTypeDef Resync_Register_Cache();
+    LSM6DSOXStatusTypeDef Verify_Register_Cache(uint8_t *Mismatches);
+
+    LSM6DSOXStatusTypeDef Bus_Session_Begin();
+    LSM6DSOXStatusTypeDef Bus_Session_End();
+    LSM6DSOXStatusTypeDef Embedded_Bank_Session_Begin();
+    LSM6DSOXStatusTypeDef Embedded_Bank_Session_End();
+
     LSM6DSOXStatusTypeDef Read_Reg(uint8_t reg, uint8_t *Data);
     LSM6DSOXStatusTypeDef Write_Reg(uint8_t reg, uint8_t Data);
     LSM6DSOXStatusTypeDef Set_Interrupt_Latch(uint8_t Status);
@@ -205,6 +246,7 @@ class LSM6DSOXSensor
     LSM6DSOXStatusTypeDef Set_G_SelfTest(uint8_t Status);
     
     LSM6DSOXStatusTypeDef Get_FIFO_Num_Samples(uint16_t *NumSamples);
+    LSM6DSOXStatusTypeDef Get_FIFO_Status(uint16_t *NumSamples, uint8_t *Flags);
     LSM6DSOXStatusTypeDef Get_FIFO_Full_Status(uint8_t *Status);
     LSM6DSOXStatusTypeDef Get_FIFO_Overrun_Status(uint8_t *Status);
     LSM6DSOXStatusTypeDef Get_FIFO_Watermark_Status(uint8_t *Status);
@@ -214,22 +256,40 @@ class LSM6DSOXSensor
     LSM6DSOXStatusTypeDef Set_FIFO_INT2_FIFO_Full(uint8_t Status);
     LSM6DSOXStatusTypeDef Set_FIFO_INT2_FIFO_Overrun(uint8_t Status);
     LSM6DSOXStatusTypeDef Set_FIFO_INT2_FIFO_Threshold(uint8_t Status);
+    LSM6DSOXStatusTypeDef Set_FIFO_INT1_Batch_Counter(uint8_t Status);
+    LSM6DSOXStatusTypeDef Set_FIFO_Batch_Counter_Event(uint8_t Event);
+    LSM6DSOXStatusTypeDef Set_FIFO_Batch_Counter_Threshold(uint16_t Threshold);
+    LSM6DSOXStatusTypeDef Reset_FIFO_Batch_Counter();
     LSM6DSOXStatusTypeDef Set_FIFO_Watermark_Level(uint16_t Watermark);
     LSM6DSOXStatusTypeDef Set_FIFO_Stop_On_Fth(uint8_t Status);
     LSM6DSOXStatusTypeDef Set_FIFO_Mode(uint8_t Mode);
     LSM6DSOXStatusTypeDef Get_FIFO_Tag(uint8_t *Tag);
     LSM6DSOXStatusTypeDef Get_FIFO_Data(uint8_t *Data);
-    LSM6DSOXStatusTypeDef Get_FIFO_Sample(uint8_t *Sample, uint16_t Count = 1);
+    LSM6DSOXStatusTypeDef Get_FIFO_Sample(uint8_t *Sample, uint16_t Count = 1, uint16_t *Received = NULL);
     LSM6DSOXStatusTypeDef Get_FIFO_X_Axes(int32_t *Acceleration);
     LSM6DSOXStatusTypeDef Set_FIFO_X_BDR(float Bdr);
+    LSM6DSOXStatusTypeDef Get_FIFO_X_BDR(float *Bdr);
     LSM6DSOXStatusTypeDef Get_FIFO_G_Axes(int32_t *AngularVelocity);
     LSM6DSOXStatusTypeDef Set_FIFO_G_BDR(float Bdr);
+    LSM6DSOXStatusTypeDef Get_FIFO_G_BDR(float *Bdr);
+    LSM6DSOXStatusTypeDef Set_FIFO_T_BDR(float Bdr);
+    LSM6DSOXStatusTypeDef Convert_FIFO_X_Axes(const uint8_t *Sample, uint16_t Count, int32_t *Acceleration, uint16_t *Converted);
+    LSM6DSOXStatusTypeDef Convert_FIFO_G_Axes(const uint8_t *Sample, uint16_t Count, int32_t *AngularVelocity, uint16_t *Converted);
+
+    LSM6DSOXStatusTypeDef Read_Async(uint8_t Reg, uint8_t *Data, uint16_t Len, LSM6DSOX_AsyncCallback_t Callback, void *Arg);
+    LSM6DSOXStatusTypeDef Get_FIFO_Sample_Async(uint8_t *Sample, uint16_t Count, LSM6DSOX_AsyncCallback_t Callback, void *Arg);
+    uint8_t Async_Pending();
+    void Async_Service();
 
     LSM6DSOXStatusTypeDef Get_MLC_Status(LSM6DSOX_MLC_Status_t *Status);
     LSM6DSOXStatusTypeDef Get_MLC_Output(uint8_t *Output);
+    LSM6DSOXStatusTypeDef Load_MLC_Program(const ucf_line_t *Program, uint32_t Lines, uint32_t *Loaded = NULL, uint16_t *Checksum = NULL, bool Verify = false);
     
     LSM6DSOXStatusTypeDef Get_Timestamp_Status(uint8_t *Status);
     LSM6DSOXStatusTypeDef Set_Timestamp_Status(uint8_t Status);
+    LSM6DSOXStatusTypeDef Get_Timestamp_Raw(uint32_t *Timestamp);
+
+    LSM6DSOXStatusTypeDef Get_Temperature_Raw(int16_t *Value);
 
     LSM6DSOXStatusTypeDef Set_FIFO_Timestamp_Decimation(uint8_t Decimation);
 
@@ -246,40 +306,82 @@ class LSM6DSOXSensor
      * @param  pBuffer: pointer to data to be read.
      * @param  RegisterAddr: specifies internal address register to be read.
      * @param  NumByteToRead: number of bytes to be read.
+     * @param  Increment: false when register auto-increment (IF_INC) is off,
+     *         so every transfer restarts at RegisterAddr.
      * @retval 0 if ok, an error code otherwise.
      */
-    uint8_t IO_Read(uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToRead)
+    uint8_t IO_Read(uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToRead, bool Increment = true)
     {        
+      io_last_count = 0;
+
+      /* Let background transfers finish before using the bus. */
+      async_queue.wait_idle();
+
       if (dev_spi) {
-        dev_spi->beginTransaction(SPISettings(spi_speed, MSBFIRST, SPI_MODE3));
+        if (!spi_session) {
+          dev_spi->beginTransaction(SPISettings(spi_speed, MSBFIRST, SPI_MODE3));
+        }
 
         digitalWrite(cs_pin, LOW);
 
         /* Write Reg Address */
         dev_spi->transfer(RegisterAddr | 0x80);
-        /* Read the data */
-        for (uint16_t i=0; i<NumByteToRead; i++) {
-          *(pBuffer+i) = dev_spi->transfer(0x00);
-        }
+        /* Read the data in one block transfer */
+        memset(pBuffer, 0x00, NumByteToRead);
+        dev_spi->transfer(pBuffer, NumByteToRead);
          
         digitalWrite(cs_pin, HIGH);
 
-        dev_spi->endTransaction();
+        if (!spi_session) {
+          dev_spi->endTransaction();
+        }
 
+        io_last_count = NumByteToRead;
         return 0;
       }
 		
       if (dev_i2c) {
-        dev_i2c->beginTransmission(((uint8_t)(((address) >> 1) & 0x7F)));
-        dev_i2c->write(RegisterAddr);
-        dev_i2c->endTransmission(false);
-
-        dev_i2c->requestFrom(((uint8_t)(((address) >> 1) & 0x7F)), (uint8_t) NumByteToRead);
-
-        int i=0;
-        while (dev_i2c->available()) {
-          pBuffer[i] = dev_i2c->read();
-          i++;
+        /* Split the read into transfers that fit the Wire buffer. Reads of the
+           FIFO output registers use whole 7-byte words per transfer, each one
+           restarting at the tag register. */
+        bool fifo = (RegisterAddr >= LSM6DSOX_FIFO_DATA_OUT_TAG) && (RegisterAddr <= LSM6DSOX_FIFO_DATA_OUT_Z_H);
+        uint16_t chunk = fifo ? (LSM6DSOX_I2C_CHUNK_SIZE / 7) * 7 : LSM6DSOX_I2C_CHUNK_SIZE;
+        uint16_t offset = 0;
+
+        while (offset < NumByteToRead) {
+          uint16_t len = NumByteToRead - offset;
+          if (len > chunk) {
+            len = chunk;
+          }
+
+          uint8_t reg = RegisterAddr;
+          if (fifo) {
+            reg = (uint8_t)(LSM6DSOX_FIFO_DATA_OUT_TAG + (RegisterAddr - LSM6DSOX_FIFO_DATA_OUT_TAG + offset) % 7);
+          } else if (Increment) {
+            reg = (uint8_t)(RegisterAddr + offset);
+          }
+
+          dev_i2c->beginTransmission(((uint8_t)(((address) >> 1) & 0x7F)));
+          dev_i2c->write(reg);
+          if (dev_i2c->endTransmission(false) != 0) {
+            return 1;
+          }
+
+          uint8_t received = dev_i2c->requestFrom(((uint8_t)(((address) >> 1) & 0x7F)), (uint8_t) len);
+
+          uint16_t i = 0;
+          while (dev_i2c->available() && i < len) {
+            pBuffer[offset + i] = dev_i2c->read();
+            i++;
+          }
+
+          offset += i;
+          io_last_count = offset;
+
+          /* Short read: report it instead of returning stale buffer contents. */
+          if (received < len || i < len) {
+            return 2;
+          }
         }
 
         return 0;
@@ -287,44 +389,83 @@ class LSM6DSOXSensor
 
       return 1;
     }
+
+    /**
+     * @brief  Number of bytes transferred by the last IO_Read.
+     * @retval Byte count, lower than requested after a short read.
+     */
+    uint16_t IO_Last_Read_Count()
+    {
+      return io_last_count;
+    }
     
     /**
      * @brief Utility function to write data.
      * @param  pBuffer: pointer to data to be written.
      * @param  RegisterAddr: specifies internal address register to be written.
      * @param  NumByteToWrite: number of bytes to write.
+     * @param  Increment: false when register auto-increment (IF_INC) is off,
+     *         so every transfer restarts at RegisterAddr.
      * @retval 0 if ok, an error code otherwise.
      */
-    uint8_t IO_Write(uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+    uint8_t IO_Write(uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToWrite, bool Increment = true)
     {  
+      async_queue.wait_idle();
+
       if (dev_spi) {
-        dev_spi->beginTransaction(SPISettings(spi_speed, MSBFIRST, SPI_MODE3));
+        if (!spi_session) {
+          dev_spi->beginTransaction(SPISettings(spi_speed, MSBFIRST, SPI_MODE3));
+        }
 
         digitalWrite(cs_pin, LOW);
 
-        /* Write Reg Address */
-        dev_spi->transfer(RegisterAddr);
-        /* Write the data */
-        for (uint16_t i=0; i<NumByteToWrite; i++) {
-          dev_spi->transfer(pBuffer[i]);
-        }
+        /* Write Reg Address and data in one block transfer; transfer() 
+           overwrites the buffer with what comes back, so send a copy. */
+        uint8_t frame[LSM6DSOX_SPI_BLOCK_SIZE];
+        uint16_t offset = 0;
+        uint16_t len = 0;
+
+        frame[len++] = RegisterAddr;
+        do {
+          while (offset < NumByteToWrite && len < LSM6DSOX_SPI_BLOCK_SIZE) {
+            frame[len++] = pBuffer[offset++];
+          }
+          dev_spi->transfer(frame, len);
+          len = 0;
+        } while (offset < NumByteToWrite);
 
         digitalWrite(cs_pin, HIGH);
 
-        dev_spi->endTransaction();
+        if (!spi_session) {
+          dev_spi->endTransaction();
+        }
 
         return 0;                    
       }
   
       if (dev_i2c) {
-        dev_i2c->beginTransmission(((uint8_t)(((address) >> 1) & 0x7F)));
+        /* The register address takes one byte of the Wire buffer. */
+        uint16_t offset = 0;
 
-        dev_i2c->write(RegisterAddr);
-        for (uint16_t i = 0 ; i < NumByteToWrite ; i++) {
-          dev_i2c->write(pBuffer[i]);
-        }
+        do {
+          uint16_t len = NumByteToWrite - offset;
+          if (len > LSM6DSOX_I2C_CHUNK_SIZE - 1) {
+            len = LSM6DSOX_I2C_CHUNK_SIZE - 1;
+          }
+
+          dev_i2c->beginTransmission(((uint8_t)(((address) >> 1) & 0x7F)));
+
+          dev_i2c->write(Increment ? (uint8_t)(RegisterAddr + offset) : RegisterAddr);
+          for (uint16_t i = 0 ; i < len ; i++) {
+            dev_i2c->write(pBuffer[offset + i]);
+          }
+
+          if (dev_i2c->endTransmission(true) != 0) {
+            return 1;
+          }
 
-        dev_i2c->endTransmission(true);
+          offset += len;
+        } while (offset < NumByteToWrite);
 
         return 0;
       }
@@ -332,10 +473,20 @@ class LSM6DSOXSensor
       return 1;
     }
 
+    /* Register shadow cache hooks, used by LSM6DSOX_io_read/io_write. */
+    bool Cache_Read(uint8_t Reg, uint8_t *Data, uint16_t Len);
+    void Cache_Update(uint8_t Reg, const uint8_t *Data, uint16_t Len, bool Written);
+
+    /* Memory bank tracking hooks, used by LSM6DSOX_io_read/io_write. */
+    bool Bank_Read(uint8_t Reg, uint8_t *Data, uint16_t Len);
+    bool Bank_Write(uint8_t Reg, const uint8_t *Data, uint16_t Len);
+    int32_t Bank_Flush();
+
   private:
   
     LSM6DSOXStatusTypeDef Set_X_ODR_When_Enabled(float Odr);
     LSM6DSOXStatusTypeDef Set_X_ODR_When_Disabled(float Odr);
+    int32_t Page_Value_Burst(uint8_t *Data, uint16_t Len, bool Write);
     LSM6DSOXStatusTypeDef Set_G_ODR_When_Enabled(float Odr);
     LSM6DSOXStatusTypeDef Set_G_ODR_When_Disabled(float Odr);
   
@@ -349,15 +500,37 @@ class LSM6DSOXSensor
     uint8_t address;
     int cs_pin;
     uint32_t spi_speed;
+    uint8_t spi_session;
+    uint16_t io_last_count;
     
     lsm6dsox_odr_xl_t acc_odr;
     lsm6dsox_odr_g_t gyro_odr;
     
     uint8_t acc_is_enabled;
     uint8_t gyro_is_enabled;
+
+    /* Sensitivity of the current full scale, 0 when unknown. */
+    float acc_sensitivity;
+    float gyro_sensitivity;
     
     
     lsm6dsox_ctx_t reg_ctx;
+
+    /* Shadow copy of the configuration registers: [0] user bank,
+       [1] embedded functions bank. */
+    uint8_t reg_cache_enabled;
+    uint8_t reg_cache_bank;
+    uint8_t reg_cache[2][128];
+    uint8_t reg_cache_valid[2][16];
+
+    /* FUNC_CFG_ACCESS as last set by the driver and as held by the sensor;
+       they differ only while an embedded bank session defers a switch. */
+    uint8_t bank_reg;
+    uint8_t bank_reg_hw;
+    uint8_t bank_reg_valid;
+    uint8_t bank_session;
+
+    LSM6DSOXAsyncQueue async_queue;
     
 };
 
@@ -0,0 +1,66 @@
+#include "NoteBinary.h"
+
+extern Notecard notecard;
+
+// note-c COBS-encodes in place and needs this much room per chunk
+static uint8_t staging[NOTE_BINARY_CHUNK + NOTE_BINARY_CHUNK / 254 + 2];
+static uint32_t appended = 0;
+static bool open = false;
+
+bool noteBinaryBegin(uint32_t size) {
+  open = false;
+  appended = 0;
+
+  J *rsp = notecard.requestAndResponse(notecard.newRequest("card.binary"));
+  if (rsp == NULL) return false;
+  bool ok = !JIsPresent(rsp, "err") && JIsPresent(rsp, "max") && JGetNumber(rsp, "max") >= size;
+  notecard.deleteResponse(rsp);
+  if (!ok) return false;
+
+  const char *err = NoteBinaryStoreReset();
+  if (err) {
+    Serial.print("card.binary reset failed: ");
+    Serial.println(err);
+    return false;
+  }
+  open = true;
+  return true;
+}
+
+bool noteBinaryAppend(const void *data, uint32_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+
+  while (open && len > 0) {
+    uint32_t n = (len > NOTE_BINARY_CHUNK) ? NOTE_BINARY_CHUNK : len;
+    memcpy(staging, p, n);
+    const char *err = NoteBinaryStoreTransmit(staging, n, sizeof(staging), appended);
+    if (err) {
+      Serial.print("card.binary.put failed: ");
+      Serial.println(err);
+      NoteBinaryStoreReset();
+      open = false;
+      return false;
+    }
+    appended += n;
+    p += n;
+    len -= n;
+  }
+  return open;
+}
+
+uint32_t noteBinaryLength() {
+  return appended;
+}
+
+bool noteBinaryAdd(J *req) {
+  if (!open) {
+    JDelete(req);
+    return false;
+  }
+  open = false;
+
+  // The Notecard sends binary notes straight on rather than queueing them
+  JAddBoolToObject(req, "binary", true);
+  JAddBoolToObject(req, "live", true);
+  return notecard.sendRequest(req);
+}
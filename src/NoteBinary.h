@@ -0,0 +1,39 @@
+#ifndef NOTE_BINARY_H
+#define NOTE_BINARY_H
+
+// Bulk uploads through the Notecard's binary buffer.
+//
+// A note with a binary payload is built in three steps:
+//   noteBinaryBegin()    card.binary: check the Notecard supports binary
+//                        transfers and has room, and empty its buffer
+//   noteBinaryAppend()   copy the bytes, a chunk at a time, into a staging
+//                        buffer and send each with card.binary.put (COBS
+//                        framed by note-c, about 0.4% overhead)
+//   noteBinaryAdd()      note.add the metadata with "binary":true; the
+//                        Notecard attaches the buffer as the note's payload
+// Against base64 inside the JSON body this sends a quarter fewer bytes over
+// the serial link, and neither side holds the payload as a JSON string: the
+// MCU needs only the staging buffer, no heap for the encoded copy.
+//
+// Notecard firmware without binary support fails noteBinaryBegin(); the
+// callers then fall back to base64 in the note body.
+
+#include <Arduino.h>
+#include <Notecard.h>
+
+#define NOTE_BINARY_CHUNK 512   // Bytes per card.binary.put
+
+// Start a binary payload of up to size bytes; false if the Notecard cannot
+// take it (older firmware, buffer too small)
+bool noteBinaryBegin(uint32_t size);
+
+// Append len bytes; false on a transfer error, which abandons the payload
+bool noteBinaryAppend(const void *data, uint32_t len);
+
+// Bytes appended since noteBinaryBegin()
+uint32_t noteBinaryLength();
+
+// Send req (a note.add) with the payload attached; takes ownership of req
+bool noteBinaryAdd(J *req);
+
+#endif // NOTE_BINARY_H
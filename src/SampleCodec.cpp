@@ -0,0 +1,94 @@
+#include "SampleCodec.h"
+
+static inline int16_t readAxis(const uint8_t *p) {
+  return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t zigzag(int32_t d) {
+  return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static inline size_t varintSize(uint32_t v) {
+  return (v < 0x80) ? 1 : (v < 0x4000) ? 2 : 3;
+}
+
+size_t sampleCodecMeasure(const uint8_t *records, uint16_t count, size_t *lead) {
+  int16_t prev[3] = {0, 0, 0};
+  size_t size = 0;
+  size_t ahead = 0;
+
+  for (uint16_t i = 0; i < count; i++) {
+    const uint8_t *rec = &records[i * 6];
+    for (int a = 0; a < 3; a++) {
+      int16_t v = readAxis(&rec[a * 2]);
+      size += varintSize(zigzag((int32_t)v - prev[a]));
+      prev[a] = v;
+    }
+    // Record i is read whole before its bytes are written
+    size_t read = (size_t)(i + 1) * 6;
+    if (size > read && size - read > ahead) ahead = size - read;
+  }
+
+  if (lead) *lead = ahead;
+  return size;
+}
+
+size_t sampleCodecEncode(const uint8_t *records, uint16_t count, uint8_t *out) {
+  int16_t prev[3] = {0, 0, 0};
+  size_t n = 0;
+
+  for (uint16_t i = 0; i < count; i++) {
+    const uint8_t *rec = &records[i * 6];
+    int16_t v[3] = { readAxis(&rec[0]), readAxis(&rec[2]), readAxis(&rec[4]) };
+
+    for (int a = 0; a < 3; a++) {
+      uint32_t z = zigzag((int32_t)v[a] - prev[a]);
+      prev[a] = v[a];
+      while (z >= 0x80) {
+        out[n++] = (uint8_t)(z | 0x80);
+        z >>= 7;
+      }
+      out[n++] = (uint8_t)z;
+    }
+  }
+
+  return n;
+}
+
+uint16_t sampleCodecDecode(const uint8_t *in, size_t len, int16_t (*xyz)[3], uint16_t count,
+                           size_t *used) {
+  int32_t prev[3] = {0, 0, 0};
+  size_t n = 0;
+  uint16_t i;
+
+  for (i = 0; i < count; i++) {
+    size_t m = n;
+    int32_t v[3];
+    int a;
+    for (a = 0; a < 3; a++) {
+      uint32_t z = 0;
+      int shift = 0;
+      bool done = false;
+      while (m < len && shift < 21 && !done) {
+        uint8_t b = in[m++];
+        z |= (uint32_t)(b & 0x7F) << shift;
+        shift += 7;
+        done = !(b & 0x80);
+      }
+      // Out of input, a fourth byte, or a step no pair of int16 values has
+      if (!done || z > 0x1FFFF) break;
+      v[a] = prev[a] + (int32_t)((z >> 1) ^ (0U - (z & 1)));
+      if (v[a] < -32768 || v[a] > 32767) break;
+    }
+    if (a < 3) break;
+
+    for (a = 0; a < 3; a++) {
+      prev[a] = v[a];
+      xyz[i][a] = (int16_t)v[a];
+    }
+    n = m;
+  }
+
+  if (used) *used = n;
+  return i;
+}
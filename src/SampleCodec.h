@@ -0,0 +1,40 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+// Lossless delta codec for 3-axis int16 sample records (sensors.qo format 3).
+//
+// Records are read in wire format (x,y,z int16 little-endian, 6 bytes).
+// Each axis is coded as the difference from the same axis of the record
+// before it (0 for the first), zigzag-mapped to an unsigned value
+// ((d << 1) ^ (d >> 31)) and written as a LEB128 varint: 7 bits per byte,
+// low bits first, the top bit set on every byte but the last. Differences
+// within +/-63 counts take one byte, within +/-8191 two, anything else
+// three, so a record costs 3 to 9 bytes against 6 raw.
+//
+// A stream is one or more runs of records, each starting again from
+// zero: format 3 sends the accelerometer records, then the gyroscope
+// records, in one stream.
+//
+// The encoder may work in place, its output in the same buffer as its
+// input but ahead of it, as long as the output never catches up with the
+// input still to be read; sampleCodecMeasure() gives the size and how far
+// ahead the output must start for that.
+
+#include <Arduino.h>
+
+#define SAMPLE_CODEC_MAX_RECORD 9   // Encoded bytes per record, worst case
+
+// Encoded size of count records. *lead receives the largest amount by
+// which the output gets ahead of the input (0 if it never does).
+size_t sampleCodecMeasure(const uint8_t *records, uint16_t count, size_t *lead);
+
+// Encode count records; returns the bytes written.
+size_t sampleCodecEncode(const uint8_t *records, uint16_t count, uint8_t *out);
+
+// Decode up to count records from len bytes into xyz triples. Returns the
+// records decoded, with *used set to the bytes they took; fewer than count
+// when the input runs out or holds a malformed varint.
+uint16_t sampleCodecDecode(const uint8_t *in, size_t len, int16_t (*xyz)[3], uint16_t count,
+                           size_t *used);
+
+#endif // SAMPLE_CODEC_H
@@ -0,0 +1,592 @@
+#include "SpillQueue.h"
+#include "NoteBinary.h"
+
+#include <stddef.h>
+
+extern Notecard notecard;
+
+// Flash back ends -----------------------------------------------------------
+
+#if defined(TALON_NATIVE)
+#include <HostFlash.h>
+#define SPILL_FLASH_HOST
+#define SPILL_PAGE_SIZE HOST_FLASH_PAGE_SIZE
+#elif defined(ARDUINO_ARCH_STM32) && defined(STM32L4xx)
+#define SPILL_FLASH_STM32
+#define SPILL_PAGE_SIZE FLASH_PAGE_SIZE
+// End of the firmware image: initialised data is loaded from _sidata
+extern uint32_t _sidata, _sdata, _edata;
+#else
+#define SPILL_PAGE_SIZE 2048U
+#endif
+
+static const uint8_t *region = NULL;   // Memory-mapped start of the ring
+
+static bool flashOpen() {
+#if defined(SPILL_FLASH_HOST)
+  if (SPILL_PAGES > HOST_FLASH_PAGES) return false;
+  region = hostFlashData();
+  return true;
+#elif defined(SPILL_FLASH_STM32)
+  // Below the EEPROM emulation page, the last page of flash
+  uint32_t start = FLASH_BASE + FLASH_SIZE - FLASH_PAGE_SIZE * (SPILL_PAGES + 1);
+  uint32_t image_end = (uint32_t)&_sidata + ((uint32_t)&_edata - (uint32_t)&_sdata);
+  if (start < image_end) return false;
+  region = (const uint8_t *)start;
+  return true;
+#else
+  return false;
+#endif
+}
+
+static bool flashErase(uint32_t page) {
+#if defined(SPILL_FLASH_HOST)
+  return hostFlashErase(page);
+#elif defined(SPILL_FLASH_STM32)
+  FLASH_EraseInitTypeDef erase;
+  uint32_t error = 0;
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Banks = FLASH_BANK_1;
+  erase.Page = ((uint32_t)region - FLASH_BASE) / FLASH_PAGE_SIZE + page;
+  erase.NbPages = 1;
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  bool ok = HAL_FLASHEx_Erase(&erase, &error) == HAL_OK;
+  HAL_FLASH_Lock();
+  return ok;
+#else
+  (void)page;
+  return false;
+#endif
+}
+
+// Program the double word at offset into the ring
+static bool flashProgram(uint32_t offset, uint64_t value) {
+#if defined(SPILL_FLASH_HOST)
+  return hostFlashProgram(offset, value);
+#elif defined(SPILL_FLASH_STM32)
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  bool ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (uint32_t)region + offset, value) == HAL_OK;
+  HAL_FLASH_Lock();
+  return ok;
+#else
+  (void)offset;
+  (void)value;
+  return false;
+#endif
+}
+
+// Layout ---------------------------------------------------------------------
+//
+// Page:     header (magic, lap sequence number), then fragments
+// Fragment: header (16 bytes), done double word, data padded to 8 bytes
+// Entry:    json length, binary length (4 bytes each), JSON, binary;
+//           fragments 0..n of one entry number, the first flagged FIRST
+//           (and carrying the entry's done mark), the last LAST
+
+#define PAGE_MAGIC 0x50534C51UL      // "QLSP"
+#define FRAG_MAGIC 0x5146U           // "FQ"
+#define FRAG_FIRST 0x01
+#define FRAG_LAST 0x02
+
+struct PageHeader {
+  uint32_t magic;
+  uint32_t seq;
+};
+
+struct FragHeader {
+  uint16_t magic;
+  uint16_t len;            // Data bytes
+  uint32_t entry;
+  uint16_t index;          // Fragment number within the entry
+  uint8_t flags;
+  uint8_t reserved;
+  uint32_t check;          // FNV-1a over the data, then the fields before this
+};
+
+#define PAGE_HEADER sizeof(PageHeader)
+#define FRAG_DONE sizeof(FragHeader)           // Offset of the done mark
+#define FRAG_DATA (sizeof(FragHeader) + 8)     // Offset of the data
+#define FRAG_ROOM (FRAG_DATA + 8)              // Smallest useful fragment
+
+struct Pos {
+  uint32_t page;
+  uint32_t off;
+};
+
+static bool ready = false;
+static Pos head;                     // Next fragment goes here (off past the limit: next page)
+static Pos tail;                     // First fragment of the oldest unsent entry
+static uint32_t pageSeq = 0;         // Sequence number of the head page
+static uint32_t pending = 0;
+static uint32_t nextEntry = 0;
+
+// Entry being written
+static bool writing = false;
+static Pos entryStart;
+static Pos frag;
+static uint32_t fragLen;
+static uint32_t fragCheck;
+static uint16_t fragIndex;
+static uint32_t writeEntry;
+static uint32_t binLeft;
+static uint8_t word[8];
+static uint32_t wordLen;
+
+// Sending
+static bool retrying = false;
+static unsigned long lastAttempt = 0;
+
+static inline const uint8_t *at(uint32_t page, uint32_t off) {
+  return region + page * SPILL_PAGE_SIZE + off;
+}
+
+static inline uint32_t align8(uint32_t n) {
+  return (n + 7U) & ~7U;
+}
+
+static inline uint32_t nextPage(uint32_t page) {
+  return (page + 1U) % SPILL_PAGES;
+}
+
+static bool erased(const uint8_t *p, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    if (p[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+static uint32_t fnv(uint32_t h, const void *data, uint32_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (uint32_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 16777619UL;
+  }
+  return h;
+}
+
+static bool pageValid(uint32_t page, PageHeader *h) {
+  memcpy(h, at(page, 0), sizeof(*h));
+  return h->magic == PAGE_MAGIC;
+}
+
+// A whole fragment at page/off, its check intact
+static bool readFrag(uint32_t page, uint32_t off, FragHeader *f) {
+  if (off + FRAG_ROOM > SPILL_PAGE_SIZE) return false;
+  memcpy(f, at(page, off), sizeof(*f));
+  if (f->magic != FRAG_MAGIC || f->len == 0 || off + FRAG_DATA + f->len > SPILL_PAGE_SIZE) return false;
+  uint32_t h = fnv(2166136261UL, at(page, off + FRAG_DATA), f->len);
+  return fnv(h, f, offsetof(FragHeader, check)) == f->check;
+}
+
+static bool fragSent(Pos p) {
+  return !erased(at(p.page, p.off + FRAG_DONE), 8);
+}
+
+// The next whole fragment at or after *p, short of the head. The rest of
+// a page is skipped at a fragment cut short, where writing moved on.
+static bool findFrag(Pos *p, FragHeader *f) {
+  for (uint32_t pages = 0; pages <= SPILL_PAGES; pages++) {
+    if (p->page == head.page && p->off >= head.off) return false;
+    if (readFrag(p->page, p->off, f)) return true;
+    if (p->page == head.page) return false;
+    p->page = nextPage(p->page);
+    p->off = PAGE_HEADER;
+  }
+  return false;
+}
+
+static void skipFrag(Pos *p, const FragHeader *f) {
+  p->off += FRAG_DATA + align8(f->len);
+}
+
+// All fragments of the entry starting at p are there
+static bool entryComplete(Pos p, FragHeader f) {
+  uint32_t entry = f.entry;
+  for (uint16_t index = 0; ; index++) {
+    if (f.entry != entry || f.index != index) return false;
+    if (f.flags & FRAG_LAST) return true;
+    skipFrag(&p, &f);
+    if (!findFrag(&p, &f)) return false;
+  }
+}
+
+static bool entryWaiting(Pos p, const FragHeader &f) {
+  return (f.flags & FRAG_FIRST) && !fragSent(p) && entryComplete(p, f);
+}
+
+// Move the tail to the next unsent entry after the current one
+static void advanceTail() {
+  Pos p = tail;
+  FragHeader f;
+  while (findFrag(&p, &f)) {
+    if (entryWaiting(p, f)) {
+      tail = p;
+      return;
+    }
+    skipFrag(&p, &f);
+  }
+  tail = head;
+}
+
+void spillInit() {
+  ready = false;
+  writing = false;
+  pending = 0;
+  nextEntry = 0;
+  if (!flashOpen()) {
+    Serial.println("Spill queue: no flash region, notes that fail are dropped");
+    return;
+  }
+
+  // The head page has the highest sequence number; no valid page yet
+  // starts the ring at page 0
+  PageHeader h;
+  bool any = false;
+  head.page = SPILL_PAGES - 1;
+  head.off = SPILL_PAGE_SIZE;
+  pageSeq = 0;
+  for (uint32_t page = 0; page < SPILL_PAGES; page++) {
+    if (pageValid(page, &h) && (!any || (int32_t)(h.seq - pageSeq) > 0)) {
+      any = true;
+      head.page = page;
+      pageSeq = h.seq;
+    }
+  }
+
+  Pos oldest = head;
+  if (any) {
+    // Find the head within its page: after the last whole fragment, or
+    // at the page end if a write was cut short there
+    FragHeader f;
+    head.off = PAGE_HEADER;
+    while (head.off + FRAG_ROOM <= SPILL_PAGE_SIZE) {
+      if (readFrag(head.page, head.off, &f)) {
+        head.off += FRAG_DATA + align8(f.len);
+      } else {
+        if (!erased(at(head.page, head.off), SPILL_PAGE_SIZE - head.off)) head.off = SPILL_PAGE_SIZE;
+        break;
+      }
+    }
+
+    // Pages written on the laps before, going back in sequence
+    uint32_t seq = pageSeq;
+    oldest.off = PAGE_HEADER;
+    for (uint32_t i = 1; i < SPILL_PAGES; i++) {
+      uint32_t page = (oldest.page + SPILL_PAGES - 1) % SPILL_PAGES;
+      if (!pageValid(page, &h) || h.seq != seq - 1) break;
+      oldest.page = page;
+      seq--;
+    }
+  }
+
+  tail = head;
+  bool found = false;
+  Pos p = oldest;
+  FragHeader f;
+  while (any && findFrag(&p, &f)) {
+    if (f.entry >= nextEntry) nextEntry = f.entry + 1;
+    if (entryWaiting(p, f)) {
+      if (!found) tail = p;
+      found = true;
+      pending++;
+    }
+    skipFrag(&p, &f);
+  }
+
+  ready = true;
+  Serial.print("Spill queue: ");
+  Serial.print(pending);
+  Serial.print(" notes waiting, ");
+  Serial.print(spillFree() / 1024);
+  Serial.println(" KB free");
+}
+
+uint32_t spillPending() {
+  return ready ? pending : 0;
+}
+
+uint32_t spillFree() {
+  if (!ready) return 0;
+  uint32_t head_room = (head.off + FRAG_ROOM <= SPILL_PAGE_SIZE) ? SPILL_PAGE_SIZE - head.off - FRAG_DATA : 0;
+  uint32_t pages = (pending == 0) ? SPILL_PAGES - 1
+                                  : (tail.page + SPILL_PAGES - head.page - 1) % SPILL_PAGES;
+  return head_room + pages * (SPILL_PAGE_SIZE - PAGE_HEADER - FRAG_DATA);
+}
+
+// Writing ----------------------------------------------------------------------
+
+static bool startFrag() {
+  if (head.off + FRAG_ROOM > SPILL_PAGE_SIZE) {
+    // Erase the next page of the ring, now behind the tail
+    uint32_t page = nextPage(head.page);
+    if (pending > 0 && page == tail.page) return false;
+    PageHeader h = { PAGE_MAGIC, pageSeq + 1 };
+    uint64_t v;
+    memcpy(&v, &h, sizeof(v));
+    if (!flashErase(page) || !flashProgram(page * SPILL_PAGE_SIZE, v)) return false;
+    pageSeq++;
+    head.page = page;
+    head.off = PAGE_HEADER;
+  }
+  frag = head;
+  fragLen = 0;
+  fragCheck = 2166136261UL;
+  wordLen = 0;
+  return true;
+}
+
+// The header goes last: until it is programmed the fragment does not exist
+static bool closeFrag(uint8_t flags) {
+  uint32_t base = frag.page * SPILL_PAGE_SIZE + frag.off;
+  if (wordLen > 0) {
+    memset(&word[wordLen], 0xFF, 8 - wordLen);
+    uint64_t v;
+    memcpy(&v, word, sizeof(v));
+    if (!flashProgram(base + FRAG_DATA + fragLen - wordLen, v)) return false;
+    wordLen = 0;
+  }
+
+  FragHeader f;
+  f.magic = FRAG_MAGIC;
+  f.len = (uint16_t)fragLen;
+  f.entry = writeEntry;
+  f.index = fragIndex;
+  f.flags = flags | ((fragIndex == 0) ? FRAG_FIRST : 0);
+  f.reserved = 0;
+  f.check = fnv(fragCheck, &f, offsetof(FragHeader, check));
+
+  uint64_t v[2];
+  memcpy(v, &f, sizeof(v));
+  if (!flashProgram(base, v[0]) || !flashProgram(base + 8, v[1])) return false;
+  fragIndex++;
+  head.off = frag.off + FRAG_DATA + align8(fragLen);
+  return true;
+}
+
+static bool writeBytes(const void *data, uint32_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len > 0) {
+    if (frag.off + FRAG_DATA + fragLen == SPILL_PAGE_SIZE) {
+      if (!closeFrag(0) || !startFrag()) return false;
+    }
+    uint32_t n = SPILL_PAGE_SIZE - frag.off - FRAG_DATA - fragLen;
+    if (n > len) n = len;
+    fragCheck = fnv(fragCheck, p, n);
+    for (uint32_t i = 0; i < n; i++) {
+      word[wordLen++] = p[i];
+      fragLen++;
+      if (wordLen == 8) {
+        uint64_t v;
+        memcpy(&v, word, sizeof(v));
+        if (!flashProgram(frag.page * SPILL_PAGE_SIZE + frag.off + FRAG_DATA + fragLen - 8, v)) return false;
+        wordLen = 0;
+      }
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Leave what was written as an incomplete entry, skipped when reading,
+// and carry on from the next page
+static void abandon() {
+  writing = false;
+  head.off = SPILL_PAGE_SIZE;
+  Serial.println("Spill queue: flash write failed, note dropped");
+}
+
+bool spillBegin(const J *req, uint32_t bin_len) {
+  if (!ready || writing) return false;
+  char *json = JPrintUnformatted(req);
+  if (json == NULL) return false;
+
+  uint32_t desc[2] = { (uint32_t)strlen(json), bin_len };
+  if (sizeof(desc) + desc[0] + bin_len > spillFree()) {
+    free(json);
+    Serial.println("Spill queue: full, note dropped");
+    return false;
+  }
+
+  writing = true;
+  writeEntry = nextEntry++;
+  fragIndex = 0;
+  bool ok = startFrag();
+  entryStart = frag;
+  ok = ok && writeBytes(desc, sizeof(desc)) && writeBytes(json, desc[0]);
+  free(json);
+  binLeft = bin_len;
+  if (!ok) abandon();
+  return ok;
+}
+
+bool spillAppend(const void *data, uint32_t len) {
+  if (!writing) return false;
+  if (len > binLeft || !writeBytes(data, len)) {
+    abandon();
+    return false;
+  }
+  binLeft -= len;
+  return true;
+}
+
+bool spillEnd() {
+  if (!writing) return false;
+  if (binLeft != 0 || !closeFrag(FRAG_LAST)) {
+    abandon();
+    return false;
+  }
+  writing = false;
+  if (pending == 0) tail = entryStart;
+  pending++;
+  return true;
+}
+
+// Sending ----------------------------------------------------------------------
+
+struct Reader {
+  Pos pos;
+  FragHeader f;
+  uint32_t used;           // Data bytes of f already read
+};
+
+// The next contiguous run of the entry, up to max bytes; NULL at its end
+static const uint8_t *readPiece(Reader *r, uint32_t max, uint32_t *len) {
+  while (r->used == r->f.len) {
+    if (r->f.flags & FRAG_LAST) return NULL;
+    uint32_t entry = r->f.entry;
+    uint16_t index = r->f.index + 1;
+    skipFrag(&r->pos, &r->f);
+    if (!findFrag(&r->pos, &r->f) || r->f.entry != entry || r->f.index != index) return NULL;
+    r->used = 0;
+  }
+  uint32_t n = r->f.len - r->used;
+  if (n > max) n = max;
+  const uint8_t *p = at(r->pos.page, r->pos.off + FRAG_DATA + r->used);
+  r->used += n;
+  *len = n;
+  return p;
+}
+
+static bool readBytes(Reader *r, void *data, uint32_t len) {
+  uint8_t *d = (uint8_t *)data;
+  while (len > 0) {
+    uint32_t n;
+    const uint8_t *p = readPiece(r, len, &n);
+    if (p == NULL) return false;
+    memcpy(d, p, n);
+    d += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Base64 of the next len bytes, for Notecards without binary transfers
+static char *encodePayload(Reader *r, uint32_t len) {
+  char *b64 = (char *)malloc(JB64EncodeLen(len));
+  if (b64 == NULL) return NULL;
+  char *out = b64;
+  uint8_t carry[3];
+  uint32_t held = 0;
+  *out = '\0';
+
+  while (len > 0) {
+    uint32_t n;
+    const uint8_t *p = readPiece(r, len, &n);
+    if (p == NULL) {
+      free(b64);
+      return NULL;
+    }
+    len -= n;
+    while (held > 0 && held < 3 && n > 0) {
+      carry[held++] = *p++;
+      n--;
+    }
+    if (held == 3) {
+      out += JB64Encode(out, (const char *)carry, 3) - 1;
+      held = 0;
+    }
+    uint32_t whole = n - n % 3;
+    if (whole > 0) out += JB64Encode(out, (const char *)p, whole) - 1;
+    for (uint32_t i = whole; i < n; i++) carry[held++] = p[i];
+  }
+  if (held > 0) JB64Encode(out, (const char *)carry, held);
+  return b64;
+}
+
+static void markSent() {
+  flashProgram(tail.page * SPILL_PAGE_SIZE + tail.off + FRAG_DONE, 0);
+  pending--;
+  advanceTail();
+}
+
+bool spillDue() {
+  if (!ready || writing || pending == 0) return false;
+  return !retrying || millis() - lastAttempt >= SPILL_RETRY_MS;
+}
+
+void spillService(bool binary) {
+  if (!spillDue()) return;
+  lastAttempt = millis();
+
+  Reader r;
+  r.pos = tail;
+  r.used = 0;
+  uint32_t desc[2];
+  J *req = NULL;
+  if (findFrag(&r.pos, &r.f) && readBytes(&r, desc, sizeof(desc))) {
+    char *json = (char *)malloc(desc[0] + 1);
+    if (json && readBytes(&r, json, desc[0])) {
+      json[desc[0]] = '\0';
+      req = JParse(json);
+    }
+    free(json);
+  }
+  if (req == NULL) {
+    Serial.println("Spill queue: unreadable note dropped");
+    markSent();
+    return;
+  }
+
+  bool sent = false;
+  if (desc[1] == 0) {
+    sent = notecard.sendRequest(req);
+  } else if (binary && noteBinaryBegin(desc[1])) {
+    uint32_t left = desc[1];
+    bool ok = true;
+    while (ok && left > 0) {
+      uint32_t n;
+      const uint8_t *p = readPiece(&r, left, &n);
+      ok = p && noteBinaryAppend(p, n);
+      left -= ok ? n : 0;
+    }
+    if (ok) {
+      sent = noteBinaryAdd(req);
+    } else {
+      JDelete(req);
+    }
+  } else {
+    char *b64 = encodePayload(&r, desc[1]);
+    if (b64) {
+      JAddStringToObject(req, "payload", b64);
+      free(b64);
+      sent = notecard.sendRequest(req);
+    } else {
+      JDelete(req);
+    }
+  }
+
+  if (!sent) {
+    retrying = true;
+    Serial.print("Spill queue: send failed, ");
+    Serial.print(pending);
+    Serial.println(" notes waiting");
+    return;
+  }
+  retrying = false;
+  markSent();
+  Serial.print("Spill queue: sent a queued note, ");
+  Serial.print(pending);
+  Serial.println(" left");
+}
@@ -0,0 +1,58 @@
+#ifndef SPILL_QUEUE_H
+#define SPILL_QUEUE_H
+
+// Flash-backed queue for notes the Notecard would not take.
+//
+// A note that fails to send (the uplink or the Notecard is saturated, a
+// binary note cannot go out live) is written to internal flash instead of
+// being dropped: its request JSON and its binary payload, if any. Once
+// notes are queued, new ones go behind them, so the cloud sees them in
+// order. spillService() retries the oldest from loop() and sends the
+// queue down in order once the Notecard takes notes again; binary payloads
+// go back through card.binary, or as base64 "payload" without it.
+//
+// The log is append-only over a ring of SPILL_PAGES flash pages just below
+// the EEPROM emulation page. A page is erased only when the write position
+// comes round to it again, so wear is spread evenly over the ring: every
+// page is erased once per lap. Entries are cut into fragments at page
+// ends, each with its own check, and a fragment's header is programmed
+// after its data, so a write cut short by a reset is found and skipped at
+// boot. A sent entry is marked by programming a double word left erased
+// for the purpose; nothing is rewritten in place.
+//
+// Without a flash back end (a platform other than STM32L4, or a region
+// that would overlap the firmware image) the queue reports no room and
+// callers carry on as before.
+
+#include <Arduino.h>
+#include <Notecard.h>
+
+#ifndef SPILL_PAGES
+#define SPILL_PAGES 32                 // 64 KB of 2 KB pages
+#endif
+#define SPILL_RETRY_MS 60000UL         // Between attempts while the Notecard refuses
+
+// Find the queue in flash; call once from setup()
+void spillInit();
+
+// Entries waiting to be sent
+uint32_t spillPending();
+
+// Free space for entries, in bytes
+uint32_t spillFree();
+
+// Queue a note: spillBegin() with the request (not consumed) and the
+// binary payload length, then the payload in any number of spillAppend()
+// calls, then spillEnd(). False if there is no room or a write failed; the
+// entry is then not queued.
+bool spillBegin(const J *req, uint32_t bin_len);
+bool spillAppend(const void *data, uint32_t len);
+bool spillEnd();
+
+// A queued note is due: spillService() would try to send it now
+bool spillDue();
+
+// Send the oldest queued note if due; binary allows card.binary for payloads
+void spillService(bool binary);
+
+#endif // SPILL_QUEUE_H
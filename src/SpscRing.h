@@ -0,0 +1,58 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// Lock-free single-producer/single-consumer ring.
+//
+// Meant for handing records from an interrupt handler to loop() without
+// masking interrupts: only the producer writes head and only the consumer
+// writes tail, each after its slot access, so either side sees a record
+// only once it is complete. Indices run freely and wrap at 2^16; N must be
+// a power of two no larger than 32768.
+
+#include <Arduino.h>
+
+template <typename T, uint16_t N>
+class SpscRing {
+public:
+  SpscRing() : dropped(0), head(0), tail(0) {}
+
+  // Producer side; a full ring counts the record in dropped
+  bool push(const T &record) {
+    uint16_t h = head;
+    if ((uint16_t)(h - tail) >= N) {
+      dropped++;
+      return false;
+    }
+    records[h & (N - 1)] = record;
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    head = (uint16_t)(h + 1);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T *record) {
+    uint16_t t = tail;
+    if (t == head) return false;
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+    *record = records[t & (N - 1)];
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    tail = (uint16_t)(t + 1);
+    return true;
+  }
+
+  uint16_t available() const { return (uint16_t)(head - tail); }
+
+  // Consumer side, with the producer quiet
+  void clear() { tail = head; dropped = 0; }
+
+  volatile uint32_t dropped;
+
+private:
+  static_assert((N & (N - 1)) == 0 && N <= 32768, "N must be a power of two");
+
+  T records[N];
+  volatile uint16_t head;
+  volatile uint16_t tail;
+};
+
+#endif // SPSC_RING_H
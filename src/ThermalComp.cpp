@@ -0,0 +1,130 @@
+#include "ThermalComp.h"
+
+#include <EEPROM.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// EEPROM layout: magic, the ThermalCal fields, then a checksum of both
+#define THERMAL_CAL_ADDR 0
+#define THERMAL_CAL_MAGIC 0x4C414354UL   // "TCAL"
+
+struct ThermalCalRecord {
+  uint32_t magic;
+  ThermalCal cal;
+  uint32_t check;
+};
+
+// FNV-1a over the magic and coefficients
+static uint32_t recordCheck(const ThermalCalRecord *rec) {
+  const uint8_t *p = (const uint8_t *)rec;
+  uint32_t h = 2166136261UL;
+  for (size_t i = 0; i < offsetof(ThermalCalRecord, check); i++) {
+    h = (h ^ p[i]) * 16777619UL;
+  }
+  return h;
+}
+
+bool thermalCalLoad(ThermalCal *cal) {
+  ThermalCalRecord rec;
+  uint8_t *p = (uint8_t *)&rec;
+
+  eeprom_buffer_fill();
+  for (size_t i = 0; i < sizeof(rec); i++) {
+    p[i] = eeprom_buffered_read_byte(THERMAL_CAL_ADDR + i);
+  }
+  if (rec.magic != THERMAL_CAL_MAGIC || rec.check != recordCheck(&rec)) {
+    return false;
+  }
+  *cal = rec.cal;
+  return true;
+}
+
+// One page program per save: the buffered API erases the page once
+bool thermalCalSave(const ThermalCal *cal) {
+  ThermalCalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = THERMAL_CAL_MAGIC;
+  rec.cal = *cal;
+  rec.check = recordCheck(&rec);
+  const uint8_t *p = (const uint8_t *)&rec;
+
+  eeprom_buffer_fill();
+  for (size_t i = 0; i < sizeof(rec); i++) {
+    eeprom_buffered_write_byte(THERMAL_CAL_ADDR + i, p[i]);
+  }
+  eeprom_buffer_flush();
+
+  ThermalCal check;
+  return thermalCalLoad(&check) && memcmp(&check, cal, sizeof(check)) == 0;
+}
+
+// "t0,ox,oy,oz,tx,ty,tz,sx,sy,sz": t0 in degC, offsets in mg, offset
+// slopes in mg/degC, sensitivity slopes in ppm/degC
+bool thermalCalParse(const char *text, ThermalCal *cal) {
+  float v[10];
+  const char *p = text;
+
+  if (text == NULL) return false;
+  for (int n = 0; n < 10; n++) {
+    char *end;
+    v[n] = strtof(p, &end);
+    if (end == p) return false;
+    p = end;
+    while (*p == ' ') p++;
+    if (n < 9) {
+      if (*p != ',') return false;
+      p++;
+    }
+  }
+  if (*p != '\0') return false;
+
+  cal->t0_c = v[0];
+  for (int i = 0; i < 3; i++) {
+    cal->offset_mg[i] = v[1 + i];
+    cal->offset_mg_c[i] = v[4 + i];
+    cal->sens_ppm_c[i] = v[7 + i];
+  }
+  return true;
+}
+
+void thermalCalFormat(const ThermalCal *cal, char *text, size_t size) {
+  snprintf(text, size, "%g,%g,%g,%g,%g,%g,%g,%g,%g,%g", cal->t0_c,
+           cal->offset_mg[0], cal->offset_mg[1], cal->offset_mg[2],
+           cal->offset_mg_c[0], cal->offset_mg_c[1], cal->offset_mg_c[2],
+           cal->sens_ppm_c[0], cal->sens_ppm_c[1], cal->sens_ppm_c[2]);
+}
+
+ThermalComp::ThermalComp() : calibrated(false), sensitivity(0.0f), temp_c(25.0f) {
+  memset(&cal, 0, sizeof(cal));
+  update();
+}
+
+void ThermalComp::setCalibration(const ThermalCal *c) {
+  calibrated = (c != NULL);
+  if (calibrated) {
+    cal = *c;
+  } else {
+    memset(&cal, 0, sizeof(cal));
+  }
+  update();
+}
+
+void ThermalComp::setSensitivity(float mg_per_lsb) {
+  sensitivity = mg_per_lsb;
+  update();
+}
+
+void ThermalComp::setTemperature(float t) {
+  temp_c = t;
+  update();
+}
+
+// true = (measured - offset(T)) / (1 + k(T)), as raw * gain - bias
+void ThermalComp::update() {
+  float dt = calibrated ? temp_c - cal.t0_c : 0.0f;
+  for (int i = 0; i < 3; i++) {
+    float scale = 1.0f / (1.0f + cal.sens_ppm_c[i] * 1e-6f * dt);
+    gain[i] = sensitivity * scale;
+    bias[i] = (cal.offset_mg[i] + cal.offset_mg_c[i] * dt) * scale;
+  }
+}
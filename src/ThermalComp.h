@@ -0,0 +1,60 @@
+#ifndef THERMAL_COMP_H
+#define THERMAL_COMP_H
+
+// Accelerometer thermal drift compensation.
+//
+// Per-axis model around a reference temperature t0 (dT = T - t0):
+//   measured_mg = true_mg * (1 + sens_ppm_c * 1e-6 * dT) + offset_mg + offset_mg_c * dT
+// The coefficients are per device. They are kept in the flash-emulated
+// EEPROM page so they survive resets, and can be provisioned as text (see
+// thermalCalParse). Without a calibration the model is the identity.
+//
+// setTemperature() folds the model into a per-axis gain and bias, so
+// converting a sample costs one multiply and one subtract per axis, the
+// same as a plain sensitivity scale plus the subtract.
+
+#include <Arduino.h>
+
+struct ThermalCal {
+  float t0_c;
+  float offset_mg[3];       // Zero-g offset at t0
+  float offset_mg_c[3];     // Offset change per degC
+  float sens_ppm_c[3];      // Sensitivity change per degC, ppm
+};
+
+bool thermalCalLoad(ThermalCal *cal);
+bool thermalCalSave(const ThermalCal *cal);
+bool thermalCalParse(const char *text, ThermalCal *cal);
+void thermalCalFormat(const ThermalCal *cal, char *text, size_t size);
+
+// Sensor temperature from a raw OUT_TEMP / FIFO temperature value
+inline float thermalRawToCelsius(int16_t raw) {
+  return raw / 256.0f + 25.0f;
+}
+
+class ThermalComp {
+public:
+  ThermalComp();
+
+  void setCalibration(const ThermalCal *cal);
+  void setSensitivity(float mg_per_lsb);
+  void setTemperature(float temp_c);
+  void convert(const int16_t raw[3], float mg[3]) const {
+    for (int i = 0; i < 3; i++) mg[i] = raw[i] * gain[i] - bias[i];
+  }
+
+  const ThermalCal *calibration() const { return calibrated ? &cal : NULL; }
+  float temperature() const { return temp_c; }
+
+private:
+  void update();
+
+  ThermalCal cal;
+  bool calibrated;
+  float sensitivity;
+  float temp_c;
+  float gain[3];
+  float bias[3];
+};
+
+#endif // THERMAL_COMP_H
@@ -2,14 +2,24 @@
 #define ACCELEROMETERNEW_H
 
 #include "LSM6DSOXSensor.h"
+#include "LSM6DSOXFifo.h"
 #include "graham_generator.h"
+#include "BusProfiler.h"
+#include "NoteBinary.h"
+#include "SpillQueue.h"
 #include <Notecard.h>
 
-// External notecard instance (defined in main.cpp)
+// External notecard instance and transport setting (defined in main.cpp)
 extern Notecard notecard;
+extern bool binary_transport;
 
 #define INT_1 D5  // Changed to D5 as requested
 
+// Read the MLC program back after loading it (debug; doubles the load time)
+#ifndef MLC_VERIFY_LOAD
+#define MLC_VERIFY_LOAD 0
+#endif
+
 extern volatile bool motionDetected;
 extern volatile int state;
 extern volatile int prevstate;
@@ -20,23 +30,56 @@ struct StateChangeEvent {
   int fromState;
   int toState;
   unsigned long timestamp;
+  uint64_t sensorTimeUs;  // on the sensor's timestamp counter, 0 if unknown
+  int capture;            // index into eventCaptures, -1 if none
+};
+
+// Raw accelerometer window around a state change: the samples the FIFO
+// held when the MLC interrupt froze it (pre) and those that followed (post).
+// Captures wait with their events for the 5-minute send; enough buffers
+// for a busy period, and when they run out the events so far are queued
+// in flash to free them.
+#ifndef MAX_EVENT_CAPTURES
+#define MAX_EVENT_CAPTURES 8
+#endif
+#define CAPTURE_PRE_SAMPLES 104
+#define CAPTURE_POST_SAMPLES 104
+struct EventCapture {
+  int16_t xyz[CAPTURE_PRE_SAMPLES + CAPTURE_POST_SAMPLES][3];
+  uint16_t pre;           // samples before the trigger
+  uint16_t post;          // samples from the trigger on
+  uint32_t lost;          // samples lost inside the window (FIFO full)
+  uint64_t t0_us;         // sensor time of xyz[t0_at], 0 if unknown
+  uint16_t t0_at;         // first sample with a known time
+  float rate_hz;
+  float mg_per_lsb;
+  bool used;
 };
+EventCapture eventCaptures[MAX_EVENT_CAPTURES];
+unsigned long capturesDropped = 0;   // Events not captured, no free buffer
 
-// Storage for state change events (max 100 events between transmissions)
+// Storage for state change events (sent, or queued in flash, early when
+// full or when the capture buffers are)
 #define MAX_STATE_EVENTS 100
 StateChangeEvent stateEvents[MAX_STATE_EVENTS];
 int eventCount = 0;
 unsigned long lastTransmission = 0;
+bool stateSendFailed = false;
+unsigned long lastStateSendFailure = 0;
 
 //Interrupts.
 volatile int mems_event = 0;
+volatile unsigned long motionEventMicros = 0;
 
 // Components
 LSM6DSOXSensor AccGyr(&Wire, LSM6DSOX_I2C_ADD_L);
 
+// 64-bit view of the sensor's 25 us timestamp counter, shared by the FIFO
+// decoder and the state events so both are on one timebase
+LSM6DSOXTimestamp sensorClock;
+
 // MLC
 ucf_line_t *ProgramPointer;
-int32_t LineCounter;
 int32_t TotalNumberOfLine;
 
 void INT1Event_cb();
@@ -44,6 +87,8 @@ void printMLCStatus(uint8_t status);
 
 void setupLSM6DSOX() 
 {
+  BUS_PROFILE_SCOPE("setupLSM6DSOX");
+
   AccGyr.begin();
 
   /* Feed the program to Machine Learning Core */
@@ -53,21 +98,29 @@ void setupLSM6DSOX()
   Serial.print("UCF Number Line=");
   Serial.println(TotalNumberOfLine);
 
-  for (LineCounter = 0; LineCounter < TotalNumberOfLine; LineCounter++) {
-    if (AccGyr.Write_Reg(ProgramPointer[LineCounter].address, ProgramPointer[LineCounter].data)) {
-      Serial.print("Error loading the Program to LSM6DSOX at line: ");
-      Serial.println(LineCounter);
-      while (1) {
-        delay(1000);
-      }
+  // Burst load; build with -D MLC_VERIFY_LOAD=1 to read the pages back
+  uint32_t loadedLines = 0;
+  uint16_t checksum = 0;
+  if (AccGyr.Load_MLC_Program(ProgramPointer, TotalNumberOfLine, &loadedLines, &checksum, MLC_VERIFY_LOAD) != LSM6DSOX_OK) {
+    Serial.print("Error loading the Program to LSM6DSOX at line: ");
+    Serial.println(loadedLines);
+    while (1) {
+      delay(1000);
     }
   }
 
-  Serial.println("Program loaded inside the LSM6DSOX MLC");
+  Serial.print("Program loaded inside the LSM6DSOX MLC, checksum 0x");
+  Serial.println(checksum, HEX);
   Serial.println("State detection active...");
 
-  // Note: Don't enable accelerometer here - let the main code handle it
-  // This allows the original acceleration logging to work
+  // The program leaves the accelerometer running at the rate the MLC needs;
+  // acceleration logging reads it through this same driver (initLSM6DSOX).
+  // Every access now goes through AccGyr, so configuration reads can be
+  // served from the driver's register cache.
+  AccGyr.Enable_Register_Cache();
+
+  // Samples and state events are stamped from the sensor's own counter
+  AccGyr.Set_Timestamp_Status(1);
 
   //Interrupts.
   pinMode(INT_1, INPUT);
@@ -158,12 +211,38 @@ int checkForStateChange()
   return -1;
 }
 
-// Add a state change event to storage
-void addStateChangeEvent(int fromState, int toState, unsigned long timestamp) {
+// Sensor time of the last motion interrupt: the counter now, less the time
+// since the interrupt fired, so loop lag does not shift the event
+uint64_t motionEventSensorUs() {
+  unsigned long now_us = micros();
+  uint64_t ticks = 0;
+  if (sensorClock.read(&AccGyr, &ticks) != LSM6DSOX_OK) {
+    return 0;
+  }
+  uint64_t sensor_us = ticks * LSM6DSOX_TIMESTAMP_TICK_US;
+  unsigned long lag_us = now_us - motionEventMicros;
+  return (sensor_us > lag_us) ? sensor_us - lag_us : 0;
+}
+
+void sendStateChangesToCloud();
+
+// After a failed send, wait SPILL_RETRY_MS before the next attempt
+bool stateSendDue() {
+  return !stateSendFailed || millis() - lastStateSendFailure >= SPILL_RETRY_MS;
+}
+
+// Add a state change event to storage; returns its index, -1 if full
+int addStateChangeEvent(int fromState, int toState, unsigned long timestamp, uint64_t sensorTimeUs) {
+  if (eventCount >= MAX_STATE_EVENTS && stateSendDue()) {
+    // Hand the full batch on (sent, or queued in flash) rather than drop events
+    sendStateChangesToCloud();
+  }
   if (eventCount < MAX_STATE_EVENTS) {
     stateEvents[eventCount].fromState = fromState;
     stateEvents[eventCount].toState = toState;
     stateEvents[eventCount].timestamp = timestamp;
+    stateEvents[eventCount].sensorTimeUs = sensorTimeUs;
+    stateEvents[eventCount].capture = -1;
     eventCount++;
     
     Serial.print("State Change Stored: ");
@@ -172,35 +251,66 @@ void addStateChangeEvent(int fromState, int toState, unsigned long timestamp) {
     Serial.print(toState);
     Serial.print(" at ");
     Serial.println(timestamp);
+    return eventCount - 1;
   } else {
     Serial.println("Warning: State event buffer full!");
+    return -1;
   }
 }
 
-// Check for interrupt-based state changes and store them
-void checkAndStoreStateChanges() {
+// Check for interrupt-based state changes and store them; returns the index
+// of the stored event, -1 if none
+int checkAndStoreStateChanges() {
   // First check if interrupt occurred
   int newState = checkForStateChange();
   
   // Then check if a state change was detected
   if (stateChanged) {
     stateChanged = false; // Reset flag
-    addStateChangeEvent(prevstate, state, millis());
+    return addStateChangeEvent(prevstate, state, millis(), motionEventSensorUs());
   }
+  return -1;
 }
 
-// Send all stored state changes to Notehub
-void sendStateChangesToCloud() {
-  if (eventCount == 0) {
-    Serial.println("No state changes to send");
-    return;
+// Attach a capture to an event note: int16 x,y,z little-endian, either
+// at offset in the note's binary payload or, with offset < 0, base64 in
+// the event
+void addCaptureToEvent(J *event, const EventCapture *capture, int32_t offset) {
+  int total_size = (capture->pre + capture->post) * 6;
+  char *encoded = NULL;
+  if (offset < 0) {
+    encoded = (char *)malloc(JB64EncodeLen(total_size));
+    if (encoded == NULL) {
+      Serial.println("Failed to allocate memory for capture");
+      return;
+    }
+    JB64Encode(encoded, (const char *)capture->xyz, total_size);
   }
   
-  Serial.print("Sending ");
-  Serial.print(eventCount);
-  Serial.println(" state changes to cloud...");
-  
-  // Create JSON note with all state changes
+  J *obj = JAddObjectToObject(event, "capture");
+  if (obj) {
+    if (encoded) {
+      JAddStringToObject(obj, "data", encoded);
+    } else {
+      JAddNumberToObject(obj, "offset", offset);
+      JAddNumberToObject(obj, "length", total_size);
+    }
+    JAddNumberToObject(obj, "pre", capture->pre);
+    JAddNumberToObject(obj, "post", capture->post);
+    JAddNumberToObject(obj, "lost", capture->lost);
+    JAddNumberToObject(obj, "rate_hz", capture->rate_hz);
+    JAddNumberToObject(obj, "mg_per_lsb", capture->mg_per_lsb);
+    if (capture->t0_us) {
+      JAddNumberToObject(obj, "t0_us", (double)capture->t0_us);
+      JAddNumberToObject(obj, "t0_at", capture->t0_at);
+    }
+  }
+  free(encoded);
+}
+
+// The states.qo note for the stored events; their captures at their
+// offsets in the note's binary payload, or base64 in the events
+J *newStatesNote(bool binary) {
   J *req = notecard.newRequest("note.add");
   JAddStringToObject(req, "file", "states.qo");
   JAddBoolToObject(req, "sync", true);
@@ -210,47 +320,145 @@ void sendStateChangesToCloud() {
     JAddNumberToObject(body, "event_count", eventCount);
     JAddNumberToObject(body, "collection_start", lastTransmission);
     JAddNumberToObject(body, "collection_end", millis());
+    JAddNumberToObject(body, "captures_dropped", capturesDropped);
     
     // Add events as an array
     J *events = JAddArrayToObject(body, "events");
     if (events) {
+      int32_t offset = 0;
       for (int i = 0; i < eventCount; i++) {
         J *event = JCreateObject();
         if (event) {
           JAddNumberToObject(event, "from", stateEvents[i].fromState);
           JAddNumberToObject(event, "to", stateEvents[i].toState);
           JAddNumberToObject(event, "time", stateEvents[i].timestamp);
+          if (stateEvents[i].sensorTimeUs) {
+            JAddNumberToObject(event, "time_us", (double)stateEvents[i].sensorTimeUs);
+          }
+          if (stateEvents[i].capture >= 0) {
+            const EventCapture *c = &eventCaptures[stateEvents[i].capture];
+            addCaptureToEvent(event, c, binary ? offset : -1);
+            offset += (c->pre + c->post) * 6;
+          }
           JAddItemToArray(events, event);
         }
       }
     }
   }
+  return req;
+}
+
+// Bytes of capture data attached to the stored events
+uint32_t stateCaptureBytes() {
+  uint32_t binary_size = 0;
+  for (int i = 0; i < eventCount; i++) {
+    if (stateEvents[i].capture >= 0) {
+      const EventCapture *c = &eventCaptures[stateEvents[i].capture];
+      binary_size += (c->pre + c->post) * 6;
+    }
+  }
+  return binary_size;
+}
+
+// Queue the stored state changes in flash as a states.qo note, their
+// captures in its binary payload; true if queued
+bool spillStateChanges(uint32_t binary_size) {
+  J *req = newStatesNote(true);
+  bool success = spillBegin(req, binary_size);
+  JDelete(req);
+  for (int i = 0; success && i < eventCount; i++) {
+    if (stateEvents[i].capture >= 0) {
+      const EventCapture *c = &eventCaptures[stateEvents[i].capture];
+      success = spillAppend(c->xyz, (c->pre + c->post) * 6);
+    }
+  }
+  return success && spillEnd();
+}
+
+// Start the next collection period, releasing the captures
+void clearStateChanges() {
+  for (int i = 0; i < eventCount; i++) {
+    if (stateEvents[i].capture >= 0) eventCaptures[stateEvents[i].capture].used = false;
+  }
+  eventCount = 0;
+  lastTransmission = millis();
+}
+
+// All capture buffers hold finished captures
+bool captureBuffersFull() {
+  for (int i = 0; i < MAX_EVENT_CAPTURES; i++) {
+    if (!eventCaptures[i].used) return false;
+  }
+  return true;
+}
+
+// Queue the stored state changes in flash ahead of the 5-minute send, so
+// the next event has a capture buffer
+void queueStateChanges() {
+  if (eventCount == 0) return;
+  bool success = spillStateChanges(stateCaptureBytes());
+  Serial.print(eventCount);
+  Serial.println(success ? " state changes queued in flash, capture buffers full" : " state changes kept, flash queue full");
+  if (success) clearStateChanges();
+}
+
+// Send all stored state changes to Notehub, or queue them in flash when
+// the Notecard will not take them
+void sendStateChangesToCloud() {
+  if (eventCount == 0) {
+    Serial.println("No state changes to send");
+    return;
+  }
+  
+  Serial.print("Sending ");
+  Serial.print(eventCount);
+  Serial.println(" state changes to cloud...");
   
-  bool success = notecard.sendRequest(req);
+  // Captures go in the note's binary payload, in event order, if the
+  // Notecard takes binary transfers. Once notes are queued in flash, this
+  // one goes behind them.
+  uint32_t binary_size = stateCaptureBytes();
+  bool queued = spillPending() > 0;
+  bool binary = !queued && binary_transport && binary_size > 0 && noteBinaryBegin(binary_size);
+  for (int i = 0; binary && i < eventCount; i++) {
+    if (stateEvents[i].capture >= 0) {
+      const EventCapture *c = &eventCaptures[stateEvents[i].capture];
+      binary = noteBinaryAppend(c->xyz, (c->pre + c->post) * 6);
+    }
+  }
   
+  bool success = false;
+  if (!queued) {
+    success = binary ? noteBinaryAdd(newStatesNote(true)) : notecard.sendRequest(newStatesNote(false));
+  }
   if (success) {
     Serial.print("Successfully sent ");
     Serial.print(eventCount);
     Serial.println(" state changes");
-    
-    // Reset for next collection period
-    eventCount = 0;
-    lastTransmission = millis();
   } else {
-    Serial.println("Failed to send state changes");
+    success = spillStateChanges(binary_size);
+    Serial.print(eventCount);
+    Serial.println(success ? " state changes queued in flash" : " state changes kept, send failed");
+  }
+  
+  if (success) {
+    clearStateChanges();
   }
+  stateSendFailed = !success;
+  lastStateSendFailure = millis();
 }
 
 // Check if it's time to send state changes (every 5 minutes)
 void checkStateTransmissionTimer() {
   const unsigned long FIVE_MINUTES = 5 * 60 * 1000; // 5 minutes in milliseconds
   
-  if (millis() - lastTransmission >= FIVE_MINUTES) {
+  if (millis() - lastTransmission >= FIVE_MINUTES && stateSendDue()) {
     sendStateChangesToCloud();
   }
 }
 
 void INT1Event_cb() {
+  motionEventMicros = micros();
   motionDetected = true;
 }
 
@@ -4,184 +4,436 @@
 #include <cstring>
 #include <cstdlib>
 #include "accelerometernew.h"
+#include "LSM6DSOXFifo.h"
+#include "BusProfiler.h"
+#include "ThermalComp.h"
+#include "SpscRing.h"
+#include "SampleCodec.h"
+#include "NoteBinary.h"
+#include "SpillQueue.h"
 
 #define usbSerial Serial
 
 #define productUID "com.gmail.taulabtech:taulabtest"
 
-// LSM6DSOX I2C addresses
-#define LSM6DSOX_ADDRESS_LOW  0x6A
-#define LSM6DSOX_ADDRESS_HIGH 0x6B
-
 // Expected WHO_AM_I value
 #define LSM6DSOX_WHO_AM_I_VALUE 0x6C
 
 Notecard notecard;
 
 // Configuration
-float current_odr = 26.0f;           // 26 Hz sampling rate
-unsigned long sample_interval_ms;    // Calculated from ODR
-unsigned long logging_duration = 10000;  // 10 seconds
+float current_odr = 26.0f;           // Sampling rate, taken from the MLC program
+float requested_odr = 0.0f;          // 0 keeps the MLC program's ODR, otherwise up to 6667 Hz
+float effective_odr = 0.0f;          // Measured from the batch counter interrupts
+float accel_bdr = 0.0f;              // FIFO batch rate, 0 batches every accelerometer sample
+float gyro_bdr = 0.0f;               // 0 leaves the gyroscope off, otherwise 6-axis
+bool delta_codec = true;             // Delta-code the records (format 3) when that is smaller
+bool binary_transport = true;        // Send records through card.binary when the Notecard supports it
+unsigned long logging_duration = 10000;  // 10 seconds per capture window
+unsigned long acq_period_ms = 5UL * 60UL * 1000UL;  // Window start to start, 0 runs them back to back
 
-// Sensor variables
-uint8_t lsm6dsox_address = 0;
+// Sensor state
 bool lsm6dsox_found = false;
 
-// Data storage for batching
-#define MAX_SAMPLES 300  // Adjust based on available memory
-float ax_samples[MAX_SAMPLES];
-float ay_samples[MAX_SAMPLES];
-float az_samples[MAX_SAMPLES];
+// Data storage for batching. Samples stay raw int16 counts (6 bytes, half
+// a float triple) and are converted to mg on the host with the full-scale
+// metadata sent alongside. They are written straight into the note payload
+// in wire format (x,y,z little-endian), packed at the tail of a buffer
+// sized for their base64 encoding; the encoder then works front to back
+// in place, as it writes 4 bytes for every 3 it has read and so never
+// overtakes the input. No intermediate arrays, copies or malloc.
+#define MAX_SAMPLES 600  // 3-axis records; adjust based on available memory
+#define SAMPLE_BYTES 6
+#define PAYLOAD_LEN (((MAX_SAMPLES * SAMPLE_BYTES + 2) / 3) * 4 + 1)
+#define PAYLOAD_RAW_OFFSET (PAYLOAD_LEN - MAX_SAMPLES * SAMPLE_BYTES)
+char payload[PAYLOAD_LEN];
+uint8_t *const payload_samples = (uint8_t *)&payload[PAYLOAD_RAW_OFFSET];
 int collected_samples = 0;
+int max_xl_samples = MAX_SAMPLES;
 
-// I2C communication functions
-bool writeRegister(uint8_t reg, uint8_t value) {
-  Wire.beginTransmission(lsm6dsox_address);
-  Wire.write(reg);
-  Wire.write(value);
-  return (Wire.endTransmission() == 0);
-}
+// 6-axis sessions store accelerometer records, then gyroscope records, the
+// record area split between them in proportion to their batch rates.
+bool six_axis = false;
+float xl_rate = 0.0f;                // Batch rates in use
+float gyro_rate = 0.0f;
+float gyro_sensitivity_mdps = 0.0f;
+int gyro_offset = 0;                 // Byte offset of the gyroscope records
+int max_gy_samples = 0;
+int gyro_samples = 0;
+uint64_t gyro_first_us = 0;
+uint64_t gyro_last_us = 0;
+int gyro_first_at = 0;
+int gyro_last_at = 0;
 
-uint8_t readRegister(uint8_t reg) {
-  Wire.beginTransmission(lsm6dsox_address);
-  Wire.write(reg);
-  if (Wire.endTransmission(false) != 0) return 0xFF;
-  
-  Wire.requestFrom(lsm6dsox_address, (uint8_t)1);
-  return Wire.available() ? Wire.read() : 0xFF;
-}
+// FIFO acquisition
+#define FIFO_DEPTH_WORDS 512
+#define FIFO_DRAIN_MS 100         // Target time between batch counter interrupts
+#define FIFO_TIMESTAMP_EVERY 8    // One TIMESTAMP word per 8 samples (LSM6DSOX_DEC_8)
+#define FIFO_WORDS_PER_SAMPLE (1.0f + 1.0f / FIFO_TIMESTAMP_EVERY)
+LSM6DSOXFifoDecoder fifoDecoder(&AccGyr, &sensorClock);
+float fifo_sensitivity_mg = 0.0f;
+int32_t fifo_fs_g = 0;               // Full scales of the stored counts
+int32_t gyro_fs_dps = 0;
+#define FIFO_TEMP_BDR 1.6f           // Temperature words batched alongside, Hz
+SpscRing<unsigned long, 16> fifoEvents;   // micros() of each INT1 while acquiring
+// Sensor time of the first and last stored samples that have one (none
+// before the first TIMESTAMP word or across a gap) and their indices
+uint64_t first_sample_us = 0;
+uint64_t last_sample_us = 0;
+int first_sample_at = 0;
+int last_sample_at = 0;
 
-bool readMultipleRegisters(uint8_t reg, uint8_t* buffer, uint8_t count) {
-  Wire.beginTransmission(lsm6dsox_address);
-  Wire.write(reg);
-  if (Wire.endTransmission(false) != 0) return false;
-  
-  Wire.requestFrom(lsm6dsox_address, count);
-  for (uint8_t i = 0; i < count; i++) {
-    if (Wire.available()) {
-      buffer[i] = Wire.read();
-    } else {
-      return false;
-    }
-  }
-  return true;
-}
+// Gaps in the stored samples (FIFO overruns)
+#define MAX_GAPS 16
+uint16_t gap_index[MAX_GAPS];        // Stored samples before the gap
+uint16_t gap_gy_index[MAX_GAPS];     // Stored gyroscope samples before the gap
+uint32_t gap_lost[MAX_GAPS];         // Samples lost, 0 if unknown
+int gap_count = 0;
+uint32_t lost_samples = 0;
+uint16_t fifo_peak_level = 0;        // Highest FIFO level seen at a drain
+
+// Thermal drift compensation, fed by the FIFO temperature words
+ThermalComp thermalComp;
+float temp_sum = 0.0f;               // Session mean temperature
+int temp_count = 0;
 
+// Acquisition service: a window of logging_duration every acq_period_ms,
+// or continuously when the period is 0. Event capture shares the FIFO and
+// runs between windows only.
+bool acquiring = false;              // FIFO streaming, batch counter on INT1
+bool acq_started = false;            // A window has been started since boot
+unsigned long windowStart = 0;
+float acq_mlc_odr = 0.0f;            // ODR to restore when acquisition stops
+bool acq_gyro_started = false;       // Gyroscope started for the acquisition
+uint16_t acq_batch = 0;              // Accelerometer samples per batch counter event
+uint32_t acq_xl_popped = 0;          // Samples taken from the decoder since acquisition start
+uint32_t acq_gy_popped = 0;
+uint32_t window_xl_base = 0;         // ... at the start of the window
+uint32_t window_gy_base = 0;
+uint32_t rate_k0 = 0, rate_k1 = 0;   // Batch counter events at the first and last drain
+unsigned long rate_us0 = 0, rate_us1 = 0;
+bool rate_valid = false;
+
+// Event capture between acquisition windows
+float capture_odr = 104.0f;          // At least the MLC program's ODR
+enum CaptureState { CAPTURE_OFF, CAPTURE_ARMED, CAPTURE_POST };
+CaptureState captureState = CAPTURE_OFF;
+EventCapture *capture = NULL;        // Capture being filled
+int captureEvent = -1;               // Its state event
+uint64_t captureTriggerUs = 0;
+unsigned long captureMotionMicros = 0;
+unsigned long captureStart = 0;
+bool captureStamped = false;         // A timestamped sample has been seen
+int16_t capturePre[CAPTURE_PRE_SAMPLES][3];   // Pre-trigger samples, circular
+uint64_t capturePreUs[CAPTURE_PRE_SAMPLES];
+uint16_t capturePreHead = 0;
+uint64_t capturePostUs = 0;          // First post-trigger sample with a time
+uint16_t capturePostAt = 0;
+
+// Sampling goes through the same LSM6DSOXSensor instance (AccGyr) that
+// loaded the MLC program, so the device has one configuration: the ODR and
+// full scale set by the UCF, which the MLC depends on.
 bool initLSM6DSOX() {
-  uint8_t addresses[] = {LSM6DSOX_ADDRESS_LOW, LSM6DSOX_ADDRESS_HIGH};
+  BUS_PROFILE_SCOPE("initLSM6DSOX");
+  uint8_t whoami = 0;
   
-  for (int i = 0; i < 2; i++) {
-    lsm6dsox_address = addresses[i];
-    
-    uint8_t whoami = readRegister(LSM6DSOX_WHO_AM_I);
-    
-    if (whoami == LSM6DSOX_WHO_AM_I_VALUE) {
-      Serial.print("LSM6DSOX found at address 0x");
-      Serial.println(lsm6dsox_address, HEX);
-      
-      // Configure accelerometer: 26Hz, ±2g
-      uint8_t ctrl_val = 0x20;  // 0010 0000 = 26Hz, ±2g
-      
-      if (writeRegister(LSM6DSOX_CTRL1_XL, ctrl_val)) {
-        Serial.println("LSM6DSOX configured: 26Hz, ±2g");
-        delay(100);
-        lsm6dsox_found = true;
-        return true;
-      }
-    }
+  if (AccGyr.ReadID(&whoami) != LSM6DSOX_OK || whoami != LSM6DSOX_WHO_AM_I_VALUE) {
+    Serial.println("LSM6DSOX not found!");
+    return false;
   }
   
-  Serial.println("LSM6DSOX not found!");
-  return false;
+  // Sample at the rate the MLC program runs the accelerometer at
+  float odr = 0.0f;
+  int32_t fs = 0;
+  if (AccGyr.Get_X_ODR(&odr) != LSM6DSOX_OK || AccGyr.Get_X_FS(&fs) != LSM6DSOX_OK || odr <= 0.0f) {
+    Serial.println("LSM6DSOX accelerometer not running!");
+    return false;
+  }
+  current_odr = odr;
+  
+  Serial.print("LSM6DSOX configured by MLC program: ");
+  Serial.print(current_odr, 0);
+  Serial.print("Hz, ±");
+  Serial.print(fs);
+  Serial.println("g");
+  lsm6dsox_found = true;
+  return true;
 }
 
-bool isDataReady() {
-  uint8_t status = readRegister(LSM6DSOX_STATUS_REG);
-  return (status & 0x01);
+// INT1 carries both the batch counter and the MLC event while acquiring;
+// loop() tells them apart from the status registers
+void fifoEvent_cb() {
+  fifoEvents.push(micros());
 }
 
-bool readAcceleration(float &ax, float &ay, float &az) {
-  if (!lsm6dsox_found) return false;
-  
-  uint8_t data[6];
-  if (!readMultipleRegisters(LSM6DSOX_OUTX_L_A, data, 6)) return false;
-  
-  int16_t raw_x = (int16_t)(data[1] << 8 | data[0]);
-  int16_t raw_y = (int16_t)(data[3] << 8 | data[2]);
-  int16_t raw_z = (int16_t)(data[5] << 8 | data[4]);
-  
-  // Convert to mg (milligravity)
-  const float sensitivity_mg = 0.061035;
-  ax = raw_x * sensitivity_mg;
-  ay = raw_y * sensitivity_mg;
-  az = raw_z * sensitivity_mg;
+// Empty fifoEvents into the time of the last one; an MLC interrupt among
+// them goes to the state tracking. Returns false if none was queued.
+bool takeFifoEvents(unsigned long *event_us) {
+  bool event = false;
+  while (fifoEvents.pop(event_us)) event = true;
+  if (!event) return false;
   
+  LSM6DSOX_MLC_Status_t mlc_status;
+  if (AccGyr.Get_MLC_Status(&mlc_status) == LSM6DSOX_OK && mlc_status.is_mlc1) {
+    motionEventMicros = *event_us;
+    motionDetected = true;
+  }
   return true;
 }
 
-void writeBinaryData() {
-  // Send acceleration data as base64-encoded JSON note instead of binary storage
-  // This is simpler and more reliable than the complex binary API
-  
-  Serial.println("Encoding acceleration data as base64...");
-  
-  // Calculate total size needed
-  int total_size = collected_samples * 12;  // 3 floats * 4 bytes each
+bool windowFull() {
+  return collected_samples >= max_xl_samples || (six_axis && gyro_samples >= max_gy_samples);
+}
+
+// Move decoded records into the window; what does not fit stays in the
+// decoder rings for the next window
+void storeSamples() {
+  // Temperature first, so the samples of this burst use the latest
+  int16_t temp_raw;
+  while (fifoDecoder.temperature.pop(&temp_raw)) {
+    float temp_c = thermalRawToCelsius(temp_raw);
+    thermalComp.setTemperature(temp_c);
+    temp_sum += temp_c;
+    temp_count++;
+  }
   
-  // Create buffer with all data
-  uint8_t* all_data = (uint8_t*)malloc(total_size);
-  if (all_data == NULL) {
-    Serial.println("Failed to allocate memory for data");
-    return;
+  LSM6DSOX_FIFO_Axes_t sample;
+  while (collected_samples < max_xl_samples && fifoDecoder.xl.pop(&sample)) {
+    memcpy(&payload_samples[collected_samples * SAMPLE_BYTES], sample.axis, SAMPLE_BYTES);
+    if (sample.timestamp_us) {
+      if (!first_sample_us) {
+        first_sample_us = sample.timestamp_us;
+        first_sample_at = collected_samples;
+      }
+      last_sample_us = sample.timestamp_us;
+      last_sample_at = collected_samples;
+    }
+    
+    // Live monitoring, in mg, only while the serial port can keep up
+    if (xl_rate <= 104.0f) {
+      float mg[3];
+      thermalComp.convert(sample.axis, mg);
+      Serial.print(mg[0], 1);
+      Serial.print("\t");
+      Serial.print(mg[1], 1);
+      Serial.print("\t");
+      Serial.println(mg[2], 1);
+    }
+    
+    collected_samples++;
+    acq_xl_popped++;
   }
   
-  // Pack all samples into the buffer
-  for (int i = 0; i < collected_samples; i++) {
-    int offset = i * 12;
-    memcpy(&all_data[offset], &ax_samples[i], 4);
-    memcpy(&all_data[offset + 4], &ay_samples[i], 4);
-    memcpy(&all_data[offset + 8], &az_samples[i], 4);
+  while (gyro_samples < max_gy_samples && fifoDecoder.gy.pop(&sample)) {
+    memcpy(&payload_samples[gyro_offset + gyro_samples * SAMPLE_BYTES], sample.axis, SAMPLE_BYTES);
+    if (sample.timestamp_us) {
+      if (!gyro_first_us) {
+        gyro_first_us = sample.timestamp_us;
+        gyro_first_at = gyro_samples;
+      }
+      gyro_last_us = sample.timestamp_us;
+      gyro_last_at = gyro_samples;
+    }
+    gyro_samples++;
+    acq_gy_popped++;
   }
   
-  // Base64 encode the entire dataset
-  int encodedLen = ((total_size + 2) / 3) * 4 + 1;
-  char* encoded = (char*)malloc(encodedLen);
-  if (encoded == NULL) {
-    Serial.println("Failed to allocate memory for encoded data");
-    free(all_data);
-    return;
+  // Gap positions count from the decoder reset; make them window-relative
+  LSM6DSOX_FIFO_Gap_t gap;
+  while (fifoDecoder.gaps.pop(&gap)) {
+    lost_samples += gap.lost;
+    uint32_t at = (gap.xl_index > window_xl_base) ? gap.xl_index - window_xl_base : 0;
+    uint32_t gy_at = (gap.gy_index > window_gy_base) ? gap.gy_index - window_gy_base : 0;
+    if (at > (uint32_t)max_xl_samples || gap_count >= MAX_GAPS) continue;
+    gap_index[gap_count] = at;
+    gap_gy_index[gap_count] = (gy_at < (uint32_t)max_gy_samples) ? gy_at : max_gy_samples;
+    gap_lost[gap_count] = gap.lost;
+    gap_count++;
+    Serial.print("FIFO gap before sample ");
+    Serial.print(at);
+    Serial.print(": ");
+    Serial.print(gap.lost);
+    Serial.println(" lost");
   }
+}
+
+// Drain the FIFO in bursts, storing accelerometer (and gyroscope) words,
+// until the window is full; the rest wait in the FIFO. Returns the words read
+uint16_t drainFifo(uint16_t level) {
+  BUS_PROFILE_SCOPE("drainFifo");
+  uint16_t drained = 0;
   
-  JB64Encode(encoded, (const char*)all_data, total_size);
+  storeSamples();
+  while (drained < level && !windowFull()) {
+    // No burst larger than the rings can take, so nothing is dropped
+    uint16_t count = level - drained;
+    if (count > LSM6DSOX_FIFO_BURST_WORDS) count = LSM6DSOX_FIFO_BURST_WORDS;
+    if (count > fifoDecoder.xl.space()) count = fifoDecoder.xl.space();
+    if (count > fifoDecoder.gy.space()) count = fifoDecoder.gy.space();
+    if (count == 0) break;
+    
+    int32_t received = fifoDecoder.drain(count);
+    if (received <= 0) break;
+    drained += received;
+    storeSamples();
+    
+    if (received < count) break;
+  }
   
-  // Send as regular JSON note with base64 data
+  return drained;
+}
+
+// The sensors.qo note for the session, all but its records: base64 in
+// the body's "data", or else the note's binary payload
+J *newSensorsNote(int format) {
   J *req = notecard.newRequest("note.add");
   JAddStringToObject(req, "file", "sensors.qo");
   JAddBoolToObject(req, "sync", true);
   
   J *body = JAddObjectToObject(req, "body");
   if (body) {
-    JAddStringToObject(body, "data", encoded);
     JAddNumberToObject(body, "samples", collected_samples);
-    JAddNumberToObject(body, "format", 1);  // 1 = float32 ax,ay,az format
-    JAddNumberToObject(body, "rate_hz", current_odr);
+    // 2 = int16 ax,ay,az records, then int16 gx,gy,gz records (gyro_samples);
+    // 3 = the same records delta/zigzag/varint coded (see SampleCodec.h)
+    JAddNumberToObject(body, "format", format);
+    JAddNumberToObject(body, "fs_g", fifo_fs_g);
+    JAddNumberToObject(body, "mg_per_lsb", fifo_sensitivity_mg);
+    JAddNumberToObject(body, "gyro_samples", gyro_samples);
+    if (six_axis) {
+      JAddNumberToObject(body, "fs_dps", gyro_fs_dps);
+      JAddNumberToObject(body, "mdps_per_lsb", gyro_sensitivity_mdps);
+      JAddNumberToObject(body, "gyro_rate_hz", gyro_rate);
+      if (gyro_first_us) {
+        JAddNumberToObject(body, "gyro_t0_us", (double)gyro_first_us);
+        JAddNumberToObject(body, "gyro_t0_at", gyro_first_at);
+        JAddNumberToObject(body, "gyro_t1_us", (double)gyro_last_us);
+        JAddNumberToObject(body, "gyro_t1_at", gyro_last_at);
+      }
+    }
+    JAddNumberToObject(body, "rate_hz", xl_rate);
+    if (temp_count > 0) {
+      JAddNumberToObject(body, "temp_c", temp_sum / temp_count);
+    }
+    const ThermalCal *cal = thermalComp.calibration();
+    if (cal) {
+      // Thermal model ("t0,ox,oy,oz,tx,ty,tz,sx,sy,sz", see ThermalComp.h)
+      // for the host to apply at temp_c when converting to mg
+      char tcal[128];
+      thermalCalFormat(cal, tcal, sizeof(tcal));
+      JAddStringToObject(body, "tcal", tcal);
+    }
+    JAddNumberToObject(body, "rate_eff_hz", effective_odr);
     JAddNumberToObject(body, "duration_ms", logging_duration);
     JAddNumberToObject(body, "timestamp", millis());
+    if (first_sample_us) {
+      // Sensor timestamp counter at records t0_at and t1_at, the first and
+      // last with a known time
+      JAddNumberToObject(body, "t0_us", (double)first_sample_us);
+      JAddNumberToObject(body, "t0_at", first_sample_at);
+      JAddNumberToObject(body, "t1_us", (double)last_sample_us);
+      JAddNumberToObject(body, "t1_at", last_sample_at);
+    }
+    
+    // Gap records: samples lost before stored sample "at" (lost 0: unknown)
+    JAddNumberToObject(body, "lost_samples", lost_samples);
+    JAddNumberToObject(body, "overruns", fifoDecoder.overruns);
+    JAddNumberToObject(body, "fifo_peak", fifo_peak_level);
+    if (gap_count > 0) {
+      J *gaps = JAddArrayToObject(body, "gaps");
+      if (gaps) {
+        for (int i = 0; i < gap_count; i++) {
+          J *gap = JCreateObject();
+          if (gap) {
+            JAddNumberToObject(gap, "at", gap_index[i]);
+            if (six_axis) JAddNumberToObject(gap, "gy_at", gap_gy_index[i]);
+            JAddNumberToObject(gap, "lost", gap_lost[i]);
+            JAddItemToArray(gaps, gap);
+          }
+        }
+      }
+    }
   }
+  return req;
+}
+
+void writeBinaryData() {
+  // The records go out as the note's binary payload (see NoteBinary.h), or
+  // base64-encoded in its body when the Notecard has no binary support.
+  // Either way the layout below is ready for base64 in place, which
+  // consumes the samples, so the session is sent once.
+  int raw_size = (collected_samples + gyro_samples) * SAMPLE_BYTES;
+  int total_size = raw_size;
+  uint8_t *data = payload_samples;
+  int format = 2;
   
-  bool success = notecard.sendRequest(req);
+  // Delta coding, when smaller, runs in place too: from the tail to the
+  // front of the payload, both record runs into one stream
+  if (delta_codec) {
+    unsigned long enc_start = micros();
+    size_t xl_lead = 0, gy_lead = 0;
+    size_t xl_size = sampleCodecMeasure(payload_samples, collected_samples, &xl_lead);
+    size_t gy_size = six_axis ? sampleCodecMeasure(&payload_samples[gyro_offset], gyro_samples, &gy_lead) : 0;
+    size_t gy_room = PAYLOAD_RAW_OFFSET + gyro_offset - xl_size;
+    
+    if (xl_size + gy_size < (size_t)raw_size && xl_lead <= PAYLOAD_RAW_OFFSET && gy_lead <= gy_room) {
+      uint8_t *out = (uint8_t *)payload;
+      size_t n = sampleCodecEncode(payload_samples, collected_samples, out);
+      if (six_axis) n += sampleCodecEncode(&payload_samples[gyro_offset], gyro_samples, &out[n]);
+      
+      // Base64 in place needs its input a third of its length further on
+      data = &out[(n + 2) / 3 + 1];
+      memmove(data, out, n);
+      total_size = n;
+      format = 3;
+      
+      Serial.print("Delta coded ");
+      Serial.print(raw_size);
+      Serial.print(" -> ");
+      Serial.print(total_size);
+      Serial.print(" bytes in ");
+      Serial.print(micros() - enc_start);
+      Serial.println(" us");
+    }
+  }
+  if (format == 2 && six_axis) {
+    // Close up the unused end of the accelerometer area
+    memmove(&payload_samples[collected_samples * SAMPLE_BYTES], &payload_samples[gyro_offset],
+            gyro_samples * SAMPLE_BYTES);
+  }
+  
+  // Once notes are queued in flash, this one goes behind them
+  bool queued = spillPending() > 0;
+  bool binary = !queued && binary_transport && noteBinaryBegin(total_size) && noteBinaryAppend(data, total_size);
+  bool success = false;
+  if (binary) {
+    success = noteBinaryAdd(newSensorsNote(format));
+  } else if (!queued) {
+    Serial.println("Encoding acceleration data as base64...");
+    JB64Encode(payload, (const char*)data, total_size);
+    J *req = newSensorsNote(format);
+    JAddStringToObject(JGetObjectItem(req, "body"), "data", payload);
+    success = notecard.sendRequest(req);
+  }
   
   if (success) {
     Serial.print("Successfully sent ");
     Serial.print(collected_samples);
-    Serial.println(" samples as base64 JSON note");
-  } else {
-    Serial.println("Failed to send data note");
+    Serial.println(binary ? " samples as binary note" : " samples as base64 JSON note");
+    return;
   }
   
-  // Clean up
-  free(all_data);
-  free(encoded);
+  // Keep the note in flash until the Notecard takes notes again. Base64
+  // in place has used up the records, so such a note keeps its "data".
+  bool spilled;
+  J *req = newSensorsNote(format);
+  if (binary || queued) {
+    spilled = spillBegin(req, total_size) && spillAppend(data, total_size) && spillEnd();
+  } else {
+    JAddStringToObject(JGetObjectItem(req, "body"), "data", payload);
+    spilled = spillBegin(req, 0) && spillEnd();
+  }
+  JDelete(req);
+  Serial.println(spilled ? "Data note queued in flash" : "Failed to send data note");
 }
 
 void sendSamplesToCloud() {
@@ -190,13 +442,314 @@ void sendSamplesToCloud() {
     return;
   }
   
-  Serial.println("Sending samples to cloud as JSON note...");
+  Serial.println("Sending samples to cloud as a sensors.qo note...");
   
-  // Send data using the simpler JSON approach
+  // Format 2 records, or format 3 when delta coding is smaller, in the
+  // note's card.binary payload or base64 in its body; queued in flash if
+  // the Notecard refuses the note
   writeBinaryData();
 }
 
-void log() {
+// Event capture: between logging sessions the FIFO runs in STREAM_TO_FIFO
+// mode, keeping the last FIFO_DEPTH_WORDS words without any bus traffic.
+// The MLC interrupt switches it to FIFO mode, freezing that pre-trigger
+// window; the MCU drains it, then drains on batch counter interrupts while
+// the FIFO collects the post-trigger samples, and re-arms.
+void armCapture() {
+  float odr = (capture_odr > current_odr) ? capture_odr : current_odr;
+  
+  AccGyr.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);   // empty the FIFO, clear the trigger
+  AccGyr.Set_X_ODR(odr);
+  AccGyr.Enable_X();
+  AccGyr.Get_X_ODR(&odr);
+  fifoDecoder.reset();
+  fifoDecoder.set_slot_rate(odr);
+  AccGyr.Set_FIFO_X_BDR(odr);
+  AccGyr.Set_FIFO_Timestamp_Decimation(LSM6DSOX_DEC_8);
+  AccGyr.Set_FIFO_Mode(LSM6DSOX_STREAM_TO_FIFO_MODE);
+  
+  capture = NULL;
+  captureEvent = -1;
+  captureMotionMicros = motionEventMicros;
+  captureState = CAPTURE_ARMED;
+}
+
+// Sort drained samples into the pre-trigger ring or the post-trigger window.
+// Samples before the first TIMESTAMP word are the oldest, so pre-trigger;
+// after a gap they read 0 again but follow the trigger.
+void storeCaptureSamples() {
+  LSM6DSOX_FIFO_Axes_t sample;
+  while (fifoDecoder.xl.pop(&sample)) {
+    bool post = (sample.timestamp_us == 0) ? captureStamped : sample.timestamp_us >= captureTriggerUs;
+    if (sample.timestamp_us) captureStamped = true;
+    
+    if (!post) {
+      uint16_t slot = capturePreHead % CAPTURE_PRE_SAMPLES;
+      memcpy(capturePre[slot], sample.axis, sizeof(sample.axis));
+      capturePreUs[slot] = sample.timestamp_us;
+      capturePreHead++;
+    } else if (capture->post < CAPTURE_POST_SAMPLES) {
+      memcpy(capture->xyz[CAPTURE_PRE_SAMPLES + capture->post], sample.axis, sizeof(sample.axis));
+      if (sample.timestamp_us && !capturePostUs) {
+        capturePostUs = sample.timestamp_us;
+        capturePostAt = capture->post;
+      }
+      capture->post++;
+    }
+  }
+  
+  LSM6DSOX_FIFO_Gap_t gap;
+  while (fifoDecoder.gaps.pop(&gap)) {
+    capture->lost += gap.lost;
+  }
+}
+
+// Returns true if the capture was attached to its event
+bool finishCapture() {
+  // Oldest pre-trigger sample first, then the post-trigger window after it
+  uint16_t pre = (capturePreHead < CAPTURE_PRE_SAMPLES) ? capturePreHead : CAPTURE_PRE_SAMPLES;
+  uint16_t first = (uint16_t)(capturePreHead - pre);
+  for (uint16_t i = 0; i < pre; i++) {
+    memcpy(capture->xyz[i], capturePre[(first + i) % CAPTURE_PRE_SAMPLES], sizeof(capture->xyz[i]));
+  }
+  memmove(capture->xyz[pre], capture->xyz[CAPTURE_PRE_SAMPLES], capture->post * sizeof(capture->xyz[0]));
+  capture->pre = pre;
+  
+  // Samples before the first TIMESTAMP word have no time: use the first
+  // that does
+  capture->t0_us = 0;
+  capture->t0_at = 0;
+  for (uint16_t i = 0; i < pre && !capture->t0_us; i++) {
+    capture->t0_us = capturePreUs[(first + i) % CAPTURE_PRE_SAMPLES];
+    capture->t0_at = i;
+  }
+  if (!capture->t0_us && capturePostUs) {
+    capture->t0_us = capturePostUs;
+    capture->t0_at = pre + capturePostAt;
+  }
+  
+  // The event may have been sent while the window was filling
+  if (captureEvent < eventCount && stateEvents[captureEvent].sensorTimeUs == captureTriggerUs &&
+      stateEvents[captureEvent].capture < 0) {
+    stateEvents[captureEvent].capture = (int)(capture - eventCaptures);
+    Serial.print("Captured ");
+    Serial.print(capture->pre);
+    Serial.print(" + ");
+    Serial.print(capture->post);
+    Serial.print(" samples around event ");
+    Serial.print(captureEvent);
+    Serial.print(", ");
+    Serial.print(capture->lost);
+    Serial.println(" lost");
+    return true;
+  }
+  capture->used = false;
+  return false;
+}
+
+// Drain what the FIFO holds into the capture
+void drainCapture() {
+  uint16_t level = 0;
+  uint8_t flags = 0;
+  if (AccGyr.Get_FIFO_Status(&level, &flags) != LSM6DSOX_OK) return;
+  
+  // FIFO mode stops collecting once full: after these words comes a gap
+  while (level > 0) {
+    uint16_t count = (level > LSM6DSOX_FIFO_BURST_WORDS) ? LSM6DSOX_FIFO_BURST_WORDS : level;
+    int32_t received = fifoDecoder.drain(count);
+    if (received <= 0) break;
+    storeCaptureSamples();
+    level -= received;
+  }
+  if (flags & LSM6DSOX_FIFO_FLAG_FULL) {
+    fifoDecoder.mark_gap();
+  }
+}
+
+void startCapture(int event) {
+  capture = NULL;
+  for (int i = 0; i < MAX_EVENT_CAPTURES; i++) {
+    if (!eventCaptures[i].used) {
+      capture = &eventCaptures[i];
+      break;
+    }
+  }
+  if (capture == NULL) {
+    capturesDropped++;
+    Serial.print("No free capture buffer, event not captured (");
+    Serial.print(capturesDropped);
+    Serial.println(" dropped)");
+    armCapture();
+    return;
+  }
+  
+  capture->used = true;
+  capture->pre = 0;
+  capture->post = 0;
+  capture->lost = 0;
+  capture->t0_us = 0;
+  AccGyr.Get_X_ODR(&capture->rate_hz);
+  AccGyr.Get_X_Sensitivity(&capture->mg_per_lsb);
+  captureEvent = event;
+  captureTriggerUs = stateEvents[event].sensorTimeUs;
+  captureStart = millis();
+  captureStamped = false;
+  capturePreHead = 0;
+  capturePostUs = 0;
+  capturePostAt = 0;
+  captureState = CAPTURE_POST;
+  
+  // The post-trigger samples raise INT1 in batches, as in acquisition
+  uint16_t batch = (uint16_t)(capture->rate_hz * FIFO_DRAIN_MS / 1000.0f);
+  if (batch < 1) batch = 1;
+  AccGyr.Set_FIFO_Batch_Counter_Event(LSM6DSOX_XL_BATCH_EVENT);
+  AccGyr.Set_FIFO_Batch_Counter_Threshold(batch);
+  AccGyr.Reset_FIFO_Batch_Counter();
+  AccGyr.Set_FIFO_INT1_Batch_Counter(1);
+  fifoEvents.clear();
+  attachInterrupt(INT_1, fifoEvent_cb, RISING);
+  
+  // The pre-trigger window is already waiting
+  drainCapture();
+}
+
+// Called from loop() with the index of a newly stored state event, or -1
+void serviceCapture(int newEvent) {
+  if (captureState == CAPTURE_ARMED) {
+    if (newEvent >= 0) {
+      startCapture(newEvent);
+    } else if (motionEventMicros != captureMotionMicros) {
+      // An MLC interrupt without a state change froze the FIFO too
+      armCapture();
+    }
+    return;
+  }
+  if (captureState != CAPTURE_POST) return;
+  
+  unsigned long event_us = 0;
+  if (takeFifoEvents(&event_us)) drainCapture();
+  
+  unsigned long window_ms = (unsigned long)(2000.0f * CAPTURE_POST_SAMPLES / capture->rate_hz) + 1000UL;
+  if (capture->post >= CAPTURE_POST_SAMPLES || millis() - captureStart > window_ms) {
+    // INT1 back to the MLC alone
+    AccGyr.Set_FIFO_INT1_Batch_Counter(0);
+    attachInterrupt(INT_1, INT1Event_cb, RISING);
+    bool captured = finishCapture();
+    armCapture();
+    
+    // Captures wait for the 5-minute send unless that would leave the next
+    // event without a buffer
+    if (captured && captureBuffersFull()) queueStateChanges();
+  }
+}
+
+// Batch acquisition: the accelerometer fills the FIFO in STREAM mode and
+// the sensor's batch counter raises INT1 every N accelerometer samples,
+// whatever else is batched; the ISR only queues its time and loop() drains
+// the FIFO in bursts, so no sample depends on polling latency. While a
+// window's note is being sent the FIFO keeps collecting, and the next
+// window continues from where the last one stopped.
+void startAcquisition() {
+  // The FIFO is shared with event capture: let one in progress finish
+  captureState = CAPTURE_OFF;
+  
+  // Optionally run faster than the MLC program; the MLC keeps its own rate
+  acq_mlc_odr = current_odr;
+  AccGyr.Set_X_ODR((requested_odr > 0.0f) ? requested_odr : current_odr);
+  AccGyr.Enable_X();
+  AccGyr.Get_X_ODR(&current_odr);
+  AccGyr.Get_X_Sensitivity(&fifo_sensitivity_mg);
+  AccGyr.Get_X_FS(&fifo_fs_g);
+  thermalComp.setSensitivity(fifo_sensitivity_mg);
+  
+  // One register read to start from; the FIFO keeps it current after that
+  int16_t temp_raw = 0;
+  if (AccGyr.Get_Temperature_Raw(&temp_raw) == LSM6DSOX_OK) {
+    thermalComp.setTemperature(thermalRawToCelsius(temp_raw));
+  }
+  
+  // 7-byte words at 6667 Hz exceed 400 kHz I2C; the sensor supports Fm+
+  if (current_odr > 3333.0f) Wire.setClock(1000000);
+  
+  AccGyr.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);   // empty the FIFO
+  fifoDecoder.reset();
+  acq_xl_popped = 0;
+  acq_gy_popped = 0;
+  
+  // Batch rates, each at most the ODR. The gyroscope, unless the MLC
+  // program already runs it, is started at the accelerometer's ODR so both
+  // are sampled on the same time slots.
+  float xl_bdr = (accel_bdr > 0.0f && accel_bdr < current_odr) ? accel_bdr : current_odr;
+  AccGyr.Set_FIFO_X_BDR(xl_bdr);
+  AccGyr.Get_FIFO_X_BDR(&xl_rate);
+  six_axis = gyro_bdr > 0.0f;
+  gyro_rate = 0.0f;
+  float gyro_odr = 0.0f;
+  AccGyr.Get_G_ODR(&gyro_odr);
+  acq_gyro_started = six_axis && gyro_odr <= 0.0f;
+  if (acq_gyro_started) {
+    AccGyr.Set_G_ODR(current_odr);
+    AccGyr.Enable_G();
+  }
+  if (six_axis) {
+    AccGyr.Get_G_Sensitivity(&gyro_sensitivity_mdps);
+    AccGyr.Get_G_FS(&gyro_fs_dps);
+    AccGyr.Set_FIFO_G_BDR((gyro_bdr < current_odr) ? gyro_bdr : current_odr);
+    AccGyr.Get_FIFO_G_BDR(&gyro_rate);
+    
+    max_xl_samples = (int)(MAX_SAMPLES * xl_rate / (xl_rate + gyro_rate));
+    max_gy_samples = MAX_SAMPLES - max_xl_samples;
+    gyro_offset = max_xl_samples * SAMPLE_BYTES;
+  } else {
+    max_xl_samples = MAX_SAMPLES;
+    max_gy_samples = 0;
+  }
+  
+  fifoDecoder.set_slot_rate((gyro_rate > xl_rate) ? gyro_rate : xl_rate);
+  
+  // Accelerometer samples per drain; the words batched with them must
+  // leave FIFO headroom
+  float words_per_sample = FIFO_WORDS_PER_SAMPLE + gyro_rate / xl_rate;
+  uint16_t batch = (uint16_t)(xl_rate * FIFO_DRAIN_MS / 1000.0f);
+  uint16_t batch_max = (uint16_t)(FIFO_DEPTH_WORDS / 2 / words_per_sample);
+  if (batch < 1) batch = 1;
+  if (batch > batch_max) batch = batch_max;
+  acq_batch = batch;
+  
+  AccGyr.Set_FIFO_Timestamp_Decimation(LSM6DSOX_DEC_8);
+  AccGyr.Set_FIFO_T_BDR(FIFO_TEMP_BDR);
+  AccGyr.Set_FIFO_Batch_Counter_Event(LSM6DSOX_XL_BATCH_EVENT);
+  AccGyr.Set_FIFO_Batch_Counter_Threshold(batch);
+  AccGyr.Reset_FIFO_Batch_Counter();
+  AccGyr.Set_FIFO_INT1_Batch_Counter(1);
+  fifoEvents.clear();
+  attachInterrupt(INT_1, fifoEvent_cb, RISING);
+  AccGyr.Set_FIFO_Mode(LSM6DSOX_STREAM_MODE);
+  
+  acquiring = true;
+  acq_started = true;
+}
+
+void stopAcquisition() {
+  // The counter has no enable bit: unrouted and with nothing batched it is
+  // idle, and its 1..2047 threshold stays as set
+  AccGyr.Set_FIFO_INT1_Batch_Counter(0);
+  AccGyr.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);
+  AccGyr.Set_FIFO_X_BDR(0);
+  AccGyr.Set_FIFO_G_BDR(0);
+  AccGyr.Set_FIFO_T_BDR(0);
+  AccGyr.Set_FIFO_Timestamp_Decimation(LSM6DSOX_NO_DECIMATION);
+  if (acq_gyro_started) AccGyr.Disable_G();
+  attachInterrupt(INT_1, INT1Event_cb, RISING);
+  
+  if (current_odr > 3333.0f) Wire.setClock(400000);
+  AccGyr.Set_X_ODR(acq_mlc_odr);
+  current_odr = acq_mlc_odr;
+  
+  acquiring = false;
+}
+
+void startWindow() {
   Serial.println("A_X [mg]\tA_Y [mg]\tA_Z [mg]");
   Serial.print("Logging for ");
   Serial.print(logging_duration / 1000);
@@ -206,32 +759,43 @@ void log() {
   
   // Reset sample collection
   collected_samples = 0;
+  gyro_samples = 0;
+  effective_odr = 0.0f;
+  first_sample_us = 0;
+  last_sample_us = 0;
+  first_sample_at = 0;
+  last_sample_at = 0;
+  gyro_first_us = 0;
+  gyro_last_us = 0;
+  gyro_first_at = 0;
+  gyro_last_at = 0;
+  gap_count = 0;
+  lost_samples = 0;
+  fifo_peak_level = 0;
+  temp_sum = 0.0f;
+  temp_count = 0;
+  fifoDecoder.overruns = 0;
+  window_xl_base = acq_xl_popped;
+  window_gy_base = acq_gy_popped;
+  rate_valid = false;
   
-  unsigned long start_time = millis();
-  unsigned long last_sample = 0;
-  
-  while (millis() - start_time < logging_duration && collected_samples < MAX_SAMPLES) {
-    if (millis() - last_sample >= sample_interval_ms) {
-      if (isDataReady()) {
-        float ax, ay, az;
-        if (readAcceleration(ax, ay, az)) {
-          // Store the sample in arrays
-          ax_samples[collected_samples] = ax;
-          ay_samples[collected_samples] = ay;
-          az_samples[collected_samples] = az;
-          
-          // Also print to serial for monitoring
-          Serial.print(ax, 1);
-          Serial.print("\t");
-          Serial.print(ay, 1);
-          Serial.print("\t");
-          Serial.println(az, 1);
-          
-          collected_samples++;
-        }
-      }
-      last_sample = millis();
-    }
+  windowStart = millis();
+}
+
+void finishWindow() {
+  // Words lost after the last drain are never read; count the overrun only
+  uint16_t level = 0;
+  uint8_t flags = 0;
+  if (AccGyr.Get_FIFO_Status(&level, &flags) == LSM6DSOX_OK &&
+      (flags & (LSM6DSOX_FIFO_FLAG_OVR | LSM6DSOX_FIFO_FLAG_OVR_LATCHED))) {
+    fifoDecoder.mark_gap();
+  }
+  
+  // Each batch counter interrupt marks exactly acq_batch more samples
+  if (rate_valid && rate_k1 > rate_k0 && rate_us1 != rate_us0) {
+    effective_odr = (float)(rate_k1 - rate_k0) * acq_batch * 1000000.0f / (float)(rate_us1 - rate_us0);
+  } else {
+    effective_odr = xl_rate;
   }
   
   digitalWrite(LED_BUILTIN, LOW);
@@ -239,12 +803,119 @@ void log() {
   Serial.println("Logging completed!");
   Serial.print("Total samples collected: ");
   Serial.println(collected_samples);
+  if (six_axis) {
+    Serial.print("Gyroscope samples collected: ");
+    Serial.println(gyro_samples);
+  }
   Serial.print("Actual rate: ");
-  Serial.print((float)collected_samples * 1000.0 / logging_duration, 2);
+  Serial.print(effective_odr, 2);
   Serial.println(" Hz");
+  if (last_sample_at > first_sample_at) {
+    Serial.print("Sensor time span: ");
+    Serial.print((unsigned long)(last_sample_us - first_sample_us));
+    Serial.print(" us over samples ");
+    Serial.print(first_sample_at);
+    Serial.print("-");
+    Serial.println(last_sample_at);
+  }
+  if (fifoDecoder.overruns) {
+    Serial.print("Warning: ");
+    Serial.print(fifoDecoder.overruns);
+    Serial.print(" FIFO overrun(s), ");
+    Serial.print(lost_samples);
+    Serial.print(" samples lost, peak level ");
+    Serial.print(fifo_peak_level);
+    Serial.print("/");
+    Serial.println(FIFO_DEPTH_WORDS);
+  }
   
   // Send all samples as a single note (1 credit)
   sendSamplesToCloud();
+  
+  // Always-on keeps the FIFO streaming; otherwise capture events until
+  // the next window
+  if (acq_period_ms == 0) {
+    startWindow();
+  } else {
+    stopAcquisition();
+    armCapture();
+  }
+}
+
+// Called from loop(): starts windows when due and drains the FIFO on the
+// batch counter interrupts queued since the last call
+void serviceAcquisition() {
+  if (!acquiring) {
+    if (captureState == CAPTURE_POST) return;
+    if (acq_started && millis() - windowStart < acq_period_ms) return;
+    startAcquisition();
+    startWindow();
+    return;
+  }
+  
+  unsigned long event_us = 0;
+  if (takeFifoEvents(&event_us)) {
+    uint16_t level = 0;
+    uint8_t flags = 0;
+    if (AccGyr.Get_FIFO_Status(&level, &flags) == LSM6DSOX_OK) {
+      // An overrun dropped the oldest words: what follows is after a gap,
+      // and the batch count no longer matches the samples decoded
+      if (flags & (LSM6DSOX_FIFO_FLAG_OVR | LSM6DSOX_FIFO_FLAG_OVR_LATCHED)) {
+        fifoDecoder.mark_gap();
+        rate_valid = false;
+      }
+      if (flags & LSM6DSOX_FIFO_FLAG_COUNTER_BDR) {
+        if (level > fifo_peak_level) fifo_peak_level = level;
+        
+        // Drained up to the interrupt, the samples decoded since the
+        // counter reset give its event count, unless another came since
+        if (drainFifo(level) == level && fifoEvents.available() == 0) {
+          uint32_t k = (acq_xl_popped + fifoDecoder.xl.available()) / acq_batch;
+          if (!rate_valid) {
+            rate_k0 = k;
+            rate_us0 = event_us;
+            rate_valid = true;
+          }
+          rate_k1 = k;
+          rate_us1 = event_us;
+        }
+      }
+    }
+  }
+  
+  if (windowFull() || millis() - windowStart >= logging_duration) {
+    finishWindow();
+    // Records held back while the window was full start the next one
+    if (acquiring) drainFifo(0);
+  }
+}
+
+// Thermal calibration: the copy kept in flash, replaced when the Notehub
+// environment variable accel_tcal holds a different one
+void loadThermalCalibration() {
+  ThermalCal cal;
+  bool have_cal = thermalCalLoad(&cal);
+  
+  J *req = notecard.newRequest("env.get");
+  if (req != NULL) {
+    JAddStringToObject(req, "name", "accel_tcal");
+    J *rsp = notecard.requestAndResponse(req);
+    ThermalCal env_cal;
+    if (rsp != NULL && thermalCalParse(JGetString(rsp, "text"), &env_cal) &&
+        (!have_cal || memcmp(&env_cal, &cal, sizeof(cal)) != 0)) {
+      cal = env_cal;
+      have_cal = true;  // used for this run even if it cannot be stored
+      if (thermalCalSave(&cal)) {
+        Serial.println("Thermal calibration updated");
+      } else {
+        Serial.println("Failed to store thermal calibration");
+      }
+    }
+    notecard.deleteResponse(rsp);
+  }
+  
+  thermalComp.setCalibration(have_cal ? &cal : NULL);
+  Serial.println(have_cal ? "Thermal compensation active" : "No thermal calibration");
 }
 
 void setup() {
@@ -264,6 +935,9 @@ void setup() {
     }
   }
   
+  // Notes left in flash by an earlier run go out first
+  spillInit();
+  
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, LOW);
   
@@ -273,13 +947,17 @@ void setup() {
   Wire.begin();
   Wire.setClock(400000);
   
+#ifdef LSM6DSOX_BUS_PROFILE
+  busProfileBegin();
+#endif
+
   // Initialize sensor with MLC
   setupLSM6DSOX();
   
   // Initialize state change tracking
   lastTransmission = millis();
   
-  // Initialize regular acceleration readings (restore original functionality)
+  // Acceleration readings share the MLC's configuration
   if (!initLSM6DSOX()) {
     Serial.println("ERROR: Failed to initialize LSM6DSOX for acceleration readings!");
     while(1) {
@@ -288,34 +966,66 @@ void setup() {
     }
   }
   
-  // Calculate sample interval
-  sample_interval_ms = (unsigned long)(1000.0f / current_odr);
+  loadThermalCalibration();
   
   Serial.print("Max samples per session: ");
   Serial.println(MAX_SAMPLES);
   Serial.println("Ready to start logging...");
   Serial.println("MLC state detection active - move sensor to see state changes");
   delay(2000);
-  log();
+
+#ifdef LSM6DSOX_BUS_PROFILE
+  busProfileDump(Serial);
+#endif
 }
 
 void loop() {
   // Check for interrupt-based state changes and store them
-  checkAndStoreStateChanges();
+  int newEvent = checkAndStoreStateChanges();
+  
+  // Collect the raw window around a new state change
+  serviceCapture(newEvent);
+  
+  // Periodic (or continuous) sample windows, sent as sensors.qo notes
+  serviceAcquisition();
   
   // Check if it's time to send state changes (every 5 minutes)
   checkStateTransmissionTimer();
   
+  // Notes queued in flash, oldest first, once the Notecard takes them again
+  spillService(binary_transport);
+  
   // Debug: Print current status occasionally
   static unsigned long lastDebug = 0;
   if (millis() - lastDebug > 10000) { // Every 10 seconds
     Serial.print("MLC State: ");
     Serial.print(getRawState());
     Serial.print(" | State events stored: ");
-    Serial.println(eventCount);
+    Serial.print(eventCount);
+    Serial.print(" | Notes in flash: ");
+    Serial.println(spillPending());
     lastDebug = millis();
+    
+    // Keep the 64-bit timestamp within half a counter period (14.9 h)
+    uint64_t ticks;
+    sensorClock.read(&AccGyr, &ticks);
   }
+
+#ifdef LSM6DSOX_BUS_PROFILE
+  // Bus profile every 5 minutes
+  static unsigned long lastProfileDump = 0;
+  if (millis() - lastProfileDump >= 5UL * 60UL * 1000UL) {
+    busProfileDump(Serial);
+    lastProfileDump = millis();
+  }
+#endif
   
-  // Small delay for system stability
-  delay(10);
+  // Sleep until INT1 or the next SysTick, unless work is waiting: batch
+  // counter events (acquisition or a capture window), an MLC event, or a
+  // note in flash to send
+  noInterrupts();
+  if (fifoEvents.available() == 0 && !motionDetected && !spillDue()) {
+    __WFI();
+  }
+  interrupts();
 }
\ No newline at end of file
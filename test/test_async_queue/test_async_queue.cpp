@@ -0,0 +1,206 @@
+/**
+ * @file    test_async_queue.cpp
+ * @brief   LSM6DSOXAsyncQueue semantics on the host Wire back end.
+ *
+ * On the host, transfers run in the background on the Wire model's clock
+ * the way HAL I2C DMA transfers do on the Cygnet, so the queue behaves as
+ * on the target: submit() returns at once, transfers run back to back,
+ * and callbacks arrive from service(), in submission order.
+ */
+
+#include <unity.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "LSM6DSOXAsync.h"
+#include "LSM6DSOXSim.h"
+#include "LSM6DSOXSimBus.h"
+
+#define TEST_ADDRESS (LSM6DSOX_I2C_ADD_L >> 1)
+#define TEST_NO_DEVICE 0x10
+
+static LSM6DSOXSim sim;
+static LSM6DSOXSimBus simBus(&sim);
+
+static void simTick(void *arg, uint64_t now_us)
+{
+  (void)arg;
+  sim.advanceTo(now_us * 1000ULL);
+}
+
+/* Completions in the order they were delivered */
+struct Delivery
+{
+  int count;
+  int order[LSM6DSOX_ASYNC_QUEUE_DEPTH + 1];
+  int32_t status[LSM6DSOX_ASYNC_QUEUE_DEPTH + 1];
+  uint16_t len[LSM6DSOX_ASYNC_QUEUE_DEPTH + 1];
+};
+
+static Delivery delivered;
+static int tags[LSM6DSOX_ASYNC_QUEUE_DEPTH + 1];
+
+static void onDone(void *arg, int32_t status, uint8_t *data, uint16_t len)
+{
+  (void)data;
+  int i = delivered.count++;
+  delivered.order[i] = *(int *)arg;
+  delivered.status[i] = status;
+  delivered.len[i] = len;
+}
+
+static void resetDeliveries()
+{
+  memset(&delivered, 0, sizeof(delivered));
+  for (int i = 0; i <= LSM6DSOX_ASYNC_QUEUE_DEPTH; i++) {
+    tags[i] = i;
+  }
+  sim.reset();
+}
+
+static void test_callbacks_wait_for_service_in_order()
+{
+  lsm6dsox_ctx_t ctx;
+  LSM6DSOXSim_ctx_init(&ctx, &sim);
+  LSM6DSOXAsyncQueue queue(&Wire, TEST_ADDRESS, &ctx);
+  uint8_t watermark = 0x5A;
+  uint8_t who = 0;
+  uint8_t readback = 0;
+
+  resetDeliveries();
+  TEST_ASSERT_EQUAL(0, queue.begin());
+
+  uint64_t submitted_us = hostMicros64();
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_FIFO_CTRL1, &watermark, 1, true, onDone, &tags[0]));
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_WHO_AM_I, &who, 1, false, onDone, &tags[1]));
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_FIFO_CTRL1, &readback, 1, false, onDone, &tags[2]));
+
+  /* Queued without waiting out the three transfers' wire time */
+  TEST_ASSERT_TRUE(hostMicros64() - submitted_us < 10);
+  TEST_ASSERT_TRUE(queue.transferring());
+  TEST_ASSERT_EQUAL(3, queue.pending());
+  TEST_ASSERT_EQUAL(0, delivered.count);
+
+  /* Done on the bus, but nothing is delivered outside service() */
+  delay(5);
+  TEST_ASSERT_FALSE(queue.transferring());
+  TEST_ASSERT_EQUAL(3, queue.pending());
+  TEST_ASSERT_EQUAL(0, delivered.count);
+  TEST_ASSERT_EQUAL_HEX8(LSM6DSOX_ID, who);
+
+  queue.service();
+  TEST_ASSERT_EQUAL(0, queue.pending());
+  TEST_ASSERT_EQUAL(3, delivered.count);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(i, delivered.order[i]);
+    TEST_ASSERT_EQUAL(0, delivered.status[i]);
+    TEST_ASSERT_EQUAL(1, delivered.len[i]);
+  }
+
+  /* The write went out before the read queued after it */
+  TEST_ASSERT_EQUAL_HEX8(0x5A, readback);
+  TEST_ASSERT_EQUAL_HEX8(0x5A, sim.peekUser(LSM6DSOX_FIFO_CTRL1));
+}
+
+static void test_full_queue_refuses_until_serviced()
+{
+  lsm6dsox_ctx_t ctx;
+  LSM6DSOXSim_ctx_init(&ctx, &sim);
+  LSM6DSOXAsyncQueue queue(&Wire, TEST_ADDRESS, &ctx);
+  uint8_t data[LSM6DSOX_ASYNC_QUEUE_DEPTH + 1][7];
+
+  resetDeliveries();
+  queue.begin();
+
+  for (int i = 0; i < LSM6DSOX_ASYNC_QUEUE_DEPTH; i++) {
+    TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_WHO_AM_I, data[i], 1, false, onDone, &tags[i]));
+  }
+  TEST_ASSERT_EQUAL(-1, queue.submit(LSM6DSOX_WHO_AM_I, data[LSM6DSOX_ASYNC_QUEUE_DEPTH], 1, false,
+                                     onDone, &tags[LSM6DSOX_ASYNC_QUEUE_DEPTH]));
+
+  /* Completed transfers hold their slots until delivered */
+  delay(10);
+  TEST_ASSERT_EQUAL(-1, queue.submit(LSM6DSOX_WHO_AM_I, data[LSM6DSOX_ASYNC_QUEUE_DEPTH], 1, false,
+                                     onDone, &tags[LSM6DSOX_ASYNC_QUEUE_DEPTH]));
+
+  queue.service();
+  TEST_ASSERT_EQUAL(LSM6DSOX_ASYNC_QUEUE_DEPTH, delivered.count);
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_WHO_AM_I, data[LSM6DSOX_ASYNC_QUEUE_DEPTH], 1, false,
+                                    onDone, &tags[LSM6DSOX_ASYNC_QUEUE_DEPTH]));
+  queue.wait_idle();
+  queue.service();
+  TEST_ASSERT_EQUAL(LSM6DSOX_ASYNC_QUEUE_DEPTH + 1, delivered.count);
+  for (int i = 0; i <= LSM6DSOX_ASYNC_QUEUE_DEPTH; i++) {
+    TEST_ASSERT_EQUAL(i, delivered.order[i]);
+    TEST_ASSERT_EQUAL_HEX8(LSM6DSOX_ID, data[i][0]);
+  }
+}
+
+static void test_bus_error_is_delivered()
+{
+  lsm6dsox_ctx_t ctx;
+  LSM6DSOXSim_ctx_init(&ctx, &sim);
+  LSM6DSOXAsyncQueue queue(&Wire, TEST_NO_DEVICE, &ctx);
+  uint8_t who = 0;
+
+  resetDeliveries();
+  queue.begin();
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_WHO_AM_I, &who, 1, false, onDone, &tags[0]));
+  queue.wait_idle();
+  queue.service();
+
+  TEST_ASSERT_EQUAL(1, delivered.count);
+  TEST_ASSERT_EQUAL(-1, delivered.status[0]);
+  TEST_ASSERT_EQUAL(0, queue.pending());
+}
+
+/* Without I2C (the SPI case) transfers run inside submit(), callbacks still wait */
+static void test_synchronous_fallback_keeps_callback_semantics()
+{
+  lsm6dsox_ctx_t ctx;
+  LSM6DSOXSim_ctx_init(&ctx, &sim);
+  LSM6DSOXAsyncQueue queue(NULL, 0, &ctx);
+  uint8_t who = 0;
+
+  resetDeliveries();
+  queue.begin();
+  TEST_ASSERT_EQUAL(0, queue.submit(LSM6DSOX_WHO_AM_I, &who, 1, false, onDone, &tags[0]));
+
+  TEST_ASSERT_FALSE(queue.transferring());
+  TEST_ASSERT_EQUAL_HEX8(LSM6DSOX_ID, who);
+  TEST_ASSERT_EQUAL(1, queue.pending());
+  TEST_ASSERT_EQUAL(0, delivered.count);
+
+  queue.service();
+  TEST_ASSERT_EQUAL(1, delivered.count);
+  TEST_ASSERT_EQUAL(0, delivered.status[0]);
+  TEST_ASSERT_EQUAL(0, queue.pending());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  /* Fast mode, as the firmware runs it */
+  sim.advanceTo(hostMicros64() * 1000ULL);
+  Wire.setClock(400000);
+  Wire.attachDevice(TEST_ADDRESS, &simBus);
+  hostAddTickHook(simTick, NULL);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_callbacks_wait_for_service_in_order);
+  RUN_TEST(test_full_queue_refuses_until_serviced);
+  RUN_TEST(test_bus_error_is_delivered);
+  RUN_TEST(test_synchronous_fallback_keeps_callback_semantics);
+  return UNITY_END();
+}
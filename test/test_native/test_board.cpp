@@ -0,0 +1,49 @@
+/**
+ * @file    test_board.cpp
+ * @brief   Two simulated LSM6DSOX on the host Wire bus for the native tests.
+ */
+
+#include "test_board.h"
+#include "LSM6DSOXSimBus.h"
+
+static LSM6DSOXSim sims[TEST_SENSORS];
+static LSM6DSOXSimBus buses[TEST_SENSORS] = { LSM6DSOXSimBus(&sims[0]), LSM6DSOXSimBus(&sims[1]) };
+static bool attached = false;
+
+static void simTick(void *arg, uint64_t now_us)
+{
+  (void)arg;
+  for (int i = 0; i < TEST_SENSORS; i++) {
+    sims[i].advanceTo(now_us * 1000ULL);
+  }
+}
+
+void testBoardInit()
+{
+  if (attached) {
+    return;
+  }
+
+  for (int i = 0; i < TEST_SENSORS; i++) {
+    /* Start level with the host clock */
+    sims[i].advanceTo(hostMicros64() * 1000ULL);
+  }
+  /* Fast mode, as the firmware runs it */
+  Wire.setClock(400000);
+  Wire.attachDevice((uint8_t)(LSM6DSOX_I2C_ADD_L >> 1), &buses[0]);
+  Wire.attachDevice((uint8_t)(LSM6DSOX_I2C_ADD_H >> 1), &buses[1]);
+  hostAddTickHook(simTick, NULL);
+  attached = true;
+}
+
+LSM6DSOXSim *testSim(int i)
+{
+  return &sims[i];
+}
+
+void testSetMotion(LSM6DSOXSimMotion *motion)
+{
+  for (int i = 0; i < TEST_SENSORS; i++) {
+    sims[i].setMotion(motion);
+  }
+}
@@ -0,0 +1,30 @@
+/**
+ * @file    test_board.h
+ * @brief   Two simulated LSM6DSOX on the host Wire bus for the native tests.
+ *
+ * Sensor 0 answers at LSM6DSOX_I2C_ADD_L (0x6A) and sensor 1 at
+ * LSM6DSOX_I2C_ADD_H (0x6B). Both run from the host clock with the same
+ * motion source, so two sensors configured alike produce the same samples
+ * on the same time slots and one can serve as the reference for the other.
+ */
+
+#ifndef TEST_BOARD_H
+#define TEST_BOARD_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "LSM6DSOXSim.h"
+
+#define TEST_SENSORS 2
+
+/** Attach the simulated sensors; safe to call more than once. */
+void testBoardInit();
+
+/** Simulated sensor i (0 or 1). */
+LSM6DSOXSim *testSim(int i);
+
+/** Motion source for both sensors, NULL for none. */
+void testSetMotion(LSM6DSOXSimMotion *motion);
+
+#endif /* TEST_BOARD_H */
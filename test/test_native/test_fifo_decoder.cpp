@@ -0,0 +1,396 @@
+/**
+ * @file    test_fifo_decoder.cpp
+ * @brief   FIFO decoder tests: compressed tag streams and gap handling.
+ *
+ * Sensor 0 batches uncompressed and sensor 1 compressed, from the same
+ * motion on the same time slots, so every sample decoded from sensor 1's
+ * NC/NC_T_x/2xC/3xC words must equal sensor 0's.
+ */
+
+#include <unity.h>
+#include <vector>
+
+#include "test_board.h"
+#include "LSM6DSOXFifo.h"
+#include "test_fifo_words.h"
+
+#define TEST_ODR 416.0f
+#define TEST_DRAIN_MS 20
+#define TEST_WORDS 16           /* per read: a 3xC word is three records */
+
+/* Default full scales after begin(): 2 g and 2000 dps */
+#define TEST_MG_PER_LSB 0.061f
+#define TEST_MDPS_PER_LSB 70.0f
+
+/*
+ * Repeats 250 ms each of slow motion (5-bit differences, 3xC), moderate
+ * motion (8-bit differences, 2xC) and noise (uncompressed), with a little
+ * noise throughout so that the stream lines up only one way. With
+ * slow_only set, the motion stays slow.
+ */
+class CompressionMotion : public LSM6DSOXSimMotion
+{
+  public:
+    explicit CompressionMotion(bool slow_only = false) : slow_only(slow_only) {}
+
+    void sample(uint64_t t_ns, LSM6DSOXSimFrame *frame) override
+    {
+      static const float base_lsb[3] = { 0.0f, 0.0f, 16393.0f };
+      float t = (float)((double)t_ns * 1e-9);
+      uint32_t seed = (uint32_t)(t_ns / 1000ULL) * 2654435761U;
+      int part = slow_only ? 0 : (int)((t_ns / 250000000ULL) % 3U);
+
+      for (int i = 0; i < 3; i++) {
+        float noise = (float)((seed >> (8 * i)) & 0xFFU) / 255.0f - 0.5f;
+        float lsb;
+        if (part == 0) {
+          lsb = 100.0f * sinf(6.2831853f * t + i) + 6.0f * noise;
+        } else if (part == 1) {
+          lsb = 1000.0f * sinf(6.2831853f * 5.0f * t + i) + 6.0f * noise;
+        } else {
+          lsb = 8000.0f * noise;
+        }
+        frame->accel_mg[i] = (base_lsb[i] + lsb) * TEST_MG_PER_LSB;
+        frame->gyro_mdps[i] = lsb * TEST_MDPS_PER_LSB;
+      }
+      frame->temp_c = 25.0f;
+    }
+
+  private:
+    bool slow_only;
+};
+
+static CompressionMotion motion;
+static CompressionMotion slow_motion(true);
+
+/* One sensor's decoded stream */
+struct Stream
+{
+  LSM6DSOXSensor *sensor;
+  LSM6DSOXFifoDecoder *decoder;
+  std::vector<int16_t> xl;      /* x, y, z per sample */
+  std::vector<int16_t> gy;
+  uint32_t tags[32];
+  uint32_t words;
+};
+
+static void streamInit(Stream *s, LSM6DSOXSensor *sensor, LSM6DSOXFifoDecoder *decoder)
+{
+  s->sensor = sensor;
+  s->decoder = decoder;
+  s->xl.clear();
+  s->gy.clear();
+  memset(s->tags, 0, sizeof(s->tags));
+  s->words = 0;
+}
+
+static void startSensor(int index, LSM6DSOXSensor *sensor, uint8_t compression)
+{
+  testSim(index)->reset();
+  TEST_ASSERT_EQUAL(LSM6DSOX_OK, sensor->begin());
+  sensor->Set_X_ODR(TEST_ODR);
+  sensor->Set_G_ODR(TEST_ODR);
+  sensor->Enable_X();
+  sensor->Enable_G();
+  sensor->Set_Timestamp_Status(1);
+  sensor->Set_FIFO_X_BDR(TEST_ODR);
+  sensor->Set_FIFO_G_BDR(TEST_ODR);
+  sensor->Set_FIFO_Timestamp_Decimation(LSM6DSOX_DEC_8);
+  if (compression != LSM6DSOX_CMP_DISABLE) {
+    sensor->Set_FIFO_Compression_Algo_Enable(1);
+    sensor->Set_FIFO_Compression_Algo_Init(1);
+    sensor->Set_FIFO_Compression_Algo_Set(compression);
+    sensor->Set_FIFO_Compression_Algo_Real_Time_Set(1);
+  }
+}
+
+/* Read everything the FIFO holds, counting the words by tag */
+static void drainStream(Stream *s)
+{
+  uint16_t level = 0;
+  if (s->sensor->Get_FIFO_Num_Samples(&level) != LSM6DSOX_OK) {
+    return;
+  }
+
+  while (level > 0) {
+    uint8_t words[TEST_WORDS * 7];
+    uint16_t count = (level > TEST_WORDS) ? TEST_WORDS : level;
+    uint16_t received = 0;
+
+    s->sensor->Get_FIFO_Sample(words, count, &received);
+    for (uint16_t i = 0; i < received; i++) {
+      s->tags[words[7 * i] >> 3]++;
+    }
+    s->words += received;
+    s->decoder->decode(words, received);
+
+    LSM6DSOX_FIFO_Axes_t sample;
+    while (s->decoder->xl.pop(&sample)) {
+      s->xl.insert(s->xl.end(), sample.axis, sample.axis + 3);
+    }
+    while (s->decoder->gy.pop(&sample)) {
+      s->gy.insert(s->gy.end(), sample.axis, sample.axis + 3);
+    }
+
+    if (received < count) {
+      break;
+    }
+    level -= received;
+  }
+}
+
+/*
+ * The two streams start a sample or so apart: find the shift that lines
+ * up the first samples of 'test' with 'ref', then compare all they share.
+ */
+static void assertSameSamples(const std::vector<int16_t> &ref, const std::vector<int16_t> &test)
+{
+  const int lead = 32;
+  size_t ref_n = ref.size() / 3;
+  size_t test_n = test.size() / 3;
+  TEST_ASSERT_TRUE(ref_n > 1000 && test_n > 1000);
+
+  int shift = -1;
+  for (int s = 0; s < 16 && shift < 0; s++) {
+    if (memcmp(&ref[3 * s], &test[0], 3 * lead * sizeof(int16_t)) == 0) {
+      shift = s;
+    }
+  }
+  int skip = -1;
+  for (int s = 1; s < 16 && shift < 0 && skip < 0; s++) {
+    if (memcmp(&ref[0], &test[3 * s], 3 * lead * sizeof(int16_t)) == 0) {
+      skip = s;
+    }
+  }
+  TEST_ASSERT_TRUE_MESSAGE(shift >= 0 || skip >= 0, "streams do not line up");
+
+  size_t ref_at = (shift >= 0) ? (size_t)shift : 0U;
+  size_t test_at = (skip >= 0) ? (size_t)skip : 0U;
+  size_t n = ref_n - ref_at;
+  if (test_n - test_at < n) {
+    n = test_n - test_at;
+  }
+  TEST_ASSERT_TRUE(n > 1000);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(&ref[3 * ref_at], &test[3 * test_at], 3 * n);
+}
+
+static void test_compressed_stream_matches_uncompressed()
+{
+  LSM6DSOXSensor plain(&Wire, LSM6DSOX_I2C_ADD_L);
+  LSM6DSOXSensor packed(&Wire, LSM6DSOX_I2C_ADD_H);
+  LSM6DSOXFifoDecoder plain_decoder(&plain);
+  LSM6DSOXFifoDecoder packed_decoder(&packed);
+  Stream ref;
+  Stream test;
+
+  testSetMotion(&motion);
+  startSensor(0, &plain, LSM6DSOX_CMP_DISABLE);
+  startSensor(1, &packed, LSM6DSOX_CMP_16_TO_1);
+  streamInit(&ref, &plain, &plain_decoder);
+  streamInit(&test, &packed, &packed_decoder);
+  plain_decoder.set_slot_rate(TEST_ODR);
+  packed_decoder.set_slot_rate(TEST_ODR);
+  plain.Set_FIFO_Mode(LSM6DSOX_STREAM_MODE);
+  packed.Set_FIFO_Mode(LSM6DSOX_STREAM_MODE);
+
+  /* Three seconds: each kind of motion four times */
+  for (int i = 0; i < 3000 / TEST_DRAIN_MS; i++) {
+    delay(TEST_DRAIN_MS);
+    drainStream(&ref);
+    drainStream(&test);
+  }
+  uint16_t level = 0;
+  uint8_t plain_flags = 0;
+  uint8_t packed_flags = 0;
+  plain.Get_FIFO_Status(&level, &plain_flags);
+  packed.Get_FIFO_Status(&level, &packed_flags);
+  plain.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);
+  packed.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);
+  testSetMotion(NULL);
+
+  /* Both streams are complete */
+  TEST_ASSERT_FALSE(plain_flags & LSM6DSOX_FIFO_FLAG_OVR_LATCHED);
+  TEST_ASSERT_FALSE(packed_flags & LSM6DSOX_FIFO_FLAG_OVR_LATCHED);
+
+  /* The reference is all NC words, the other uses every compressed kind */
+  TEST_ASSERT_EQUAL_UINT32(0, ref.tags[LSM6DSOX_XL_2XC_TAG] + ref.tags[LSM6DSOX_XL_3XC_TAG]);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_XL_NC_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_XL_NC_T_2_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_XL_2XC_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_XL_3XC_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_GYRO_NC_T_2_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_GYRO_2XC_TAG] > 0);
+  TEST_ASSERT_TRUE(test.tags[LSM6DSOX_GYRO_3XC_TAG] > 0);
+  TEST_ASSERT_TRUE(test.words < ref.words);
+
+  TEST_ASSERT_EQUAL_UINT32(0, plain_decoder.parity_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, packed_decoder.parity_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, packed_decoder.decompress_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, packed_decoder.xl.dropped + packed_decoder.gy.dropped);
+
+  /* TIMESTAMP words account for every slot, compressed or not */
+  TEST_ASSERT_EQUAL_UINT32(0, plain_decoder.lost_slots);
+  TEST_ASSERT_EQUAL_UINT32(0, packed_decoder.lost_slots);
+
+  assertSameSamples(ref.xl, test.xl);
+  assertSameSamples(ref.gy, test.gy);
+}
+
+/* Compressed word builders for the decoder-only tests */
+static void put2xC(uint8_t *word, uint8_t tag, uint8_t cnt, const int8_t (*diff)[3])
+{
+  uint8_t data[6];
+  for (int s = 0; s < 2; s++) {
+    for (int i = 0; i < 3; i++) {
+      data[3 * s + i] = (uint8_t)diff[s][i];
+    }
+  }
+  putWord(word, tag, cnt, data);
+}
+
+static void put3xC(uint8_t *word, uint8_t tag, uint8_t cnt, const int8_t (*diff)[3])
+{
+  uint8_t data[6];
+  for (int s = 0; s < 3; s++) {
+    uint16_t group = (uint16_t)((diff[s][0] & 0x1F) | ((diff[s][1] & 0x1F) << 5) | ((diff[s][2] & 0x1F) << 10));
+    data[2 * s] = (uint8_t)group;
+    data[2 * s + 1] = (uint8_t)(group >> 8);
+  }
+  putWord(word, tag, cnt, data);
+}
+
+static void assertPop(LSM6DSOXFifoDecoder *decoder, int16_t x, int16_t y, int16_t z)
+{
+  LSM6DSOX_FIFO_Axes_t sample;
+  int16_t expected[3] = { x, y, z };
+  TEST_ASSERT_TRUE(decoder->xl.pop(&sample));
+  TEST_ASSERT_EQUAL_INT16_ARRAY(expected, sample.axis, 3);
+}
+
+static void test_difference_words_need_a_reference()
+{
+  LSM6DSOXSensor sensor(&Wire, LSM6DSOX_I2C_ADD_L);
+  LSM6DSOXFifoDecoder decoder(&sensor);
+  static const int16_t start[3] = { 100, -200, 300 };
+  static const int8_t small[3][3] = { { 1, -1, 2 }, { 3, 0, -4 }, { -16, 15, 0 } };
+  uint8_t word[7];
+
+  /* Joined mid-way: nothing to apply the differences to */
+  put3xC(word, LSM6DSOX_XL_3XC_TAG, 0, small);
+  decoder.decode(word, 1);
+  TEST_ASSERT_EQUAL_UINT32(1, decoder.decompress_errors);
+  TEST_ASSERT_EQUAL(0, decoder.xl.available());
+
+  /* An uncompressed word resynchronises the channel */
+  putNC(word, LSM6DSOX_XL_NC_TAG, 1, start);
+  decoder.decode(word, 1);
+  put3xC(word, LSM6DSOX_XL_3XC_TAG, 2, small);
+  decoder.decode(word, 1);
+  TEST_ASSERT_EQUAL(4, decoder.xl.available());
+  assertPop(&decoder, 100, -200, 300);
+  assertPop(&decoder, 101, -201, 302);
+  assertPop(&decoder, 104, -201, 298);
+  assertPop(&decoder, 88, -186, 298);
+  TEST_ASSERT_EQUAL_UINT32(1, decoder.decompress_errors);
+}
+
+static void test_mark_gap_drops_the_reference()
+{
+  LSM6DSOXSensor sensor(&Wire, LSM6DSOX_I2C_ADD_L);
+  LSM6DSOXFifoDecoder decoder(&sensor);
+  static const int16_t start[3] = { -5, 0, 16384 };
+  static const int16_t resync[3] = { 1000, 2000, -3000 };
+  static const int8_t large[2][3] = { { 10, -20, 127 }, { -128, 0, 5 } };
+  uint8_t word[7];
+
+  putNC(word, LSM6DSOX_XL_NC_TAG, 0, start);
+  decoder.decode(word, 1);
+  putNC(word, LSM6DSOX_GYRO_NC_TAG, 0, start);
+  decoder.decode(word, 1);
+  put2xC(word, LSM6DSOX_XL_2XC_TAG, 1, large);
+  decoder.decode(word, 1);
+  TEST_ASSERT_EQUAL(3, decoder.xl.available());
+  TEST_ASSERT_EQUAL_UINT32(0, decoder.decompress_errors);
+  decoder.xl.clear();
+
+  /* After an overrun the words continue from samples that were lost */
+  decoder.mark_gap();
+  TEST_ASSERT_EQUAL_UINT32(1, decoder.overruns);
+  put2xC(word, LSM6DSOX_XL_2XC_TAG, 3, large);
+  decoder.decode(word, 1);
+  put2xC(word, LSM6DSOX_GYRO_2XC_TAG, 3, large);
+  decoder.decode(word, 1);
+  TEST_ASSERT_EQUAL_UINT32(2, decoder.decompress_errors);
+  TEST_ASSERT_EQUAL(0, decoder.xl.available());
+  TEST_ASSERT_EQUAL(1, decoder.gy.available());
+
+  putNC(word, LSM6DSOX_XL_NC_TAG, 0, resync);
+  decoder.decode(word, 1);
+  put2xC(word, LSM6DSOX_XL_2XC_TAG, 1, large);
+  decoder.decode(word, 1);
+  assertPop(&decoder, 1000, 2000, -3000);
+  assertPop(&decoder, 1010, 1980, -2873);
+  assertPop(&decoder, 882, 1980, -2868);
+  TEST_ASSERT_EQUAL_UINT32(2, decoder.decompress_errors);
+}
+
+/*
+ * A real overrun of a compressed FIFO, reported the way the firmware does.
+ * Slow motion keeps the FIFO in 3xC words, so the oldest words left after
+ * the overrun are differences from samples that were dropped.
+ */
+static void test_overrun_counts_decompress_errors()
+{
+  LSM6DSOXSensor sensor(&Wire, LSM6DSOX_I2C_ADD_H);
+  LSM6DSOXFifoDecoder decoder(&sensor);
+  Stream s;
+
+  testSetMotion(&slow_motion);
+  startSensor(1, &sensor, LSM6DSOX_CMP_32_TO_1);
+  streamInit(&s, &sensor, &decoder);
+  decoder.set_slot_rate(TEST_ODR);
+  sensor.Set_FIFO_Mode(LSM6DSOX_STREAM_MODE);
+
+  for (int i = 0; i < 200 / TEST_DRAIN_MS; i++) {
+    delay(TEST_DRAIN_MS);
+    drainStream(&s);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, decoder.decompress_errors);
+  size_t before = s.xl.size();
+
+  /* Far more than 512 words, even compressed */
+  delay(4000);
+  uint16_t level = 0;
+  uint8_t flags = 0;
+  TEST_ASSERT_EQUAL(LSM6DSOX_OK, sensor.Get_FIFO_Status(&level, &flags));
+  TEST_ASSERT_TRUE(flags & (LSM6DSOX_FIFO_FLAG_OVR | LSM6DSOX_FIFO_FLAG_OVR_LATCHED));
+  decoder.mark_gap();
+  drainStream(&s);
+  uint32_t errors = decoder.decompress_errors;
+  TEST_ASSERT_TRUE(errors > 0);
+
+  /* Resynchronised at the next uncompressed word; no errors after that */
+  for (int i = 0; i < 500 / TEST_DRAIN_MS; i++) {
+    delay(TEST_DRAIN_MS);
+    drainStream(&s);
+  }
+  sensor.Set_FIFO_Mode(LSM6DSOX_BYPASS_MODE);
+  testSetMotion(NULL);
+
+  TEST_ASSERT_EQUAL_UINT32(errors, decoder.decompress_errors);
+  TEST_ASSERT_EQUAL_UINT32(1, decoder.overruns);
+  TEST_ASSERT_TRUE(s.xl.size() > before + 3 * 400);
+
+  LSM6DSOX_FIFO_Gap_t gap;
+  TEST_ASSERT_TRUE(decoder.gaps.pop(&gap));
+  TEST_ASSERT_TRUE(gap.lost > 0);
+  TEST_ASSERT_EQUAL_UINT32(before / 3, gap.xl_index);
+}
+
+void runFifoDecoderTests()
+{
+  RUN_TEST(test_difference_words_need_a_reference);
+  RUN_TEST(test_mark_gap_drops_the_reference);
+  RUN_TEST(test_compressed_stream_matches_uncompressed);
+  RUN_TEST(test_overrun_counts_decompress_errors);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file    test_fifo_words.h
+ * @brief   FIFO word builders for the decoder-only tests.
+ */
+
+#ifndef TEST_FIFO_WORDS_H
+#define TEST_FIFO_WORDS_H
+
+#include <string.h>
+
+#include "LSM6DSOXSensor.h"
+
+/** A 7-byte FIFO word: tag, tag counter and parity, then the data bytes. */
+static inline void putWord(uint8_t *word, uint8_t tag, uint8_t cnt, const uint8_t *data)
+{
+  uint8_t tag_byte = (uint8_t)((tag << 3) | ((cnt & 0x03U) << 1));
+  uint8_t parity = tag_byte;
+  parity ^= (uint8_t)(parity >> 4);
+  parity ^= (uint8_t)(parity >> 2);
+  parity ^= (uint8_t)(parity >> 1);
+  word[0] = (uint8_t)(tag_byte | (parity & 0x01U));
+  memcpy(&word[1], data, 6);
+}
+
+/** An uncompressed x, y, z word. */
+static inline void putNC(uint8_t *word, uint8_t tag, uint8_t cnt, const int16_t *v)
+{
+  uint8_t data[6];
+  for (int i = 0; i < 3; i++) {
+    data[2 * i] = (uint8_t)v[i];
+    data[2 * i + 1] = (uint8_t)((uint16_t)v[i] >> 8);
+  }
+  putWord(word, tag, cnt, data);
+}
+
+/** A TIMESTAMP word carrying the raw 32-bit counter. */
+static inline void putTimestamp(uint8_t *word, uint8_t cnt, uint32_t raw)
+{
+  uint8_t data[6] = { (uint8_t)raw, (uint8_t)(raw >> 8), (uint8_t)(raw >> 16), (uint8_t)(raw >> 24), 0, 0 };
+  putWord(word, LSM6DSOX_TIMESTAMP_TAG, cnt, data);
+}
+
+#endif /* TEST_FIFO_WORDS_H */
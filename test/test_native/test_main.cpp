@@ -0,0 +1,39 @@
+/**
+ * @file    test_main.cpp
+ * @brief   Native test runner: `pio test -e native`.
+ *
+ * The tests run on the host clock of lib/ArduinoHost against the sensor
+ * model in lib/LSM6DSOXSim (see test_board.h).
+ */
+
+#include <unity.h>
+
+#include "test_board.h"
+
+void runFifoDecoderTests();
+void runTimestampTests();
+void runSampleCodecTests();
+void runSpillQueueTests();
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  testBoardInit();
+
+  UNITY_BEGIN();
+  runFifoDecoderTests();
+  runTimestampTests();
+  runSampleCodecTests();
+  runSpillQueueTests();
+  return UNITY_END();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file    test_sample_codec.cpp
+ * @brief   Delta codec tests: round trips, sampleCodecMeasure() and the
+ *          in-place encoding writeBinaryData() relies on.
+ */
+
+#include <unity.h>
+#include <string.h>
+
+#include "SampleCodec.h"
+
+#define CODEC_RECORDS 200
+
+/* Records in wire format from xyz triples */
+static void putRecords(uint8_t *records, const int16_t (*xyz)[3], uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++) {
+    for (int a = 0; a < 3; a++) {
+      records[6 * i + 2 * a] = (uint8_t)xyz[i][a];
+      records[6 * i + 2 * a + 1] = (uint8_t)((uint16_t)xyz[i][a] >> 8);
+    }
+  }
+}
+
+/*
+ * Motion with every step size: quiet stretches (1-byte differences), a
+ * swing (2 bytes) and full-scale jumps (3 bytes, -32768 to 32767)
+ */
+static void makeMotion(int16_t (*xyz)[3], uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++) {
+    int part = (i / 25) % 4;
+    for (int a = 0; a < 3; a++) {
+      int32_t v;
+      if (part == 0) {
+        v = 16384 * (a == 2) + (int32_t)((i * 7 + a) % 11) - 5;
+      } else if (part == 1) {
+        v = (int32_t)(i % 25) * 300 * (a + 1) - 4000;
+      } else if (part == 2) {
+        v = ((i + a) & 1) ? 32767 : -32768;
+      } else {
+        v = -(int32_t)i * 40 * (a + 1);
+      }
+      xyz[i][a] = (int16_t)v;
+    }
+  }
+}
+
+static void assertDecodes(const uint8_t *coded, size_t len, const int16_t (*xyz)[3], uint16_t count)
+{
+  static int16_t back[CODEC_RECORDS][3];
+  size_t used = 0;
+
+  TEST_ASSERT_EQUAL_UINT16(count, sampleCodecDecode(coded, len, back, count, &used));
+  TEST_ASSERT_EQUAL(len, used);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(&xyz[0][0], &back[0][0], 3 * count);
+}
+
+static void test_round_trip_matches_measure()
+{
+  static int16_t xyz[CODEC_RECORDS][3];
+  static uint8_t records[CODEC_RECORDS * 6];
+  static uint8_t coded[CODEC_RECORDS * SAMPLE_CODEC_MAX_RECORD];
+
+  makeMotion(xyz, CODEC_RECORDS);
+  putRecords(records, xyz, CODEC_RECORDS);
+
+  size_t lead = 0;
+  size_t size = sampleCodecMeasure(records, CODEC_RECORDS, &lead);
+  size_t n = sampleCodecEncode(records, CODEC_RECORDS, coded);
+  TEST_ASSERT_EQUAL(size, n);
+  assertDecodes(coded, n, xyz, CODEC_RECORDS);
+
+  /* Full-scale jumps cost 9 bytes, more than the 6 read */
+  TEST_ASSERT_TRUE(lead > 0);
+
+  /* One record: three single-byte zeros, or the zigzag of each value */
+  static const int16_t one[1][3] = { { 0, -1, 64 } };
+  putRecords(records, one, 1);
+  TEST_ASSERT_EQUAL(4, sampleCodecEncode(records, 1, coded));
+  TEST_ASSERT_EQUAL_HEX8(0x00, coded[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, coded[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, coded[2]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, coded[3]);
+}
+
+/* The output starting exactly the measured lead ahead is enough */
+static void test_in_place_encoding_at_the_measured_lead()
+{
+  static int16_t xyz[CODEC_RECORDS][3];
+  static uint8_t records[CODEC_RECORDS * 6];
+  static uint8_t expected[CODEC_RECORDS * SAMPLE_CODEC_MAX_RECORD];
+  static uint8_t buffer[CODEC_RECORDS * SAMPLE_CODEC_MAX_RECORD];
+
+  makeMotion(xyz, CODEC_RECORDS);
+  putRecords(records, xyz, CODEC_RECORDS);
+  size_t n = sampleCodecEncode(records, CODEC_RECORDS, expected);
+
+  size_t lead = 0;
+  sampleCodecMeasure(records, CODEC_RECORDS, &lead);
+  memcpy(&buffer[lead], records, sizeof(records));
+  TEST_ASSERT_EQUAL(n, sampleCodecEncode(&buffer[lead], CODEC_RECORDS, buffer));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, n);
+  assertDecodes(buffer, n, xyz, CODEC_RECORDS);
+
+  /* Quiet motion never gets ahead: fully in place */
+  for (uint16_t i = 0; i < CODEC_RECORDS; i++) {
+    for (int a = 0; a < 3; a++) {
+      xyz[i][a] = (int16_t)(16384 * (a == 2) + (int)((i + a) % 9) - 4);
+    }
+  }
+  putRecords(records, xyz, CODEC_RECORDS);
+  n = sampleCodecMeasure(records, CODEC_RECORDS, &lead);
+  TEST_ASSERT_EQUAL(0, lead);
+  sampleCodecEncode(records, CODEC_RECORDS, expected);
+  memcpy(buffer, records, sizeof(records));
+  TEST_ASSERT_EQUAL(n, sampleCodecEncode(buffer, CODEC_RECORDS, buffer));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, n);
+  TEST_ASSERT_TRUE(n < sizeof(records));
+}
+
+/* Format 3: accelerometer then gyroscope runs, each from zero, one stream */
+static void test_two_runs_in_one_stream()
+{
+  static int16_t xl[CODEC_RECORDS][3];
+  static int16_t gy[CODEC_RECORDS / 2][3];
+  static uint8_t records[CODEC_RECORDS * 6];
+  static uint8_t coded[2 * CODEC_RECORDS * SAMPLE_CODEC_MAX_RECORD];
+
+  makeMotion(xl, CODEC_RECORDS);
+  for (uint16_t i = 0; i < CODEC_RECORDS / 2; i++) {
+    for (int a = 0; a < 3; a++) {
+      gy[i][a] = (int16_t)(xl[2 * i][a] / 3 - 100);
+    }
+  }
+
+  putRecords(records, xl, CODEC_RECORDS);
+  size_t n = sampleCodecEncode(records, CODEC_RECORDS, coded);
+  size_t xl_n = n;
+  putRecords(records, gy, CODEC_RECORDS / 2);
+  n += sampleCodecEncode(records, CODEC_RECORDS / 2, &coded[n]);
+
+  static int16_t back[CODEC_RECORDS][3];
+  size_t used = 0;
+  TEST_ASSERT_EQUAL_UINT16(CODEC_RECORDS, sampleCodecDecode(coded, n, back, CODEC_RECORDS, &used));
+  TEST_ASSERT_EQUAL(xl_n, used);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(&xl[0][0], &back[0][0], 3 * CODEC_RECORDS);
+  assertDecodes(&coded[used], n - used, gy, CODEC_RECORDS / 2);
+}
+
+/* A cut-off stream decodes to the last whole record */
+static void test_truncated_stream_stops_at_a_record()
+{
+  static int16_t xyz[CODEC_RECORDS][3];
+  static uint8_t records[CODEC_RECORDS * 6];
+  static uint8_t coded[CODEC_RECORDS * SAMPLE_CODEC_MAX_RECORD];
+  static int16_t back[CODEC_RECORDS][3];
+
+  makeMotion(xyz, CODEC_RECORDS);
+  putRecords(records, xyz, CODEC_RECORDS);
+  size_t n = sampleCodecEncode(records, CODEC_RECORDS, coded);
+  size_t whole = sampleCodecMeasure(records, 60, NULL);
+  TEST_ASSERT_TRUE(n > whole + 2);
+
+  size_t used = 0;
+  TEST_ASSERT_EQUAL_UINT16(60, sampleCodecDecode(coded, whole + 2, back, CODEC_RECORDS, &used));
+  TEST_ASSERT_EQUAL(whole, used);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(&xyz[0][0], &back[0][0], 3 * 60);
+
+  /* A fourth continuation byte is malformed */
+  static const uint8_t bad[4] = { 0x80, 0x80, 0x80, 0x01 };
+  TEST_ASSERT_EQUAL_UINT16(0, sampleCodecDecode(bad, sizeof(bad), back, 1, &used));
+  TEST_ASSERT_EQUAL(0, used);
+}
+
+void runSampleCodecTests()
+{
+  RUN_TEST(test_round_trip_matches_measure);
+  RUN_TEST(test_in_place_encoding_at_the_measured_lead);
+  RUN_TEST(test_two_runs_in_one_stream);
+  RUN_TEST(test_truncated_stream_stops_at_a_record);
+}
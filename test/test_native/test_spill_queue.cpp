@@ -0,0 +1,244 @@
+/**
+ * @file    test_spill_queue.cpp
+ * @brief   Flash spill queue recovery: resets mid-write, torn fragment
+ *          headers and sent marks, on the host flash (HostFlash.h).
+ *
+ * A reset is spillInit() again over the same flash, as at boot. Sent notes
+ * are read back from the host Notecard's request log ($TALON_HOST_NOTES).
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <HostFlash.h>
+#include "SpillQueue.h"
+
+#define NOTE_BINARY 3000        /* more than a 2 KB page: two fragments */
+
+static char notesPath[] = "/tmp/spill_notes_XXXXXX";
+
+/* Blank flash and an empty queue */
+static void freshQueue()
+{
+  for (uint32_t page = 0; page < SPILL_PAGES; page++) {
+    hostFlashErase(page);
+  }
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(0, spillPending());
+}
+
+static void fillBinary(uint8_t *data, uint32_t len, int note)
+{
+  for (uint32_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)(i * 7 + note * 31);
+  }
+}
+
+static J *newNote(int note)
+{
+  J *req = JCreateObject();
+  JAddStringToObject(req, "req", "note.add");
+  JAddStringToObject(req, "file", "spill.qo");
+  J *body = JAddObjectToObject(req, "body");
+  JAddNumberToObject(body, "note", note);
+  return req;
+}
+
+/* Queue note n with bin_len bytes of binary payload */
+static void queueNote(int note, uint32_t bin_len)
+{
+  static uint8_t data[NOTE_BINARY];
+  J *req = newNote(note);
+  fillBinary(data, bin_len, note);
+  TEST_ASSERT_TRUE(spillBegin(req, bin_len));
+  JDelete(req);
+  TEST_ASSERT_TRUE(bin_len == 0 || spillAppend(data, bin_len));
+  TEST_ASSERT_TRUE(spillEnd());
+}
+
+/* Send up to max queued notes; the log lines they produced */
+static std::vector<std::string> sendNotes(uint32_t max)
+{
+  FILE *f = fopen(notesPath, "w");
+  if (f) {
+    fclose(f);
+  }
+  for (uint32_t i = 0; i < max && spillPending() > 0; i++) {
+    spillService(false);
+  }
+
+  std::vector<std::string> lines;
+  f = fopen(notesPath, "r");
+  TEST_ASSERT_NOT_NULL(f);
+  static char line[16384];
+  while (fgets(line, sizeof(line), f)) {
+    lines.push_back(line);
+  }
+  fclose(f);
+  return lines;
+}
+
+/* The log line is note n, with its binary payload intact */
+static void assertNote(const std::string &line, int note, uint32_t bin_len)
+{
+  char tag[32];
+  snprintf(tag, sizeof(tag), "\"note\":%d", note);
+  TEST_ASSERT_TRUE_MESSAGE(line.find(tag) != std::string::npos, line.c_str());
+
+  if (bin_len > 0) {
+    static uint8_t data[NOTE_BINARY];
+    static char b64[NOTE_BINARY * 2];
+    fillBinary(data, bin_len, note);
+    JB64Encode(b64, (const char *)data, (int)bin_len);
+    std::string payload = std::string("\"payload\":\"") + b64 + "\"";
+    TEST_ASSERT_TRUE_MESSAGE(line.find(payload) != std::string::npos, "payload differs");
+  }
+}
+
+/* Where the next fragment goes: the start of the erased end of the page */
+static uint32_t erasedFrom(uint32_t page)
+{
+  const uint8_t *p = hostFlashData() + page * HOST_FLASH_PAGE_SIZE;
+  uint32_t off = HOST_FLASH_PAGE_SIZE;
+  while (off >= 8 && p[off - 1] == 0xFF && p[off - 2] == 0xFF && p[off - 3] == 0xFF &&
+         p[off - 4] == 0xFF && p[off - 5] == 0xFF && p[off - 6] == 0xFF &&
+         p[off - 7] == 0xFF && p[off - 8] == 0xFF) {
+    off -= 8;
+  }
+  return off;
+}
+
+static void test_queue_survives_a_reset()
+{
+  freshQueue();
+  queueNote(1, 0);
+  queueNote(2, NOTE_BINARY);
+  queueNote(3, 100);
+
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(3, spillPending());
+
+  std::vector<std::string> sent = sendNotes(10);
+  TEST_ASSERT_EQUAL(3, sent.size());
+  assertNote(sent[0], 1, 0);
+  assertNote(sent[1], 2, NOTE_BINARY);
+  assertNote(sent[2], 3, 100);
+  TEST_ASSERT_EQUAL_UINT32(0, spillPending());
+}
+
+/* Power lost with an entry half written, its first fragment complete */
+static void test_reset_mid_entry_drops_only_that_entry()
+{
+  static uint8_t data[NOTE_BINARY];
+
+  freshQueue();
+  queueNote(1, 500);
+
+  J *req = newNote(2);
+  fillBinary(data, NOTE_BINARY, 2);
+  TEST_ASSERT_TRUE(spillBegin(req, NOTE_BINARY));
+  JDelete(req);
+  TEST_ASSERT_TRUE(spillAppend(data, 2500));
+
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(1, spillPending());
+
+  /* Writing carries on past the cut-off fragment */
+  queueNote(3, NOTE_BINARY);
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(2, spillPending());
+
+  std::vector<std::string> sent = sendNotes(10);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  assertNote(sent[0], 1, 500);
+  assertNote(sent[1], 3, NOTE_BINARY);
+}
+
+/* Power lost between the two double words of a fragment header */
+static void test_torn_fragment_header_is_skipped()
+{
+  freshQueue();
+  queueNote(1, 40);
+
+  /* The first write of the ring went to page 0 */
+  uint32_t off = erasedFrom(0);
+  TEST_ASSERT_TRUE(off > 8 && off + 64 < HOST_FLASH_PAGE_SIZE);
+  TEST_ASSERT_TRUE(hostFlashProgram(off + 24, 0x0123456789ABCDEFULL));
+  TEST_ASSERT_TRUE(hostFlashProgram(off, 0x0000000700205146ULL));   /* magic, len, entry */
+  uint32_t torn_end = erasedFrom(0);
+
+  /* The rest of the page is given up; the next note goes to page 1 */
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(1, spillPending());
+  queueNote(2, 40);
+  TEST_ASSERT_EQUAL(torn_end, erasedFrom(0));
+  TEST_ASSERT_TRUE(erasedFrom(1) > 8);
+
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(2, spillPending());
+  std::vector<std::string> sent = sendNotes(10);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  assertNote(sent[0], 1, 40);
+  assertNote(sent[1], 2, 40);
+}
+
+/* Sent marks are in flash: a reset does not send a note twice */
+static void test_sent_notes_stay_sent_after_a_reset()
+{
+  freshQueue();
+  queueNote(1, 0);
+  queueNote(2, 200);
+  queueNote(3, 0);
+
+  std::vector<std::string> sent = sendNotes(1);
+  TEST_ASSERT_EQUAL(1, sent.size());
+  assertNote(sent[0], 1, 0);
+
+  spillInit();
+  TEST_ASSERT_EQUAL_UINT32(2, spillPending());
+  sent = sendNotes(10);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  assertNote(sent[0], 2, 200);
+  assertNote(sent[1], 3, 0);
+}
+
+/* Resets anywhere in several laps of the ring keep the order */
+static void test_resets_across_laps_of_the_ring()
+{
+  freshQueue();
+  int next = 0;
+  int expected = 0;
+  for (int round = 0; round < 3 * SPILL_PAGES / 2; round++) {
+    queueNote(next++, NOTE_BINARY);
+    queueNote(next++, 1000);
+    spillInit();
+    TEST_ASSERT_EQUAL_UINT32(2, spillPending());
+
+    std::vector<std::string> sent = sendNotes(10);
+    TEST_ASSERT_EQUAL(2, sent.size());
+    assertNote(sent[0], expected, NOTE_BINARY);
+    assertNote(sent[1], expected + 1, 1000);
+    expected += 2;
+  }
+}
+
+void runSpillQueueTests()
+{
+  int fd = mkstemp(notesPath);
+  TEST_ASSERT_TRUE(fd >= 0);
+  close(fd);
+  setenv("TALON_HOST_NOTES", notesPath, 1);
+
+  RUN_TEST(test_queue_survives_a_reset);
+  RUN_TEST(test_reset_mid_entry_drops_only_that_entry);
+  RUN_TEST(test_torn_fragment_header_is_skipped);
+  RUN_TEST(test_sent_notes_stay_sent_after_a_reset);
+  RUN_TEST(test_resets_across_laps_of_the_ring);
+
+  unsetenv("TALON_HOST_NOTES");
+  unlink(notesPath);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file    test_timestamp.cpp
+ * @brief   Timestamp extension across the 32-bit counter wrap.
+ *
+ * The counter wraps every 29.8 h, longer than the simulation can run, so
+ * these feed LSM6DSOXTimestamp and the decoder raw values directly.
+ */
+
+#include <unity.h>
+
+#include "LSM6DSOXFifo.h"
+#include "test_fifo_words.h"
+
+#define WRAP 0x100000000ULL
+
+static void test_extend_carries_across_the_wrap()
+{
+  LSM6DSOXTimestamp clock;
+
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFF00ULL, clock.extend(0xFFFFFF00U));
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFFFFULL, clock.extend(0xFFFFFFFFU));
+  TEST_ASSERT_EQUAL_UINT64(WRAP, clock.extend(0x00000000U));
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x10U, clock.extend(0x00000010U));
+}
+
+static void test_extend_places_late_readings_before_the_newest()
+{
+  LSM6DSOXTimestamp clock;
+
+  clock.extend(0xFFFFFFF0U);
+  clock.extend(0x00000020U);
+
+  /* A FIFO word read after the registers, from before the wrap */
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFFF8ULL, clock.extend(0xFFFFFFF8U));
+
+  /* It does not move the newest reading back */
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x30U, clock.extend(0x00000030U));
+}
+
+static void test_extend_counts_every_wrap()
+{
+  LSM6DSOXTimestamp clock;
+  const uint32_t step = 0x40000000U;   /* a quarter of the range, 7.5 h */
+  uint64_t expected = 0x12345678U;
+
+  clock.extend((uint32_t)expected);
+  for (int i = 0; i < 20; i++) {
+    expected += step;
+    TEST_ASSERT_EQUAL_UINT64(expected, clock.extend((uint32_t)expected));
+  }
+  TEST_ASSERT_EQUAL_UINT64(5U, expected / WRAP);
+
+  clock.reset();
+  TEST_ASSERT_EQUAL_UINT64(0x10U, clock.extend(0x10U));
+}
+
+/* FIFO TIMESTAMP words either side of the wrap time samples on one line */
+static void test_decoder_times_samples_across_the_wrap()
+{
+  LSM6DSOXSensor sensor(&Wire, LSM6DSOX_I2C_ADD_L);
+  LSM6DSOXTimestamp clock;
+  LSM6DSOXFifoDecoder decoder(&sensor, &clock);
+  static const int16_t v[3] = { 1, 2, 3 };
+  const uint32_t before = 0xFFFFFFD8U;   /* 40 ticks, one slot, before the wrap */
+  uint8_t words[5 * 7];
+
+  /* 1 kHz slots are 40 ticks; TIMESTAMP every second slot */
+  decoder.set_slot_rate(1000.0f);
+  putTimestamp(&words[0], 0, before);
+  putNC(&words[7], LSM6DSOX_XL_NC_TAG, 0, v);
+  putNC(&words[14], LSM6DSOX_XL_NC_TAG, 1, v);
+  putTimestamp(&words[21], 2, before + 80U);
+  putNC(&words[28], LSM6DSOX_XL_NC_TAG, 2, v);
+  decoder.decode(words, 5);
+
+  LSM6DSOX_FIFO_Axes_t sample[3];
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(decoder.xl.pop(&sample[i]));
+  }
+  TEST_ASSERT_EQUAL_UINT64((uint64_t)before * LSM6DSOX_TIMESTAMP_TICK_US, sample[0].timestamp_us);
+  TEST_ASSERT_EQUAL_UINT64(sample[0].timestamp_us + 1000U, sample[1].timestamp_us);
+  TEST_ASSERT_EQUAL_UINT64((WRAP + 40U) * LSM6DSOX_TIMESTAMP_TICK_US, sample[2].timestamp_us);
+
+  /* The wrap is not mistaken for lost slots */
+  TEST_ASSERT_EQUAL_UINT32(0, decoder.lost_slots);
+  TEST_ASSERT_EQUAL(0, decoder.gaps.available());
+}
+
+void runTimestampTests()
+{
+  RUN_TEST(test_extend_carries_across_the_wrap);
+  RUN_TEST(test_extend_places_late_readings_before_the_newest);
+  RUN_TEST(test_extend_counts_every_wrap);
+  RUN_TEST(test_decoder_times_samples_across_the_wrap);
+}
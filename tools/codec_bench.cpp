@@ -0,0 +1,170 @@
+// Compression ratio and encode cost of the sensors.qo delta codec
+// (src/SampleCodec.h) on recorded motion traces.
+//
+// Reads trace CSVs in the simulator's format (t_ms,ax,ay,az[,gx,gy,gz][,mlc],
+// mg and mdps; see LSM6DSOXSim), quantises them to int16 counts at the
+// full-scale sensitivities the firmware reports, cuts them into windows of
+// the firmware's size and encodes each run as writeBinaryData() would. Every
+// window is decoded again and compared with its input.
+//
+// Build and run on the host:
+//   g++ -O2 -I src -I lib/ArduinoHost/src -o codec_bench
+//       tools/codec_bench.cpp src/SampleCodec.cpp
+//   ./codec_bench [-w records] [-g mg_per_lsb] [-d mdps_per_lsb] trace.csv ...
+//
+// Cycle counts use the time-stamp counter on x86 and are only a guide to
+// the Cortex-M4; nanoseconds are given alongside.
+
+#include "SampleCodec.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cycles() { return __rdtsc(); }
+#define HAVE_CYCLES 1
+#else
+static inline uint64_t cycles() { return 0; }
+#define HAVE_CYCLES 0
+#endif
+
+struct Totals {
+  uint64_t records = 0;
+  uint64_t raw = 0;
+  uint64_t coded = 0;
+  uint64_t cycles = 0;
+  uint64_t ns = 0;
+  uint32_t windows = 0;
+  uint32_t errors = 0;
+};
+
+static int16_t quantise(double v, double per_lsb) {
+  double c = std::lround(v / per_lsb);
+  if (c > 32767) c = 32767;
+  if (c < -32768) c = -32768;
+  return (int16_t)c;
+}
+
+static void putRecord(std::vector<uint8_t> &out, const int16_t v[3]) {
+  for (int a = 0; a < 3; a++) {
+    out.push_back((uint8_t)(v[a] & 0xFF));
+    out.push_back((uint8_t)((uint16_t)v[a] >> 8));
+  }
+}
+
+static void runWindow(const uint8_t *records, uint16_t count, Totals &t) {
+  std::vector<uint8_t> out(count * SAMPLE_CODEC_MAX_RECORD);
+  std::vector<int16_t> back(count * 3);
+  const int reps = 20;
+  size_t n = 0;
+
+  // Best of several runs, to keep the figure clear of scheduling noise
+  uint64_t best_cycles = UINT64_MAX;
+  uint64_t best_ns = UINT64_MAX;
+  for (int r = 0; r < reps; r++) {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    n = sampleCodecEncode(records, count, out.data());
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    if (c1 - c0 < best_cycles) best_cycles = c1 - c0;
+    if (ns < best_ns) best_ns = ns;
+  }
+
+  size_t used = 0;
+  uint16_t got = sampleCodecDecode(out.data(), n, (int16_t (*)[3])back.data(), count, &used);
+  if (got != count || used != n ||
+      memcmp(back.data(), records, (size_t)count * 6) != 0) {  // little-endian host
+    t.errors++;
+  }
+
+  if (sampleCodecMeasure(records, count, NULL) != n) t.errors++;
+
+  t.records += count;
+  t.raw += (uint64_t)count * 6;
+  t.coded += n;
+  t.cycles += best_cycles;
+  t.ns += best_ns;
+  t.windows++;
+}
+
+static void report(const char *name, const char *run, const Totals &t) {
+  if (t.records == 0) return;
+  // Both go out base64-coded, so the ratio carries straight through
+  printf("%-28s %-4s %4u win %7llu rec  %5.2f B/rec  ratio %4.2f  b64 %7llu -> %7llu  ",
+         name, run, t.windows, (unsigned long long)t.records,
+         (double)t.coded / t.records, (double)t.raw / t.coded,
+         (unsigned long long)(4 * ((t.raw + 2) / 3)), (unsigned long long)(4 * ((t.coded + 2) / 3)));
+  if (HAVE_CYCLES) printf("%5.1f cyc/rec  ", (double)t.cycles / t.records);
+  printf("%5.1f ns/rec%s\n", (double)t.ns / t.records, t.errors ? "  ROUND TRIP FAILED" : "");
+}
+
+int main(int argc, char **argv) {
+  unsigned window = 600;          // MAX_SAMPLES in main.cpp
+  double mg_per_lsb = 0.061;     // +/-2 g
+  double mdps_per_lsb = 70.0;    // +/-2000 dps
+  int status = 0;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i += 2) {
+    if (i + 1 >= argc) break;
+    if (!strcmp(argv[i], "-w")) window = (unsigned)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-g")) mg_per_lsb = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-d")) mdps_per_lsb = atof(argv[i + 1]);
+    else break;
+  }
+  if (i >= argc || window == 0 || window > 65535) {
+    fprintf(stderr, "usage: %s [-w records] [-g mg_per_lsb] [-d mdps_per_lsb] trace.csv ...\n",
+            argv[0]);
+    return 2;
+  }
+
+  for (; i < argc; i++) {
+    FILE *f = fopen(argv[i], "r");
+    if (!f) {
+      perror(argv[i]);
+      status = 1;
+      continue;
+    }
+
+    std::vector<uint8_t> xl, gy;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      double v[8];
+      int n = sscanf(line, "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+                     &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+      if (n < 4) continue;   // header, comment or blank line
+      int16_t a[3] = { quantise(v[1], mg_per_lsb), quantise(v[2], mg_per_lsb),
+                       quantise(v[3], mg_per_lsb) };
+      putRecord(xl, a);
+      if (n >= 7) {
+        int16_t g[3] = { quantise(v[4], mdps_per_lsb), quantise(v[5], mdps_per_lsb),
+                         quantise(v[6], mdps_per_lsb) };
+        putRecord(gy, g);
+      }
+    }
+    fclose(f);
+
+    const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+    Totals txl, tgy;
+    for (size_t off = 0; off < xl.size(); off += (size_t)window * 6) {
+      size_t left = (xl.size() - off) / 6;
+      runWindow(&xl[off], (uint16_t)(left < window ? left : window), txl);
+    }
+    for (size_t off = 0; off < gy.size(); off += (size_t)window * 6) {
+      size_t left = (gy.size() - off) / 6;
+      runWindow(&gy[off], (uint16_t)(left < window ? left : window), tgy);
+    }
+    report(name, "xl", txl);
+    report(name, "gy", tgy);
+    if (txl.errors || tgy.errors) status = 1;
+  }
+
+  return status;
+}
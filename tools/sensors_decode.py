@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Decode sensors.qo notes into CSV.
+
+Reads JSON lines: the requests the firmware sends (the host build writes
+them to $TALON_HOST_NOTES) or Notehub events, anything with a sensors.qo
+"body". The records are base64 in the body's "data", or for notes sent
+through the Notecard's binary buffer, the base64 "payload" beside it.
+Writes one CSV row per record:
+
+    note,sensor,index,x,y,z
+
+sensor is "xl" (mg) or "gy" (mdps), or raw int16 counts with --raw.
+
+Formats:
+  2  base64 of int16 little-endian x,y,z records: "samples" accelerometer
+     records, then "gyro_samples" gyroscope records
+  3  the same records delta/zigzag/varint coded (src/SampleCodec.h): per
+     axis the difference from the record before, zigzag-mapped and
+     written as LEB128; the gyroscope run starts again from zero
+
+Usage: sensors_decode.py [--raw] [notes.jsonl ...]   (stdin if no file)
+"""
+
+import base64
+import csv
+import json
+import struct
+import sys
+
+
+def decode_raw(data, count):
+    if len(data) < count * 6:
+        raise ValueError("%d bytes for %d records" % (len(data), count))
+    return [struct.unpack_from("<3h", data, i * 6) for i in range(count)], count * 6
+
+
+def decode_delta(data, count):
+    records = []
+    prev = [0, 0, 0]
+    n = 0
+    for _ in range(count):
+        for a in range(3):
+            z = 0
+            shift = 0
+            while True:
+                if n >= len(data) or shift > 14:
+                    raise ValueError("truncated or malformed varint at byte %d" % n)
+                b = data[n]
+                n += 1
+                z |= (b & 0x7F) << shift
+                shift += 7
+                if not b & 0x80:
+                    break
+            prev[a] += (z >> 1) ^ -(z & 1)
+            if not -32768 <= prev[a] <= 32767:
+                raise ValueError("sample out of range at byte %d" % n)
+        records.append(tuple(prev))
+    return records, n
+
+
+def decode_body(body, payload):
+    fmt = body.get("format")
+    data = base64.b64decode(body["data"] if "data" in body else payload)
+    xl_count = int(body.get("samples", 0))
+    gy_count = int(body.get("gyro_samples", 0))
+
+    if fmt == 2:
+        decode = decode_raw
+    elif fmt == 3:
+        decode = decode_delta
+    else:
+        raise ValueError("unsupported format %r" % fmt)
+
+    xl, used = decode(data, xl_count)
+    gy, used_gy = decode(data[used:], gy_count)
+    if used + used_gy != len(data):
+        raise ValueError("%d bytes left over" % (len(data) - used - used_gy))
+    return xl, gy
+
+
+def main(argv):
+    raw = "--raw" in argv
+    paths = [a for a in argv if a != "--raw"]
+    out = csv.writer(sys.stdout, lineterminator="\n")
+    out.writerow(["note", "sensor", "index", "x", "y", "z"])
+
+    note = 0
+    for f in [open(p) for p in paths] or [sys.stdin]:
+        for line in f:
+            line = line.strip()
+            if line.startswith("notecard> "):
+                line = line[len("notecard> "):]
+            if not line.startswith("{"):
+                continue
+            msg = json.loads(line)
+            body = msg.get("body")
+            payload = msg.get("payload")
+            if msg.get("file") != "sensors.qo" or not body or ("data" not in body and not payload):
+                continue
+
+            try:
+                xl, gy = decode_body(body, payload)
+            except ValueError as e:
+                print("note %d: %s" % (note, e), file=sys.stderr)
+                note += 1
+                continue
+
+            scales = (("xl", xl, body.get("mg_per_lsb", 1.0)),
+                      ("gy", gy, body.get("mdps_per_lsb", 1.0)))
+            for sensor, records, scale in scales:
+                for i, rec in enumerate(records):
+                    if raw:
+                        out.writerow([note, sensor, i] + list(rec))
+                    else:
+                        out.writerow([note, sensor, i] + ["%.3f" % (v * scale) for v in rec])
+            note += 1
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])